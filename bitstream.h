@@ -0,0 +1,40 @@
+/*************************************************************************
+ *
+ *	Name:		bitstream.h
+ *	Description:	bit operations for the read stream (bitstream),
+ *			done on a 64-bit cache which is left-aligned (the
+ *			next bit is the MSB) and refilled a word at a time
+ *			(included by header.c, codec.c and huffman.c)
+ *
+ *************************************************************************/
+
+#ifndef BITSTREAM_DONE
+#define BITSTREAM_DONE
+
+#include "globals.h"
+
+/*************************************************************************/
+/* the read_cache is kept in the session (see context.h):
+ * read_cache keeps read_cache_bits unread bits from the MSB ('0's after
+ * EOF), and read_cache_word is a temporary for get_n_bits() */
+
+/* make sure n bits (n<=32) in read_cache unless EOF */
+#define NEED_BITS(n) (((n)>read_cache_bits) ? fill_read_cache() : 0)
+
+/* look at the next n bits (1<=n<=32) without moving the read position */
+#define peek_bits(n) \
+	(NEED_BITS(n), (int32) (read_cache >> (64 - (n))))
+
+/* skip n bits which have been got by peek_bits() */
+#define skip_bits(n) \
+	(read_cache <<= (n),\
+	 (((read_cache_bits -= (n)) < 0) ? eof_read_error() : 0))
+
+/* get n bits (1<=n<=32) in one word */
+#define get_n_bits(n) \
+	(read_cache_word = peek_bits(n), skip_bits(n), read_cache_word)
+
+/* get 1 bit ('1' or '0') */
+#define get_bit() ((int16) get_n_bits(1))
+
+#endif
@@ -10,15 +10,16 @@
 #include "globals.h"
 #include "mytime.h"     /* TIME-type variables definition & function */
 #include "thresh.h"	/* threshold values definition */
+#include "bitstream.h"	/* bit operations for the read stream */
 
 /*************************************************************************/
 /* public */
 /* for encoder */
 extern boolean quantize(boolean intra_used, int16 *block, int16 quantizer);
-extern void transfer_TCOEFF(boolean intra_used, int16 *block);
+extern int16 transfer_TCOEFF(boolean intra_used, int16 *block, bytes8 *mask);
 /* for decoder */
 extern void Iquantize(boolean intra_used, int16 *block, int16 quantizer);
-extern void Itransfer_TCOEFF(boolean intra_used, int16 *block);
+extern int16 Itransfer_TCOEFF(boolean intra_used, int16 *block, bytes8 *mask);
 extern void clip_reconstructed_block(int16 *block);
 
 extern DHUFF *T1_Dhuff;
@@ -120,13 +121,15 @@ boolean quantize(boolean intra_used, int16 *block, int16 quantizer)
  *	Description:	transfer TCOEFF (block) out to the bitstream
  * 			according to suitable huffman (VLC) table
  *	Input:          the block to be transfered, boolean to indicate
- *			intra block
- *	Return:		none
- *	Side effects:	some entries of the block may be changed (cliped)
+ *			intra block, and the non-zero mask to be got
+ *	Return:		the last non-zero zig-zag index (see sparse_IDCT())
+ *	Side effects:	some entries of the block may be changed (cliped),
+ *			and the mask of the non-zero TCOEFFs (by their
+ *			positions in the block) will be set
  *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
  *
  *************************************************************************/
-void transfer_TCOEFF(boolean intra_used, int16 *block)
+int16 transfer_TCOEFF(boolean intra_used, int16 *block, bytes8 *mask)
 {
 	DEBUG("transfer_TCOEFF");
 	int16 run;	/* (run) # of Zero term between two NonZero terms */
@@ -134,7 +137,7 @@ void transfer_TCOEFF(boolean intra_used, int16 *block)
 	int16 code;	/* code = [run|abs(*level)]
 				where run is in the right 6-bits,
 				  and abs(*level) is in the left 8-bits */
-	int16 i;
+	int16 i, last;
 
 	if (intra_used) {
 		/* dc term : always put 8 bits for that */
@@ -142,6 +145,8 @@ void transfer_TCOEFF(boolean intra_used, int16 *block)
 		code = ((*block==128) ? 255 : *block);
 		put_n_bits(8, (int32) code);
 		i = 1;
+		last = 0;
+		*mask = 1;
 	} else {
 		/* there exists a non-zero coefficient in the block,
 		 * thus the EOB cannot occur as the first element and
@@ -152,6 +157,8 @@ void transfer_TCOEFF(boolean intra_used, int16 *block)
 		for (i=run=0; *(level=block+zigzag_index[i++])==0; run++);
 
 		/* *level is a NonZero term */
+		last = i - 1;
+		*mask = (bytes8) 1 << (level - block);
 		BOUND(*level, -127, 127);
 		code = abs(*level) | (run << 8);
 		if ((code==ESCAPE) || (!put_VLC(code, T2_Ehuff))) {
@@ -172,6 +179,8 @@ void transfer_TCOEFF(boolean intra_used, int16 *block)
 			run++;
 		} else {
 			/* *level is NonZero term */
+			last = i - 1;
+			*mask |= (bytes8) 1 << (level - block);
 			BOUND(*level, -127, 127);
 			code = abs(*level) | (run << 8);
 			if ((code==ESCAPE) || (!put_VLC(code, T1_Ehuff))) {
@@ -187,6 +196,8 @@ void transfer_TCOEFF(boolean intra_used, int16 *block)
 		}
 	}
 	put_VLC(EOB, T1_Ehuff);	/* add EOB finally */
+
+	return last;
 }
 
 /*************************************************************************
@@ -240,16 +251,18 @@ void Iquantize(boolean intra_used, int16 *block, int16 quantizer)
  *	Description:	inverse-transfer TCOEFF (block) from the bitstream
  * 			according to suitable huffman (VLD) table
  *	Input:          the block to be stored, boolean to indicate
- *			intra block
- *	Return:		none
- *	Side effects:	entries of the block will be changed
+ *			intra block, and the non-zero mask to be got
+ *	Return:		the last non-zero zig-zag index (see sparse_IDCT())
+ *	Side effects:	entries of the block will be changed, and the
+ *			mask of the non-zero TCOEFFs (by their positions in
+ *			the block) will be set
  *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
  *
  *************************************************************************/
-void Itransfer_TCOEFF(boolean intra_used, int16 *block)
+int16 Itransfer_TCOEFF(boolean intra_used, int16 *block, bytes8 *mask)
 {
 	DEBUG("Itransfer_TCOEFF");
-	int16 i, run, level;
+	int16 i, run, level, last;
 
 	memset(block, 0, sizeof(int16)*BLOCKSIZE);
 
@@ -259,6 +272,8 @@ void Itransfer_TCOEFF(boolean intra_used, int16 *block)
 		if (level==255) level = 128;
 		*block = level;
 		i = 1;
+		last = 0;
+		*mask = 1;
 	} else {
 		/* there exists a non-zero coefficient in the block,
 		 * thus the EOB cannot occur as the first element and
@@ -285,6 +300,8 @@ void Itransfer_TCOEFF(boolean intra_used, int16 *block)
 		if (level&0x80) level |= (int16) 0xFF00;
 
 		i = run;
+		last = i;
+		*mask = (bytes8) 1 << zigzag_index[i];
 		block[zigzag_index[i++]] = level;
 	}
 
@@ -292,7 +309,7 @@ void Itransfer_TCOEFF(boolean intra_used, int16 *block)
 	while (i<BLOCKSIZE) {
 		run = get_VLC(T1_Dhuff);
 		if (!run) {                  	/* find nothing (EOF) */
-			return;
+			return last;
 		} else if (run==ESCAPE) {
 			run = (int16) get_n_bits(6);
 			level = (int16) get_n_bits(8);
@@ -305,6 +322,8 @@ void Itransfer_TCOEFF(boolean intra_used, int16 *block)
 		if (level&0x80) level |= (int16) 0xFF00;
 
 		i += run;
+		last = i;
+		*mask |= (bytes8) 1 << zigzag_index[i];
 		block[zigzag_index[i++]] = level;
 	}
 
@@ -318,6 +337,8 @@ void Itransfer_TCOEFF(boolean intra_used, int16 *block)
 	#else
 	get_VLC(T1_Dhuff);
 	#endif
+
+	return last;
 }
 
 /*************************************************************************
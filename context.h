@@ -0,0 +1,258 @@
+/*************************************************************************
+ *
+ *	Name:		context.h
+ *	Description:	the context of an encoder or decoder session (the
+ *			state of a stream), and the parameters to create it
+ *			(included by globals.h)
+ *
+ *************************************************************************/
+
+#ifndef CONTEXT_DONE
+#define CONTEXT_DONE
+
+#include "mytime.h"	/* TIME-type for the timers */
+
+/*************************************************************************/
+/* parameters of a session, see H261_default_param() in libh261.c */
+#define H261_PARAM struct H261_Parameters
+H261_PARAM {
+	IMAGE *image;		/* image info. (referred by the session) */
+	int32 start_frame;	/* Start (the first) Frame ID */
+	int32 end_frame;	/* The last Frame ID (for encoder) */
+	int32 frame_skip;	/* code one per frame_skip frames */
+	double bit_rate;	/* bits/sec */
+	double frame_rate;	/* frames/sec */
+	double bit_per_pixel;	/* override bit_rate if not 0.0 */
+	int32 stream_buffer_size;	/* bytes of the bitstream buffer */
+	int32 read_ahead;	/* # of frames read ahead in encoder */
+	int16 me_algo;		/* FULL_SEARCH, THREE_STEP_SEARCH, ... */
+	int16 me_metric;	/* SUB64_METRIC, SAD_METRIC or SATD_METRIC */
+	int16 me_threads;	/* # of threads of motion estimation */
+	int16 me_ahead;		/* # of frames motion-estimated ahead
+				 * (pipelined, 0: no) */
+	boolean me_open_loop;	/* ME against the original frames */
+};
+
+/*************************************************************************/
+/* the context of a session: everything of a stream which was kept in
+ * globals, so that many sessions can run in one process (one thread at
+ * a time for each session)
+ * the session is bound to the running thread by Ctx, and the names below
+ * (Image, Number_GOB, rec_frame, ...) refer to the fields of the bound
+ * session; the state used only within a call (Current_GOB, Current_MB,
+ * ...) is kept by each thread (THREAD_LOCAL) instead */
+#define H261_CONTEXT struct H261_Context
+H261_CONTEXT {
+	/* global info. of image */
+	IMAGE *Image;
+
+	/* system definitions */
+	int16 Number_MB;	/* # of MacroBlock in a GOB */
+	int16 Number_GOB;	/* # of Gloup Of Block in a frame */
+	int32 Current_frame;	/* Current Frame ID */
+	int32 Start_frame;	/* Start (the first) Frame ID */
+	int32 Number_frame;	/* # of frame */
+	int32 End_frame;	/* The last Frame ID */
+	int32 Frame_skip;	/* code one per FramesSkip frames */
+	double Bit_rate;
+	double Frame_rate;
+	int32 Stream_buffer_size;	/* see open_?_stream() in io.c */
+	int32 Read_ahead;	/* see start_frame_loader() in io.c */
+	int16 ME_threads;	/* see motion_estimation() in me.c */
+	int16 ME_ahead;		/* see make_pipe_state() in pipeline.c */
+	boolean ME_open_loop;	/* (always with ME_ahead>0) */
+
+	/* for statistics */
+	int32 First_frame_bits;	/* Bits for First Frame */
+	int32 Total_bits;	/* Total (Last) Bits for coded frame */
+	int32 HeaderBits;	/* by CTRL_HEADER_BITS */
+	int32 MTYPE_count[11];	/* by CTRL_STAT_MTYPE */
+	int32 nMTYPE_mc;
+	int32 nMTYPE_not;
+	int32 VLD_symbols;	/* # of symbols decoded by get_VLC() */
+	int32 ME_candidates;	/* # of SB matchings of ME */
+	int32 ME_coarse;	/* # of 4x4/8x8 matchings of pyramid ME */
+	int32 ME_MBs;		/* # of MBs motion-estimated */
+	int32 OL_MBs;		/* # of inter MBs of open-loop ME */
+	double OL_SE;		/* squared error of their prediction by */
+	double CL_SE;		/* the open-loop and the closed-loop MVs */
+
+	/* frame stores for encoder */
+	FSTORE *ori_frame;	/* original frame in encoder */
+	FSTORE *rec_frame;	/* reconstructed frame in encoder */
+	FSTORE *ref_frame;	/* reference (last reconstructed) frame,
+				 * swapped with rec_frame per P-frame */
+	/* frame stores for decoder */
+	FSTORE *reco_frame;	/* reconstructed frame in decoder */
+	FSTORE *last_frame;	/* last reconstructed frame in decoder */
+
+	/* MB info. of the last frame (of Size_frame bytes) */
+	int16 *MTYPE_frame;
+	int16 *MVDH_frame;
+	int16 *MVDV_frame;
+	int16 *Last_update;
+	int16 Size_frame;
+
+	/* look-up-tables for obtaining memloc in MEM (set_image_type()) */
+	int32 YGOB_memloc[12];
+	int32 GOB_memloc[12];
+	int32 YMB_memloc[33];
+	int32 MB_memloc[33];
+	int32 B_memloc[6];
+	int32 YMVDV_memloc[31];
+	int32 MVDV_memloc[31];
+	int32 GOB_posX[12];
+	int32 GOB_posY[12];
+	int32 MB_posX[33];
+	int32 MB_posY[33];
+
+	/* motion-estimation algo. and matching metric */
+	int16 (*default_me_algo)(MEM *, MEM *);
+	char *ME_algo_name;	/* for statistics */
+	int16 (*default_me_metric)(MEM *, MEM *, int16);
+
+	/* the read_cache of the read stream, see bitstream.h */
+	bytes8 read_cache;
+	int16 read_cache_bits;
+	int32 read_cache_word;
+
+	/* timers (by CTRL_GET_TIME), see mytime.h */
+	TIME tTOTAL1, tME1, tDCT1, tQUAN1;
+	TIME tIDCT1, tIQUAN1;
+	TIME tTOTAL2, tME2, tDCT2, tQUAN2;
+	TIME tIDCT2, tIQUAN2;
+	long tTOTAL, tME, tDCT, tQUAN;
+	long tIDCT, tIQUAN;
+	long ntTOTAL, ntME, ntDCT, ntQUAN;
+	long ntIDCT, ntIQUAN;
+	TIME tSEQ1, tSEQ2, tLOAD1, tLOAD2;
+	long tSEQ, tLOAD;	/* time of sequence (with I/O) & waiting */
+	long tPIPE, tPIPE_wait;	/* time of ME stage & waiting for it (us) */
+
+	/* private to libh261.c */
+	boolean decoder;	/* a decoder session (not encoder) */
+	PIC_HEADER *pic_header;
+	GOB_HEADER *gob_header;
+	int32 bits_per_frame, buffer_size, target_bits;
+	int32 coded_frames;	/* # of frames coded (decoded) */
+	int16 first_TR;		/* TR of Start_frame in decoder */
+	boolean end_of_stream;	/* decoder has got the end */
+	BIT_BUFFER GOB_bits[12];	/* of the GOBs coded in parallel */
+
+	/* private to stat.c */
+	int32 total_MTYPE_count[11];
+	int32 total_nMTYPE_mc;
+	int32 total_nMTYPE_not;
+	double psnr_y, psnr_cb, psnr_cr;
+	double sum_psnr[NUMBER_OF_COMPONENTS];
+	int32 last_bits;
+
+	/* private to me.c, io.c and pipeline.c (see make_ME_state(),
+	 * make_IO_state() and make_pipe_state()) */
+	struct ME_State *ME_state;
+	struct IO_State *IO_state;
+	struct Pipe_State *Pipe_state;
+};
+
+/* the session bound to this thread (see H261_bind()) */
+extern THREAD_LOCAL H261_CONTEXT *Ctx;
+
+/*************************************************************************/
+/* the names of the fields of the bound session */
+#define Image		(Ctx->Image)
+
+#define Number_MB	(Ctx->Number_MB)
+#define Number_GOB	(Ctx->Number_GOB)
+#define Current_frame	(Ctx->Current_frame)
+#define Start_frame	(Ctx->Start_frame)
+#define Number_frame	(Ctx->Number_frame)
+#define End_frame	(Ctx->End_frame)
+#define Frame_skip	(Ctx->Frame_skip)
+#define Bit_rate	(Ctx->Bit_rate)
+#define Frame_rate	(Ctx->Frame_rate)
+#define Stream_buffer_size	(Ctx->Stream_buffer_size)
+#define Read_ahead	(Ctx->Read_ahead)
+#define ME_threads	(Ctx->ME_threads)
+#define ME_ahead	(Ctx->ME_ahead)
+#define ME_open_loop	(Ctx->ME_open_loop)
+
+#define First_frame_bits	(Ctx->First_frame_bits)
+#define Total_bits	(Ctx->Total_bits)
+#define HeaderBits	(Ctx->HeaderBits)
+#define MTYPE_count	(Ctx->MTYPE_count)
+#define nMTYPE_mc	(Ctx->nMTYPE_mc)
+#define nMTYPE_not	(Ctx->nMTYPE_not)
+#define VLD_symbols	(Ctx->VLD_symbols)
+#define ME_candidates	(Ctx->ME_candidates)
+#define ME_coarse	(Ctx->ME_coarse)
+#define ME_MBs		(Ctx->ME_MBs)
+#define OL_MBs		(Ctx->OL_MBs)
+#define OL_SE		(Ctx->OL_SE)
+#define CL_SE		(Ctx->CL_SE)
+
+#define ori_frame	(Ctx->ori_frame)
+#define rec_frame	(Ctx->rec_frame)
+#define ref_frame	(Ctx->ref_frame)
+#define reco_frame	(Ctx->reco_frame)
+#define last_frame	(Ctx->last_frame)
+
+#define MTYPE_frame	(Ctx->MTYPE_frame)
+#define MVDH_frame	(Ctx->MVDH_frame)
+#define MVDV_frame	(Ctx->MVDV_frame)
+#define Last_update	(Ctx->Last_update)
+#define Size_frame	(Ctx->Size_frame)
+
+#define YGOB_memloc	(Ctx->YGOB_memloc)
+#define GOB_memloc	(Ctx->GOB_memloc)
+#define YMB_memloc	(Ctx->YMB_memloc)
+#define MB_memloc	(Ctx->MB_memloc)
+#define B_memloc	(Ctx->B_memloc)
+#define YMVDV_memloc	(Ctx->YMVDV_memloc)
+#define MVDV_memloc	(Ctx->MVDV_memloc)
+#define GOB_posX	(Ctx->GOB_posX)
+#define GOB_posY	(Ctx->GOB_posY)
+#define MB_posX		(Ctx->MB_posX)
+#define MB_posY		(Ctx->MB_posY)
+
+#define default_me_algo	(Ctx->default_me_algo)
+#define ME_algo_name	(Ctx->ME_algo_name)
+#define default_me_metric	(Ctx->default_me_metric)
+
+#define read_cache	(Ctx->read_cache)
+#define read_cache_bits	(Ctx->read_cache_bits)
+#define read_cache_word	(Ctx->read_cache_word)
+
+#define tTOTAL1		(Ctx->tTOTAL1)
+#define tME1		(Ctx->tME1)
+#define tDCT1		(Ctx->tDCT1)
+#define tQUAN1		(Ctx->tQUAN1)
+#define tIDCT1		(Ctx->tIDCT1)
+#define tIQUAN1		(Ctx->tIQUAN1)
+#define tTOTAL2		(Ctx->tTOTAL2)
+#define tME2		(Ctx->tME2)
+#define tDCT2		(Ctx->tDCT2)
+#define tQUAN2		(Ctx->tQUAN2)
+#define tIDCT2		(Ctx->tIDCT2)
+#define tIQUAN2		(Ctx->tIQUAN2)
+#define tTOTAL		(Ctx->tTOTAL)
+#define tME		(Ctx->tME)
+#define tDCT		(Ctx->tDCT)
+#define tQUAN		(Ctx->tQUAN)
+#define tIDCT		(Ctx->tIDCT)
+#define tIQUAN		(Ctx->tIQUAN)
+#define ntTOTAL		(Ctx->ntTOTAL)
+#define ntME		(Ctx->ntME)
+#define ntDCT		(Ctx->ntDCT)
+#define ntQUAN		(Ctx->ntQUAN)
+#define ntIDCT		(Ctx->ntIDCT)
+#define ntIQUAN		(Ctx->ntIQUAN)
+#define tSEQ1		(Ctx->tSEQ1)
+#define tSEQ2		(Ctx->tSEQ2)
+#define tLOAD1		(Ctx->tLOAD1)
+#define tLOAD2		(Ctx->tLOAD2)
+#define tSEQ		(Ctx->tSEQ)
+#define tLOAD		(Ctx->tLOAD)
+#define tPIPE		(Ctx->tPIPE)
+#define tPIPE_wait	(Ctx->tPIPE_wait)
+
+#endif
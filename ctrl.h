@@ -15,8 +15,8 @@
 /* get time info. or not */
 #define GET_TOTAL_TIME	0	/* get total time or not */
 #define GET_ALL_TIME	1	/* get times of every parts or not */
-#define CTRL_GET_TIME GET_TOTAL_TIME	/* h261.c dct.c codec.c stat.c */
-/*#define CTRL_GET_TIME GET_ALL_TIME	/* h261.c dct.c codec.c stat.c */
+#define CTRL_GET_TIME GET_TOTAL_TIME	/* h261.c libh261.c dct.c codec.c stat.c */
+/*#define CTRL_GET_TIME GET_ALL_TIME	/* h261.c libh261.c dct.c codec.c stat.c */
 
 /*************************************************************************/
 /* show thresholds or not */
@@ -24,22 +24,77 @@
 
 /*************************************************************************/
 /* show MTYPE statistic */
-/*#define CTRL_STAT_MTYPE   	/* h261.c stat.c */
+/*#define CTRL_STAT_MTYPE   	/* libh261.c stat.c */
 
 /*************************************************************************/
 /* show frame info.: bits and MTYPE statistic info for each frame */
-/*#define CTRL_FRAME_INFO   	/* h261.c stat.c */
+/*#define CTRL_FRAME_INFO   	/* libh261.c stat.c */
 
 /*************************************************************************/
 /* count header bits or not */
 /*#define CTRL_HEADER_BITS  	/* header.c stat.c */
 
+/*************************************************************************/
+/* count VLC symbols decoded by get_VLC() and show symbols/sec or not */
+/*#define CTRL_VLD_STAT		/* huffman.c libh261.c stat.c */
+
+/*************************************************************************/
+/* count the candidates (SB matchings) of motion estimation and show
+ * them per MB or not */
+#define CTRL_ME_STAT		/* me.c stat.c */
+
+/*************************************************************************/
+/* also run the closed-loop ME on the reconstructed frames for the loss of
+ * the prediction by the open-loop MVs (-g, -f) or not */
+/*#define CTRL_OPEN_LOOP_COST	/* pipeline.c stat.c */
+
+/*************************************************************************/
+/* motion-estimate the rows of MBs by the threads of -j or not */
+#define CTRL_ME_THREAD		/* me.c */
+
+/*************************************************************************/
+/* encode the GOBs of a P-frame by the threads of -j or not */
+#define CTRL_GOB_THREAD		/* libh261.c */
+
+/*************************************************************************/
+/* write out the bitstream by a writer thread or not */
+#define CTRL_WRITE_THREAD	/* io.c */
+
+/*************************************************************************/
+/* read frames ahead of the encoder by a loader thread or not */
+#define CTRL_READ_THREAD	/* io.c */
+
+/*************************************************************************/
+/* write frames behind the decoder by a saver thread or not */
+#define CTRL_SAVE_THREAD	/* io.c */
+
+/*************************************************************************/
+/* map the whole bitstream file for read (mmap()) or fread() it only */
+#define CTRL_READ_MMAP		/* h261.c */
+
+/*************************************************************************/
+/* pin the threads of the encode server (-x) on the cores or not */
+#define CTRL_PIN_THREADS	/* server.c */
+
+/*************************************************************************/
+/* use SIMD (SSE2/AVX2) SAD kernels chosen by CPUID or the C ones only */
+#define CTRL_SIMD_SAD		/* sad.c */
+/* prefer the AVX2 SAD kernels to the SSE2 ones or not */
+/*#define CTRL_SAD_AVX2		/* sad.c */
+
+/*************************************************************************/
+/* use SIMD (SSE2/AVX2) DCT and IDCT kernels chosen by CPUID or the C ones
+ * only (the same results) */
+#define CTRL_SIMD_DCT		/* dct.c */
+/* prefer the AVX2 DCT and IDCT kernels to the SSE2 ones or not */
+#define CTRL_DCT_AVX2		/* dct.c */
+
 /*************************************************************************/
 /* run statistics() (obtain psnr for each frame) or not */
-#define CTRL_PSNR		/* h261.c stat.c */
+#define CTRL_PSNR		/* libh261.c stat.c */
 
 /*************************************************************************/
 /* all intra mode or not */
-/*#define CTRL_ALL_INTRA   	/* h261.c */
+/*#define CTRL_ALL_INTRA   	/* libh261.c */
 
 #endif
@@ -4,6 +4,49 @@
    IEEE Trans. Comm., vol COM-25, no. 9, Sep. 1977, pp. 1004-1009.
 */
 
+#include "globals.h"
+#include "ctrl.h"
+#include "mytime.h"     /* TIME-type variables definition & function */
+
+/* SIMD kernels need GCC (or clang) on x86 */
+#if defined(CTRL_SIMD_DCT) && defined(__GNUC__) \
+	&& (defined(__x86_64__) || defined(__i386__))
+#define SIMD_DCT
+#include <immintrin.h>
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+/*************************************************************************/
+/* public */
+extern void init_DCT(void);
+extern void benchmark_DCT(void);
+extern void sparse_IDCT(int16 *block, int16 last, bytes8 mask);
+extern void DCT_blocks(int16 *x, int16 *y, int16 n);
+/* the chosen kernels (see use_DCT() and use_DCT_blocks() in libh261.c,
+ * and sparse_IDCT()) */
+void (*default_DCT)(int16 *, int16 *) = DCT;
+void (*default_IDCT)(int16 *, int16 *) = IDCT;
+void (*default_DCT_blocks)(int16 *, int16 *, int16) = DCT_blocks;
+
+/*************************************************************************/
+/* private */
+static void IDCT_DC(int16 *x, int16 *y);
+static void IDCT_4x4(int16 *x, int16 *y);
+#ifdef SIMD_DCT
+static void DCT_SSE2(int16 *x, int16 *y);
+static void IDCT_SSE2(int16 *x, int16 *y);
+static void IDCT_4x4_SSE2(int16 *x, int16 *y);
+static void DCT_AVX2(int16 *x, int16 *y);
+static void IDCT_AVX2(int16 *x, int16 *y);
+static void DCT_AVX2x2(int16 *x, int16 *y);
+static void DCT_blocks_AVX2(int16 *x, int16 *y, int16 n);
+#endif
+/* the chosen kernel of the 4x4 low-pass blocks (see sparse_IDCT()) */
+static void (*default_IDCT_4x4)(int16 *, int16 *) = IDCT_4x4;
+
+/* the TCOEFFs in the 4x4 low-pass (by the mask of positions 0..63) */
+#define LOWPASS_MASK 0x000000000f0f0f0fULL
+
 /* Define shift operations */
 #define LS(r,s) ((r) << (s))
 #define RS(r,s) ((r) >> (s))       /* Caution with rounding... */
@@ -366,3 +409,884 @@ void IDCT(short int *x, short int *y)
                 *aptr = (((*aptr<0) ? (*aptr-8) : (*aptr+8)) /16);
 }
 
+/*************************************************************************
+ *
+ *	Name:		init_DCT()
+ *	Description:	choose the DCT and IDCT kernels by CPUID (SSE2 or
+ *			C, or AVX2 first if CTRL_DCT_AVX2)
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	default_DCT, default_IDCT and default_DCT_blocks
+ *			will be set
+ *
+ *************************************************************************/
+void init_DCT(void)
+{
+	DEBUG("init_DCT");
+
+	default_DCT = DCT;
+	default_IDCT = IDCT;
+	default_DCT_blocks = DCT_blocks;
+	default_IDCT_4x4 = IDCT_4x4;
+
+	#ifdef SIMD_DCT
+	__builtin_cpu_init();
+	#ifdef CTRL_DCT_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		default_DCT = DCT_AVX2;
+		default_IDCT = IDCT_AVX2;
+		default_DCT_blocks = DCT_blocks_AVX2;
+	} else
+	#endif
+	if (__builtin_cpu_supports("sse2")) {
+		default_DCT = DCT_SSE2;
+		default_IDCT = IDCT_SSE2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+		default_IDCT_4x4 = IDCT_4x4_SSE2;
+	#endif
+}
+
+/*************************************************************************
+ *
+ *	Name:		DCT_blocks()
+ *	Description:	DCT() of n blocks one after the other (of a MB or
+ *			the MBs of a GOB) by default_DCT
+ *	Input:		the n blocks (x may be y) and n
+ *	Return:		none
+ *	Side effects:	see DCT()
+ *
+ *************************************************************************/
+void DCT_blocks(int16 *x, int16 *y, int16 n)
+{
+	DEBUG("DCT_blocks");
+
+	for (; n>0; n--,x+=BLOCKSIZE,y+=BLOCKSIZE) (*default_DCT)(x, y);
+}
+
+/*************************************************************************
+ *
+ *	Name:		sparse_IDCT()
+ *	Description:	IDCT() of a block of TCOEFFs by the positions of
+ *			its non-zero TCOEFFs: a DC-only block is filled by
+ *			its DC, a 4x4 low-pass one is by the low-pass IDCT,
+ *			and others are by the full IDCT (the same results)
+ *	Input:		the block, the last non-zero zig-zag index and
+ *			the non-zero mask (see Itransfer_TCOEFF())
+ *	Return:		none
+ *	Side effects:	entries of the block will be changed
+ *
+ *************************************************************************/
+void sparse_IDCT(int16 *block, int16 last, bytes8 mask)
+{
+	DEBUG("sparse_IDCT");
+
+	if (last==0) IDCT_DC(block, block);
+	else if (!(mask & ~LOWPASS_MASK)) (*default_IDCT_4x4)(block, block);
+	else (*default_IDCT)(block, block);
+}
+
+/*************************************************************************
+ *
+ *	Name:		IDCT_DC()
+ *	Description:	IDCT() of a block of the DC only
+ *	Input:		see IDCT()
+ *	Return:		none
+ *	Side effects:	see IDCT()
+ *
+ *************************************************************************/
+static void IDCT_DC(int16 *x, int16 *y)
+{
+	DEBUG("IDCT_DC");
+	int16 i, dc;
+
+	/* the butterflies of IDCT() on the DC: only c1d4 in both passes
+	 * (the others are of zeros), then all are the same */
+	dc = *x * 4;
+	dc = MSCALE(c1d4 * dc);
+	dc = MSCALE(c1d4 * dc);
+	dc = ((dc<0) ? (dc-8) : (dc+8)) / 16;
+
+	for (i=0; i<BLOCKSIZE; i++) y[i] = dc;
+}
+
+/* the butterflies of IDCT() with the inputs 4..7 of zeros (b0 = x0,
+ * a0 = x1, b2 = x2 and a1 = x3), the outputs to ptr[0], ptr[s], ... */
+#define CHEN_IDCT_4(ptr, s) {\
+		c0 = MSCALE(c7d16*a0);\
+		c1 = MSCALE(-(c5d16*a1));\
+		c2 = MSCALE(c3d16*a1);\
+		c3 = MSCALE(c1d16*a0);\
+		a0 = a1 = MSCALE(c1d4*b0);\
+		a2 = MSCALE(c3d8*b2);\
+		a3 = MSCALE(c1d8*b2);\
+		b0 = a0+a3;\
+		b1 = a1+a2;\
+		b2 = a1-a2;\
+		b3 = a0-a3;\
+		a0 = c0+c1;\
+		a1 = c0-c1;\
+		a2 = c3-c2;\
+		a3 = c3+c2;\
+		c1 = MSCALE(c1d4*(a2-a1));\
+		c2 = MSCALE(c1d4*(a2+a1));\
+		ptr[0] = b0+a3;\
+		ptr[s] = b1+c2;\
+		ptr[2*(s)] = b2+c1;\
+		ptr[3*(s)] = b3+a0;\
+		ptr[4*(s)] = b3-a0;\
+		ptr[5*(s)] = b2-c1;\
+		ptr[6*(s)] = b1-c2;\
+		ptr[7*(s)] = b0-a3;\
+	}
+
+/*************************************************************************
+ *
+ *	Name:		IDCT_4x4()
+ *	Description:	IDCT() of a block with the 4x4 low-pass TCOEFFs
+ *			only (the others are zeros)
+ *	Input:		see IDCT()
+ *	Return:		none
+ *	Side effects:	see IDCT()
+ *
+ *************************************************************************/
+static void IDCT_4x4(int16 *x, int16 *y)
+{
+	DEBUG("IDCT_4x4");
+	int16 i;
+	int16 *aptr;
+	int16 a0, a1, a2, a3, b0, b1, b2, b3, c0, c1, c2, c3;
+
+	/* loop over the columns 0..3 (the others are zeros) */
+	for (i=0; i<4; i++) {
+		aptr = x+i;
+		b0 = aptr[0] * 4;
+		a0 = aptr[8] * 4;
+		b2 = aptr[16] * 4;
+		a1 = aptr[24] * 4;
+		aptr = y+i;
+		CHEN_IDCT_4(aptr, 8);
+	}
+
+	/* loop over rows (of the elements 0..3 only) */
+	for (i=0; i<8; i++) {
+		aptr = y+LS(i,3);
+		b0 = aptr[0];
+		a0 = aptr[1];
+		b2 = aptr[2];
+		a1 = aptr[3];
+		CHEN_IDCT_4(aptr, 1);
+	}
+
+	for (i=0, aptr=y; i<64; i++, aptr++)
+		*aptr = (((*aptr<0) ? (*aptr-8) : (*aptr+8)) /16);
+}
+
+#ifdef SIMD_DCT
+/*************************************************************************/
+/* SIMD versions: the same butterflies as DCT() and IDCT(), on the 8
+ * columns (or the 8 rows of the transposed block) at a time, so that the
+ * results are the same as the scalar ones (bit-exact for all inputs):
+ * - a short variable is kept as a 16-bit lane (or the low 16 bits of a
+ *   32-bit lane), where wrapped additions are the same as the
+ *   truncations to short of the scalar versions
+ * - MSCALE(c1*x + c2*y) is pmaddwd of the pairs (x, y) and (c1, c2) in
+ *   32 bits, then the bits 9..24 as a short
+ * - RS(x+y, 1) (of 17 bits) is obtained without the overflow */
+
+/* the pairs of constants of pmaddwd */
+#define PAIR_SSE2(c1, c2) \
+	_mm_setr_epi16(c1, c2, c1, c2, c1, c2, c1, c2)
+#define PAIR_AVX2(c1, c2) \
+	_mm256_setr_epi16(c1, c2, c1, c2, c1, c2, c1, c2,\
+			  c1, c2, c1, c2, c1, c2, c1, c2)
+
+/* MSCALE(c1*x + c2*y) of 8 shorts, where c is PAIR_xxx(c1, c2) */
+#define MSCALE_SSE2(x, y, c) \
+	_mm_packs_epi32(\
+	  _mm_srai_epi32(_mm_slli_epi32(\
+	    _mm_madd_epi16(_mm_unpacklo_epi16(x, y), c), 7), 16),\
+	  _mm_srai_epi32(_mm_slli_epi32(\
+	    _mm_madd_epi16(_mm_unpackhi_epi16(x, y), c), 7), 16))
+#define MSCALE_AVX2x2(x, y, c) \
+	_mm256_packs_epi32(\
+	  _mm256_srai_epi32(_mm256_slli_epi32(\
+	    _mm256_madd_epi16(_mm256_unpacklo_epi16(x, y), c), 7), 16),\
+	  _mm256_srai_epi32(_mm256_slli_epi32(\
+	    _mm256_madd_epi16(_mm256_unpackhi_epi16(x, y), c), 7), 16))
+#define MSCALE_AVX2(x, y, c) \
+	_mm256_srai_epi32(_mm256_slli_epi32(_mm256_madd_epi16(\
+	  _mm256_or_si256(_mm256_and_si256(x, low16),\
+	    _mm256_slli_epi32(y, 16)), c), 7), 16)
+
+/* RS(x+y, 1) and RS(x-y, 1) of 8 shorts */
+#define HALF_ADD_SSE2(x, y) \
+	_mm_add_epi16(_mm_add_epi16(_mm_srai_epi16(x, 1),\
+	  _mm_srai_epi16(y, 1)), _mm_and_si128(_mm_and_si128(x, y), one))
+#define HALF_SUB_SSE2(x, y) \
+	_mm_sub_epi16(_mm_sub_epi16(_mm_srai_epi16(x, 1),\
+	  _mm_srai_epi16(y, 1)), _mm_and_si128(_mm_andnot_si128(x, y), one))
+#define HALF_ADD_AVX2x2(x, y) \
+	_mm256_add_epi16(_mm256_add_epi16(_mm256_srai_epi16(x, 1),\
+	  _mm256_srai_epi16(y, 1)),\
+	  _mm256_and_si256(_mm256_and_si256(x, y), one))
+#define HALF_SUB_AVX2x2(x, y) \
+	_mm256_sub_epi16(_mm256_sub_epi16(_mm256_srai_epi16(x, 1),\
+	  _mm256_srai_epi16(y, 1)),\
+	  _mm256_and_si256(_mm256_andnot_si256(x, y), one))
+#define HALF_ADD_AVX2(x, y) \
+	_mm256_add_epi32(_mm256_add_epi32(_mm256_srai_epi32(x, 1),\
+	  _mm256_srai_epi32(y, 1)),\
+	  _mm256_and_si256(_mm256_and_si256(x, y), one))
+#define HALF_SUB_AVX2(x, y) \
+	_mm256_sub_epi32(_mm256_sub_epi32(_mm256_srai_epi32(x, 1),\
+	  _mm256_srai_epi32(y, 1)),\
+	  _mm256_and_si256(_mm256_andnot_si256(x, y), one))
+
+/* the additions of shorts */
+#define ADD_SSE2	_mm_add_epi16
+#define SUB_SSE2	_mm_sub_epi16
+#define ADD_AVX2	_mm256_add_epi32
+#define SUB_AVX2	_mm256_sub_epi32
+#define ADD_AVX2x2	_mm256_add_epi16
+#define SUB_AVX2x2	_mm256_sub_epi16
+
+/* the butterflies of ChenDct_1D() on v[0..7] (a0..a3 and c0..c3 are got
+ * from them by LS_xxx() in the 1st pass or HALF_xxx() in the 2nd one) */
+#define CHEN_DCT(ISA, FIRST, v) {\
+		a0 = FIRST##ADD_##ISA(v[0], v[7]);\
+		c3 = FIRST##SUB_##ISA(v[0], v[7]);\
+		a1 = FIRST##ADD_##ISA(v[1], v[6]);\
+		c2 = FIRST##SUB_##ISA(v[1], v[6]);\
+		a2 = FIRST##ADD_##ISA(v[2], v[5]);\
+		c1 = FIRST##SUB_##ISA(v[2], v[5]);\
+		a3 = FIRST##ADD_##ISA(v[3], v[4]);\
+		c0 = FIRST##SUB_##ISA(v[3], v[4]);\
+		b0 = ADD_##ISA(a0, a3);	b1 = ADD_##ISA(a1, a2);\
+		b2 = SUB_##ISA(a1, a2);	b3 = SUB_##ISA(a0, a3);\
+		v[0] = MSCALE_##ISA(b0, b1, k1d4);\
+		v[4] = MSCALE_##ISA(b0, b1, k1d4_n);\
+		v[2] = MSCALE_##ISA(b2, b3, k3d8_1d8);\
+		v[6] = MSCALE_##ISA(b3, b2, k3d8_1d8_n);\
+		b0 = MSCALE_##ISA(c2, c1, k1d4_n);\
+		b1 = MSCALE_##ISA(c2, c1, k1d4);\
+		a0 = ADD_##ISA(c0, b0);	a1 = SUB_##ISA(c0, b0);\
+		a2 = SUB_##ISA(c3, b1);	a3 = ADD_##ISA(c3, b1);\
+		v[1] = MSCALE_##ISA(a0, a3, k7d16_1d16);\
+		v[3] = MSCALE_##ISA(a2, a1, k3d16_5d16_n);\
+		v[5] = MSCALE_##ISA(a1, a2, k3d16_5d16);\
+		v[7] = MSCALE_##ISA(a3, a0, k7d16_1d16_n);\
+	}
+
+/* the butterflies of ChenIDct_1D() on v[0..7] */
+#define CHEN_IDCT(ISA, v) {\
+		c0 = MSCALE_##ISA(v[1], v[7], k7d16_1d16_n);\
+		c1 = MSCALE_##ISA(v[5], v[3], k3d16_5d16_n);\
+		c2 = MSCALE_##ISA(v[3], v[5], k3d16_5d16);\
+		c3 = MSCALE_##ISA(v[1], v[7], k1d16_7d16);\
+		a0 = MSCALE_##ISA(v[0], v[4], k1d4);\
+		a1 = MSCALE_##ISA(v[0], v[4], k1d4_n);\
+		a2 = MSCALE_##ISA(v[2], v[6], k3d8_1d8_n);\
+		a3 = MSCALE_##ISA(v[2], v[6], k1d8_3d8);\
+		b0 = ADD_##ISA(a0, a3);	b1 = ADD_##ISA(a1, a2);\
+		b2 = SUB_##ISA(a1, a2);	b3 = SUB_##ISA(a0, a3);\
+		a0 = ADD_##ISA(c0, c1);	a1 = SUB_##ISA(c0, c1);\
+		a2 = SUB_##ISA(c3, c2);	a3 = ADD_##ISA(c3, c2);\
+		c1 = MSCALE_##ISA(a2, a1, k1d4_n);\
+		c2 = MSCALE_##ISA(a2, a1, k1d4);\
+		v[0] = ADD_##ISA(b0, a3);	v[7] = SUB_##ISA(b0, a3);\
+		v[1] = ADD_##ISA(b1, c2);	v[6] = SUB_##ISA(b1, c2);\
+		v[2] = ADD_##ISA(b2, c1);	v[5] = SUB_##ISA(b2, c1);\
+		v[3] = ADD_##ISA(b3, a0);	v[4] = SUB_##ISA(b3, a0);\
+	}
+
+/* the constants of the butterflies: the ones of both CHEN_DCT() and
+ * CHEN_IDCT(), then the ones of each (a kernel declares only its own) */
+#define CHEN_CONSTANTS(TYPE, PAIR) \
+	TYPE k1d4 = PAIR(c1d4, c1d4), k1d4_n = PAIR(c1d4, -c1d4);\
+	TYPE k3d8_1d8_n = PAIR(c3d8, -c1d8);\
+	TYPE k7d16_1d16_n = PAIR(c7d16, -c1d16);\
+	TYPE k3d16_5d16 = PAIR(c3d16, c5d16);\
+	TYPE k3d16_5d16_n = PAIR(c3d16, -c5d16)
+#define CHEN_DCT_CONSTANTS(TYPE, PAIR) \
+	CHEN_CONSTANTS(TYPE, PAIR);\
+	TYPE k3d8_1d8 = PAIR(c3d8, c1d8);\
+	TYPE k7d16_1d16 = PAIR(c7d16, c1d16)
+#define CHEN_IDCT_CONSTANTS(TYPE, PAIR) \
+	CHEN_CONSTANTS(TYPE, PAIR);\
+	TYPE k1d8_3d8 = PAIR(c1d8, c3d8);\
+	TYPE k1d16_7d16 = PAIR(c1d16, c7d16)
+
+/* MSCALE(c*x) of 8 shorts, where c is _mm_set1_epi16(c) */
+#define MSCALE1_SSE2(x, c) \
+	_mm_or_si128(_mm_slli_epi16(_mm_mulhi_epi16(x, c), 7),\
+		_mm_srli_epi16(_mm_mullo_epi16(x, c), 9))
+
+/* CHEN_IDCT_4() on v[0..3] (the others are zeros) */
+#define CHEN_IDCT_4_SSE2(v) {\
+		c0 = MSCALE1_SSE2(v[1], k7d16);\
+		c1 = MSCALE1_SSE2(v[3], k5d16_n);\
+		c2 = MSCALE1_SSE2(v[3], k3d16);\
+		c3 = MSCALE1_SSE2(v[1], k1d16);\
+		a0 = MSCALE1_SSE2(v[0], k1d4_1);\
+		a2 = MSCALE1_SSE2(v[2], k3d8);\
+		a3 = MSCALE1_SSE2(v[2], k1d8);\
+		b0 = ADD_SSE2(a0, a3);	b1 = ADD_SSE2(a0, a2);\
+		b2 = SUB_SSE2(a0, a2);	b3 = SUB_SSE2(a0, a3);\
+		a0 = ADD_SSE2(c0, c1);	a1 = SUB_SSE2(c0, c1);\
+		a2 = SUB_SSE2(c3, c2);	a3 = ADD_SSE2(c3, c2);\
+		c1 = MSCALE_SSE2(a2, a1, k1d4_n);\
+		c2 = MSCALE_SSE2(a2, a1, k1d4);\
+		v[0] = ADD_SSE2(b0, a3);	v[7] = SUB_SSE2(b0, a3);\
+		v[1] = ADD_SSE2(b1, c2);	v[6] = SUB_SSE2(b1, c2);\
+		v[2] = ADD_SSE2(b2, c1);	v[5] = SUB_SSE2(b2, c1);\
+		v[3] = ADD_SSE2(b3, a0);	v[4] = SUB_SSE2(b3, a0);\
+	}
+
+/* LS(x+y, 2) and LS(x-y, 2) of 8 shorts */
+#define LS_ADD_SSE2(x, y)	_mm_slli_epi16(_mm_add_epi16(x, y), 2)
+#define LS_SUB_SSE2(x, y)	_mm_slli_epi16(_mm_sub_epi16(x, y), 2)
+#define LS_ADD_AVX2(x, y)	_mm256_slli_epi32(_mm256_add_epi32(x, y), 2)
+#define LS_SUB_AVX2(x, y)	_mm256_slli_epi32(_mm256_sub_epi32(x, y), 2)
+#define LS_ADD_AVX2x2(x, y)	_mm256_slli_epi16(_mm256_add_epi16(x, y), 2)
+#define LS_SUB_AVX2x2(x, y)	_mm256_slli_epi16(_mm256_sub_epi16(x, y), 2)
+
+/*************************************************************************
+ *
+ *	Name:		transpose_SSE2()
+ *	Description:	transpose 8x8 shorts (8 lines of 8 shorts)
+ *	Input:		the lines
+ *	Return:		none
+ *	Side effects:	the lines will be changed to the columns
+ *
+ *************************************************************************/
+TARGET("sse2")
+static __inline__ void transpose_SSE2(__m128i *v)
+{
+	__m128i t0, t1, t2, t3, t4, t5, t6, t7;
+	__m128i u0, u1, u2, u3, u4, u5, u6, u7;
+
+	t0 = _mm_unpacklo_epi16(v[0], v[1]);
+	t1 = _mm_unpackhi_epi16(v[0], v[1]);
+	t2 = _mm_unpacklo_epi16(v[2], v[3]);
+	t3 = _mm_unpackhi_epi16(v[2], v[3]);
+	t4 = _mm_unpacklo_epi16(v[4], v[5]);
+	t5 = _mm_unpackhi_epi16(v[4], v[5]);
+	t6 = _mm_unpacklo_epi16(v[6], v[7]);
+	t7 = _mm_unpackhi_epi16(v[6], v[7]);
+	u0 = _mm_unpacklo_epi32(t0, t2);
+	u1 = _mm_unpackhi_epi32(t0, t2);
+	u2 = _mm_unpacklo_epi32(t1, t3);
+	u3 = _mm_unpackhi_epi32(t1, t3);
+	u4 = _mm_unpacklo_epi32(t4, t6);
+	u5 = _mm_unpackhi_epi32(t4, t6);
+	u6 = _mm_unpacklo_epi32(t5, t7);
+	u7 = _mm_unpackhi_epi32(t5, t7);
+	v[0] = _mm_unpacklo_epi64(u0, u4);
+	v[1] = _mm_unpackhi_epi64(u0, u4);
+	v[2] = _mm_unpacklo_epi64(u1, u5);
+	v[3] = _mm_unpackhi_epi64(u1, u5);
+	v[4] = _mm_unpacklo_epi64(u2, u6);
+	v[5] = _mm_unpackhi_epi64(u2, u6);
+	v[6] = _mm_unpacklo_epi64(u3, u7);
+	v[7] = _mm_unpackhi_epi64(u3, u7);
+}
+
+/*************************************************************************
+ *
+ *	Name:		transpose_4_SSE2()
+ *	Description:	transpose the columns 0..3 of 8x8 shorts (8 lines
+ *			of 8 shorts)
+ *	Input:		the lines
+ *	Return:		none
+ *	Side effects:	the lines 0..3 will be changed to the columns 0..3
+ *
+ *************************************************************************/
+TARGET("sse2")
+static __inline__ void transpose_4_SSE2(__m128i *v)
+{
+	__m128i t0, t2, t4, t6, u0, u1, u4, u5;
+
+	t0 = _mm_unpacklo_epi16(v[0], v[1]);
+	t2 = _mm_unpacklo_epi16(v[2], v[3]);
+	t4 = _mm_unpacklo_epi16(v[4], v[5]);
+	t6 = _mm_unpacklo_epi16(v[6], v[7]);
+	u0 = _mm_unpacklo_epi32(t0, t2);
+	u1 = _mm_unpackhi_epi32(t0, t2);
+	u4 = _mm_unpacklo_epi32(t4, t6);
+	u5 = _mm_unpackhi_epi32(t4, t6);
+	v[0] = _mm_unpacklo_epi64(u0, u4);
+	v[1] = _mm_unpackhi_epi64(u0, u4);
+	v[2] = _mm_unpacklo_epi64(u1, u5);
+	v[3] = _mm_unpackhi_epi64(u1, u5);
+}
+
+/*************************************************************************
+ *
+ *	Name:		transpose_AVX2x2()
+ *	Description:	transpose_SSE2() of the 2 blocks in the 2 lanes
+ *	Input:		the lines
+ *	Return:		none
+ *	Side effects:	the lines will be changed to the columns
+ *
+ *************************************************************************/
+TARGET("avx2")
+static __inline__ void transpose_AVX2x2(__m256i *v)
+{
+	__m256i t0, t1, t2, t3, t4, t5, t6, t7;
+	__m256i u0, u1, u2, u3, u4, u5, u6, u7;
+
+	t0 = _mm256_unpacklo_epi16(v[0], v[1]);
+	t1 = _mm256_unpackhi_epi16(v[0], v[1]);
+	t2 = _mm256_unpacklo_epi16(v[2], v[3]);
+	t3 = _mm256_unpackhi_epi16(v[2], v[3]);
+	t4 = _mm256_unpacklo_epi16(v[4], v[5]);
+	t5 = _mm256_unpackhi_epi16(v[4], v[5]);
+	t6 = _mm256_unpacklo_epi16(v[6], v[7]);
+	t7 = _mm256_unpackhi_epi16(v[6], v[7]);
+	u0 = _mm256_unpacklo_epi32(t0, t2);
+	u1 = _mm256_unpackhi_epi32(t0, t2);
+	u2 = _mm256_unpacklo_epi32(t1, t3);
+	u3 = _mm256_unpackhi_epi32(t1, t3);
+	u4 = _mm256_unpacklo_epi32(t4, t6);
+	u5 = _mm256_unpackhi_epi32(t4, t6);
+	u6 = _mm256_unpacklo_epi32(t5, t7);
+	u7 = _mm256_unpackhi_epi32(t5, t7);
+	v[0] = _mm256_unpacklo_epi64(u0, u4);
+	v[1] = _mm256_unpackhi_epi64(u0, u4);
+	v[2] = _mm256_unpacklo_epi64(u1, u5);
+	v[3] = _mm256_unpackhi_epi64(u1, u5);
+	v[4] = _mm256_unpacklo_epi64(u2, u6);
+	v[5] = _mm256_unpackhi_epi64(u2, u6);
+	v[6] = _mm256_unpacklo_epi64(u3, u7);
+	v[7] = _mm256_unpackhi_epi64(u3, u7);
+}
+
+/*************************************************************************
+ *
+ *	Name:		transpose_AVX2()
+ *	Description:	transpose 8x8 ints (8 lines of 8 ints)
+ *	Input:		the lines
+ *	Return:		none
+ *	Side effects:	the lines will be changed to the columns
+ *
+ *************************************************************************/
+TARGET("avx2")
+static __inline__ void transpose_AVX2(__m256i *v)
+{
+	__m256i t0, t1, t2, t3, t4, t5, t6, t7;
+	__m256i u0, u1, u2, u3, u4, u5, u6, u7;
+
+	t0 = _mm256_unpacklo_epi32(v[0], v[1]);
+	t1 = _mm256_unpackhi_epi32(v[0], v[1]);
+	t2 = _mm256_unpacklo_epi32(v[2], v[3]);
+	t3 = _mm256_unpackhi_epi32(v[2], v[3]);
+	t4 = _mm256_unpacklo_epi32(v[4], v[5]);
+	t5 = _mm256_unpackhi_epi32(v[4], v[5]);
+	t6 = _mm256_unpacklo_epi32(v[6], v[7]);
+	t7 = _mm256_unpackhi_epi32(v[6], v[7]);
+	u0 = _mm256_unpacklo_epi64(t0, t2);
+	u1 = _mm256_unpackhi_epi64(t0, t2);
+	u2 = _mm256_unpacklo_epi64(t1, t3);
+	u3 = _mm256_unpackhi_epi64(t1, t3);
+	u4 = _mm256_unpacklo_epi64(t4, t6);
+	u5 = _mm256_unpackhi_epi64(t4, t6);
+	u6 = _mm256_unpacklo_epi64(t5, t7);
+	u7 = _mm256_unpackhi_epi64(t5, t7);
+	v[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+	v[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+	v[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+	v[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+	v[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+	v[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+	v[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+	v[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+/*************************************************************************
+ *
+ *	Name:		DCT_SSE2()
+ *	Description:	DCT() by SSE2 (8 shorts at a time)
+ *	Input:		see DCT() (x may be y)
+ *	Return:		none
+ *	Side effects:	see DCT()
+ *
+ *************************************************************************/
+TARGET("sse2")
+static void DCT_SSE2(int16 *x, int16 *y)
+{
+	DEBUG("DCT_SSE2");
+	int16 i;
+	__m128i v[8], s, one, four;
+	__m128i a0, a1, a2, a3, b0, b1, b2, b3, c0, c1, c2, c3;
+	CHEN_DCT_CONSTANTS(__m128i, PAIR_SSE2);
+
+	one = _mm_set1_epi16(1);
+	four = _mm_set1_epi16(4);
+	for (i=0; i<8; i++) v[i] = _mm_loadu_si128((__m128i *) (x+(i<<3)));
+
+	/* columns, then rows (of the transposed block) */
+	CHEN_DCT(SSE2, LS_, v);
+	transpose_SSE2(v);
+	CHEN_DCT(SSE2, HALF_, v);
+	transpose_SSE2(v);
+
+	/* the factor of 8: (|y|+4)/8 with the sign of y */
+	for (i=0; i<8; i++) {
+		s = _mm_srai_epi16(v[i], 15);
+		v[i] = _mm_srli_epi16(_mm_add_epi16(
+			_mm_sub_epi16(_mm_xor_si128(v[i], s), s), four), 3);
+		v[i] = _mm_sub_epi16(_mm_xor_si128(v[i], s), s);
+		_mm_storeu_si128((__m128i *) (y+(i<<3)), v[i]);
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		IDCT_SSE2()
+ *	Description:	IDCT() by SSE2 (8 shorts at a time)
+ *	Input:		see IDCT() (x may be y)
+ *	Return:		none
+ *	Side effects:	see IDCT()
+ *
+ *************************************************************************/
+TARGET("sse2")
+static void IDCT_SSE2(int16 *x, int16 *y)
+{
+	DEBUG("IDCT_SSE2");
+	int16 i;
+	__m128i v[8], s, eight;
+	__m128i a0, a1, a2, a3, b0, b1, b2, b3, c0, c1, c2, c3;
+	CHEN_IDCT_CONSTANTS(__m128i, PAIR_SSE2);
+
+	eight = _mm_set1_epi16(8);
+	for (i=0; i<8; i++) v[i] = _mm_slli_epi16(
+		_mm_loadu_si128((__m128i *) (x+(i<<3))), 2);
+
+	/* columns, then rows (of the transposed block) */
+	CHEN_IDCT(SSE2, v);
+	transpose_SSE2(v);
+	CHEN_IDCT(SSE2, v);
+	transpose_SSE2(v);
+
+	/* the factor of 16: (|y|+8)/16 with the sign of y */
+	for (i=0; i<8; i++) {
+		s = _mm_srai_epi16(v[i], 15);
+		v[i] = _mm_srli_epi16(_mm_add_epi16(
+			_mm_sub_epi16(_mm_xor_si128(v[i], s), s), eight), 4);
+		v[i] = _mm_sub_epi16(_mm_xor_si128(v[i], s), s);
+		_mm_storeu_si128((__m128i *) (y+(i<<3)), v[i]);
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		IDCT_4x4_SSE2()
+ *	Description:	IDCT_4x4() by SSE2 (8 shorts at a time)
+ *	Input:		see IDCT() (x may be y)
+ *	Return:		none
+ *	Side effects:	see IDCT()
+ *
+ *************************************************************************/
+TARGET("sse2")
+static void IDCT_4x4_SSE2(int16 *x, int16 *y)
+{
+	DEBUG("IDCT_4x4_SSE2");
+	int16 i;
+	__m128i v[8], s, eight;
+	__m128i a0, a1, a2, a3, b0, b1, b2, b3, c0, c1, c2, c3;
+	__m128i k1d4 = PAIR_SSE2(c1d4, c1d4), k1d4_n = PAIR_SSE2(c1d4, -c1d4);
+	__m128i k1d4_1 = _mm_set1_epi16(c1d4);
+	__m128i k3d8 = _mm_set1_epi16(c3d8), k1d8 = _mm_set1_epi16(c1d8);
+	__m128i k7d16 = _mm_set1_epi16(c7d16), k1d16 = _mm_set1_epi16(c1d16);
+	__m128i k3d16 = _mm_set1_epi16(c3d16);
+	__m128i k5d16_n = _mm_set1_epi16(-c5d16);
+
+	eight = _mm_set1_epi16(8);
+	for (i=0; i<4; i++) v[i] = _mm_slli_epi16(
+		_mm_loadu_si128((__m128i *) (x+(i<<3))), 2);
+
+	/* columns (of the lines 0..3), then rows (of the columns 0..3 of
+	 * the transposed block) */
+	CHEN_IDCT_4_SSE2(v);
+	transpose_4_SSE2(v);
+	CHEN_IDCT_4_SSE2(v);
+	transpose_SSE2(v);
+
+	/* the factor of 16: (|y|+8)/16 with the sign of y */
+	for (i=0; i<8; i++) {
+		s = _mm_srai_epi16(v[i], 15);
+		v[i] = _mm_srli_epi16(_mm_add_epi16(
+			_mm_sub_epi16(_mm_xor_si128(v[i], s), s), eight), 4);
+		v[i] = _mm_sub_epi16(_mm_xor_si128(v[i], s), s);
+		_mm_storeu_si128((__m128i *) (y+(i<<3)), v[i]);
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		DCT_AVX2()
+ *	Description:	DCT() by AVX2 (8 shorts in the low 16 bits of 8
+ *			ints at a time)
+ *	Input:		see DCT() (x may be y)
+ *	Return:		none
+ *	Side effects:	see DCT()
+ *
+ *************************************************************************/
+TARGET("avx2")
+static void DCT_AVX2(int16 *x, int16 *y)
+{
+	DEBUG("DCT_AVX2");
+	int16 i;
+	__m256i v[8], low16, one, four;
+	__m256i a0, a1, a2, a3, b0, b1, b2, b3, c0, c1, c2, c3;
+	CHEN_DCT_CONSTANTS(__m256i, PAIR_AVX2);
+
+	low16 = _mm256_set1_epi32(0xffff);
+	one = _mm256_set1_epi32(1);
+	four = _mm256_set1_epi32(4);
+	for (i=0; i<8; i++) v[i] = _mm256_cvtepi16_epi32(
+		_mm_loadu_si128((__m128i *) (x+(i<<3))));
+
+	/* columns, then rows (of the transposed block): the outputs of
+	 * MSCALE_AVX2() are sign-extended for HALF_xxx_AVX2() */
+	CHEN_DCT(AVX2, LS_, v);
+	transpose_AVX2(v);
+	CHEN_DCT(AVX2, HALF_, v);
+	transpose_AVX2(v);
+
+	/* the factor of 8: (|y|+4)/8 with the sign of y */
+	for (i=0; i<8; i++) v[i] = _mm256_sign_epi32(_mm256_srli_epi32(
+		_mm256_add_epi32(_mm256_abs_epi32(v[i]), four), 3), v[i]);
+	for (i=0; i<8; i+=2) _mm256_storeu_si256((__m256i *) (y+(i<<3)),
+		_mm256_permute4x64_epi64(
+			_mm256_packs_epi32(v[i], v[i+1]), 0xd8));
+}
+
+/*************************************************************************
+ *
+ *	Name:		IDCT_AVX2()
+ *	Description:	IDCT() by AVX2 (8 shorts in the low 16 bits of 8
+ *			ints at a time)
+ *	Input:		see IDCT() (x may be y)
+ *	Return:		none
+ *	Side effects:	see IDCT()
+ *
+ *************************************************************************/
+TARGET("avx2")
+static void IDCT_AVX2(int16 *x, int16 *y)
+{
+	DEBUG("IDCT_AVX2");
+	int16 i;
+	__m256i v[8], low16, eight;
+	__m256i a0, a1, a2, a3, b0, b1, b2, b3, c0, c1, c2, c3;
+	CHEN_IDCT_CONSTANTS(__m256i, PAIR_AVX2);
+
+	low16 = _mm256_set1_epi32(0xffff);
+	eight = _mm256_set1_epi32(8);
+	for (i=0; i<8; i++) v[i] = _mm256_slli_epi32(_mm256_cvtepi16_epi32(
+		_mm_loadu_si128((__m128i *) (x+(i<<3)))), 2);
+
+	/* columns, then rows (of the transposed block) */
+	CHEN_IDCT(AVX2, v);
+	transpose_AVX2(v);
+	CHEN_IDCT(AVX2, v);
+	transpose_AVX2(v);
+
+	/* the factor of 16: (|y|+8)/16 with the sign of y (as shorts) */
+	for (i=0; i<8; i++) {
+		v[i] = _mm256_srai_epi32(_mm256_slli_epi32(v[i], 16), 16);
+		v[i] = _mm256_sign_epi32(_mm256_srli_epi32(
+			_mm256_add_epi32(_mm256_abs_epi32(v[i]), eight), 4),
+			v[i]);
+	}
+	for (i=0; i<8; i+=2) _mm256_storeu_si256((__m256i *) (y+(i<<3)),
+		_mm256_permute4x64_epi64(
+			_mm256_packs_epi32(v[i], v[i+1]), 0xd8));
+}
+
+/*************************************************************************
+ *
+ *	Name:		DCT_AVX2x2()
+ *	Description:	DCT_SSE2() of 2 blocks, one in each lane of AVX2
+ *	Input:		the 2 blocks one after the other (x may be y)
+ *	Return:		none
+ *	Side effects:	see DCT()
+ *
+ *************************************************************************/
+TARGET("avx2")
+static void DCT_AVX2x2(int16 *x, int16 *y)
+{
+	DEBUG("DCT_AVX2x2");
+	int16 i;
+	__m256i v[8], s, one, four;
+	__m256i a0, a1, a2, a3, b0, b1, b2, b3, c0, c1, c2, c3;
+	CHEN_DCT_CONSTANTS(__m256i, PAIR_AVX2);
+
+	one = _mm256_set1_epi16(1);
+	four = _mm256_set1_epi16(4);
+	for (i=0; i<8; i++) v[i] = _mm256_loadu2_m128i(
+		(__m128i *) (x+BLOCKSIZE+(i<<3)), (__m128i *) (x+(i<<3)));
+
+	/* columns, then rows (of the transposed blocks) */
+	CHEN_DCT(AVX2x2, LS_, v);
+	transpose_AVX2x2(v);
+	CHEN_DCT(AVX2x2, HALF_, v);
+	transpose_AVX2x2(v);
+
+	/* the factor of 8: (|y|+4)/8 with the sign of y */
+	for (i=0; i<8; i++) {
+		s = _mm256_srai_epi16(v[i], 15);
+		v[i] = _mm256_srli_epi16(_mm256_add_epi16(
+			_mm256_sub_epi16(_mm256_xor_si256(v[i], s), s),
+			four), 3);
+		v[i] = _mm256_sub_epi16(_mm256_xor_si256(v[i], s), s);
+		_mm256_storeu2_m128i((__m128i *) (y+BLOCKSIZE+(i<<3)),
+			(__m128i *) (y+(i<<3)), v[i]);
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		DCT_blocks_AVX2()
+ *	Description:	DCT_blocks() by DCT_AVX2x2() (and DCT_AVX2() of
+ *			the last block of odd n)
+ *	Input:		see DCT_blocks()
+ *	Return:		none
+ *	Side effects:	see DCT()
+ *
+ *************************************************************************/
+TARGET("avx2")
+static void DCT_blocks_AVX2(int16 *x, int16 *y, int16 n)
+{
+	DEBUG("DCT_blocks_AVX2");
+
+	for (; n>=2; n-=2,x+=(BLOCKSIZE<<1),y+=(BLOCKSIZE<<1))
+		DCT_AVX2x2(x, y);
+	if (n) DCT_AVX2(x, y);
+}
+
+/*************************************************************************
+ *
+ *	Name:		DCT_MB_AVX2()
+ *	Description:	DCT_blocks_AVX2() of the 6 blocks of a MB (for
+ *			benchmark_DCT())
+ *	Input:		see DCT()
+ *	Return:		none
+ *	Side effects:	see DCT()
+ *
+ *************************************************************************/
+static void DCT_MB_AVX2(int16 *x, int16 *y)
+{
+	DEBUG("DCT_MB_AVX2");
+
+	DCT_blocks_AVX2(x, y, 6);
+}
+#endif
+
+/*************************************************************************
+ *
+ *	Name:		benchmark_DCT()
+ *	Description:	compare the speed and the results of the scalar
+ *			and SIMD DCT and IDCT kernels on random blocks
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	exit while the results are different
+ *
+ *************************************************************************/
+#define BENCH_BLOCKS 4200	/* (of 700 MBs) */
+#define BENCH_ROUNDS 500
+#define BENCH_KERNELS 10
+void benchmark_DCT(void)
+{
+	DEBUG("benchmark_DCT");
+	static char *name[BENCH_KERNELS] = {
+		"DCT C", "DCT SSE2", "DCT AVX2",
+		"IDCT C", "IDCT SSE2", "IDCT AVX2",
+		"IDCT DC", "IDCT 4x4 C", "IDCT 4x4 SSE2", "DCT MB AVX2"};
+	void (*kernel[BENCH_KERNELS])(int16 *, int16 *) = {
+		DCT, NULL, NULL, IDCT, NULL, NULL, IDCT_DC, IDCT_4x4, NULL,
+		NULL};
+	/* the blocks of a call (6 of a MB by the last one) */
+	static int16 blocks[BENCH_KERNELS] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 6};
+	int16 *in, *out, *ref, *blk;
+	int32 i, k, r, n;
+	TIME t1, t2;
+	long t;
+
+	#ifdef SIMD_DCT
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		kernel[1] = DCT_SSE2;
+		kernel[4] = IDCT_SSE2;
+		kernel[8] = IDCT_4x4_SSE2;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		kernel[2] = DCT_AVX2;
+		kernel[5] = IDCT_AVX2;
+		kernel[9] = DCT_MB_AVX2;
+	}
+	#endif
+
+	in = (int16 *) malloc(BENCH_BLOCKS * 64 * sizeof(int16));
+	out = (int16 *) malloc(BENCH_BLOCKS * 64 * sizeof(int16));
+	ref = (int16 *) malloc(BENCH_BLOCKS * 64 * sizeof(int16));
+	if (!in || !out || !ref) {
+		ERROR_LINE();
+		printf("Cannot allocate blocks for benchmark.\n");
+		exit(ERROR_MEMORY);
+	}
+
+	printf("DCT kernels (%d blocks, %d rounds):\n",
+		BENCH_BLOCKS, BENCH_ROUNDS);
+	for (k=0; k<BENCH_KERNELS; k++) {
+		/* the DCT of residuals (and intra blocks), the IDCT of
+		 * TCOEFFs (only the DC or the 4x4 low-pass for the sparse
+		 * ones), and 1/8 of the blocks of any shorts */
+		srand(261);
+		for (i=0; i<BENCH_BLOCKS*64; i++) {
+			if ((i>>6) % 8 == 7)
+				in[i] = (int16) ((rand() & 0xff) << 8 | (rand() & 0xff));
+			else if ((k<3) || (k==9))
+				in[i] = (int16) ((rand() % 511) - 255);
+			else	in[i] = (int16) ((rand() & 0x0f) ?
+				0 : (rand() % 4095) - 2047);
+			if (((k==6) && (i & 0x3f))
+			 || ((k==7 || k==8) && ((i & 0x24))))
+				in[i] = 0;
+		}
+		if (!kernel[k]) {
+			printf("\t%-13s: not supported\n", name[k]);
+			continue;
+		}
+		get_time(t1);
+		for (n=r=0; r<BENCH_ROUNDS; r++) {
+			for (i=0; i<BENCH_BLOCKS; i+=blocks[k],n+=blocks[k])
+				kernel[k](in+(i<<6), out+(i<<6));
+		}
+		get_time(t2);
+		t = diff_time(t2, t1);
+		printf("\t%-13s: %8.2f M blocks/sec\n", name[k],
+			(t>0) ? (double) n / (t * TIME_UNIT) / 1e6 : 0.0);
+
+		/* all versions must give the same results as the C DCT()
+		 * or IDCT() (also in place) */
+		for (i=0; i<BENCH_BLOCKS; i++)
+			((k<3) || (k==9) ? DCT : IDCT)(in+(i<<6), ref+(i<<6));
+		for (i=0; i<BENCH_BLOCKS; i+=blocks[k]) {
+			blk = in + (i<<6);
+			kernel[k](blk, blk);
+		}
+		if (memcmp(ref, out, BENCH_BLOCKS * 64 * sizeof(int16))
+		  || memcmp(ref, in, BENCH_BLOCKS * 64 * sizeof(int16))) {
+			ERROR_LINE();
+			printf("%s is different from the C version.\n",
+				name[k]);
+			exit(ERROR_OTHERS);
+		}
+	}
+
+	free(in);
+	free(out);
+	free(ref);
+}
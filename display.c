@@ -33,7 +33,6 @@ static void interpolate_image(FSTORE *fs_in, FSTORE *fs_out);
 
 /**************************************/
 /* common variables */
-extern IMAGE *Image;
 extern boolean expand;	/* set it in h261.c */
 
 static int convmat[8][4] =
@@ -317,7 +316,7 @@ static void ditherframe(FSTORE *fs)
   unsigned int uv;
   unsigned char *py,*pu,*pv,*dst;
 
-  int width, height, cwidth;
+  int width, height, cwidth, ystep, cstep;
 
   if (expand) {
     width = 2*Image->Width;
@@ -335,6 +334,10 @@ static void ditherframe(FSTORE *fs)
   pv = fs->fs[_Cr]->data;
   dst = dithered_image;
 
+  /* skip the borders at the end of lines */
+  ystep = fs->fs[_Y]->stride - width;
+  cstep = fs->fs[_Cb]->stride - cwidth;
+
   for (j=0; j<height; j+=4)
   {
     /* line j + 0 */
@@ -353,6 +356,7 @@ static void ditherframe(FSTORE *fs)
       *dst++ = ytab[((*py++ +2)<<4)|(uv&15)];
       *dst++ = ytab[((*py++ +10)<<4)|(uv>>4)];
     }
+    py += ystep;
 
     pu -= cwidth;
     pv -= cwidth;
@@ -373,6 +377,9 @@ static void ditherframe(FSTORE *fs)
       *dst++ = ytab[((*py++ +14)<<4)|(uv>>4)];
       *dst++ = ytab[((*py++ +6)<<4)|(uv&15)];
     }
+    py += ystep;
+    pu += cstep;
+    pv += cstep;
 
     /* line j + 2 */
     for (i=0; i<width; i+=8)
@@ -390,6 +397,7 @@ static void ditherframe(FSTORE *fs)
       *dst++ = ytab[((*py++ +1)<<4)|(uv&15)];
       *dst++ = ytab[((*py++ +9)<<4)|(uv>>4)];
     }
+    py += ystep;
 
     pu -= cwidth;
     pv -= cwidth;
@@ -410,12 +418,15 @@ static void ditherframe(FSTORE *fs)
       *dst++ = ytab[((*py++ +13)<<4)|(uv>>4)];
       *dst++ = ytab[((*py++ +5)<<4)|(uv&15)];
     }
+    py += ystep;
+    pu += cstep;
+    pv += cstep;
   }
 }
 
 void interpolate_image(FSTORE *fs_in, FSTORE *fs_out)
 {
-  int16 width, height, w2, h2;
+  int16 width, height, w2, h2, in_stride, out_stride;
   int i, x,xx,y;
   unsigned char *out,*in;
 
@@ -424,6 +435,8 @@ void interpolate_image(FSTORE *fs_in, FSTORE *fs_out)
 	height = Image->height[i];
 	in = fs_in->fs[i]->data;
 	out = fs_out->fs[i]->data;
+	in_stride = fs_in->fs[i]->stride;
+	out_stride = fs_out->fs[i]->stride;
 	w2 = 2 * width;
 
 	/* Horizontally */
@@ -431,31 +444,31 @@ void interpolate_image(FSTORE *fs_in, FSTORE *fs_out)
 		for (x = 0,xx=0; x < width-1; x++,xx+=2) {
 			*(out + xx) = *(in + x);
 			*(out + xx+1) = (*(in + x)  + *(in + x + 1) )>>1;
-			*(out + w2 + xx) = (*(in + x) + *(in + x + width))>>1;
-			*(out + w2 + xx+1) = (*(in + x) + *(in + x + 1) +
-			   *(in + x + width) + *(in + x + width + 1))>>2;
+			*(out + out_stride + xx) = (*(in + x) + *(in + x + in_stride))>>1;
+			*(out + out_stride + xx+1) = (*(in + x) + *(in + x + 1) +
+			   *(in + x + in_stride) + *(in + x + in_stride + 1))>>2;
 
 		}
 		*(out + w2 - 2) = *(in + width - 1);
 		*(out + w2 - 1) = *(in + width - 1);
-		*(out + w2 + w2 - 2) = *(in + width + width - 1);
-		*(out + w2 + w2 - 1) = *(in + width + width - 1);
-		out += w2<<1;
-		in += width;
+		*(out + out_stride + w2 - 2) = *(in + in_stride + width - 1);
+		*(out + out_stride + w2 - 1) = *(in + in_stride + width - 1);
+		out += out_stride<<1;
+		in += in_stride;
 	}
 	/* last lines */
 	for (x = 0,xx=0; x < width-1; x++,xx+=2) {
 		*(out+ xx) = *(in + x);
 		*(out+ xx+1) = (*(in + x) + *(in + x + 1) + 1)>>1;
-		*(out+ w2+ xx) = *(in + x);
-		*(out+ w2+ xx+1) = (*(in + x) + *(in + x + 1) + 1)>>1;
+		*(out+ out_stride+ xx) = *(in + x);
+		*(out+ out_stride+ xx+1) = (*(in + x) + *(in + x + 1) + 1)>>1;
 	}
 
 	/* bottom right corner pels */
 	*(out + (width<<1) - 2) = *(in + width -1);
 	*(out + (width<<1) - 1) = *(in + width -1);
-	*(out + (width<<2) - 2) = *(in + width -1);
-	*(out + (width<<2) - 1) = *(in + width -1);
+	*(out + out_stride + (width<<1) - 2) = *(in + width -1);
+	*(out + out_stride + (width<<1) - 1) = *(in + width -1);
   }
 }
 
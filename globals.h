@@ -36,9 +36,11 @@ typedef short int int16;/* 16-bits integer(-32,768 to 32,767) */
 typedef long int32;	/* 32-bits integer(-2,147,483,648 to 2,147,483,647) */
 typedef unsigned char byte;	/* 1 byte (8 bits) */
 typedef unsigned long bytes4;	/* 4 bytes (32 bits) */
+typedef unsigned long long bytes8;	/* 8 bytes (64 bits) */
 typedef enum {FALSE=0, TRUE=1} boolean;	/* for boolean function */
 typedef enum {_CIF=0, _QCIF=1, _NTSC=2} ImageType;	/* image types */
 typedef enum {_Y=0, _Cb=1, _Cr=2} ComponentType;	/* component types */
+typedef enum {_FILES=0, _YUV=1, _Y4M=2} FrameFileType;	/* frame file types */
 #define NUMBER_OF_COMPONENTS 3
 
 /*************************************************************************/
@@ -109,9 +111,22 @@ MB_HEADER {
 #define MAX_FILENAME_LEN 50		/* max. length of filenames */
 					/* (coded or image files) */
 #define STREAM_FILE_SUFFIX ".261"	/* coded filename suffix (?.261) */
+#define STREAM_STDIO "-"		/* coded filename for stdin/stdout */
+#define STREAM_BUFFER_SIZE (1L<<20)	/* default buffer size for coded */
+					/* file (?_buffer, in bytes) */
+#define READ_AHEAD 4			/* default # of frames read ahead */
+#define WRITE_BEHIND 4			/* # of frames written behind */
+#define MAX_ME_THREADS 36		/* max. # of threads of ME (-j) */
+#define MAX_ME_AHEAD 8			/* max. # of frames ME ahead (-f) */
+#define MAX_POOL_THREADS 256		/* max. # of threads of encode server (-n) */
 #define Y_FILE_SUFFIX ".Y"		/* image filename suffix for Y */
 #define Cb_FILE_SUFFIX ".U"		/* image filename suffix for Cb */
 #define Cr_FILE_SUFFIX ".V"		/* image filename suffix for Cr */
+/* one file for all frames (instead of 3 files per frame) */
+#define YUV_FILE_SUFFIX ".yuv"		/* raw I420 frames: Y, Cb, Cr, ... */
+#define Y4M_FILE_SUFFIX ".y4m"		/* YUV4MPEG2 header + I420 frames */
+#define Y4M_MAGIC "YUV4MPEG2"		/* the 1st word of .y4m header */
+#define Y4M_FRAME "FRAME"		/* the 1st word of .y4m frame header */
 
 /*************************************************************************/
 /* motion estimation algo. */
@@ -120,6 +135,18 @@ MB_HEADER {
 #define THREE_STEP_SEARCH      	1	/* use three_step_search_ME() */
 #define NEW_THREE_STEP_SEARCH	2	/* use new_three_step_search_ME() */
 #define MY_SEARCH	3	/* use my_search_ME() */
+#define PYRAMID_SEARCH	4	/* use pyramid_search_ME() */
+#define EPZS_SEARCH	5	/* use EPZS_search_ME() */
+#define DIAMOND_SEARCH	6	/* use diamond_search_ME() */
+#define HEXAGON_SEARCH	7	/* use hexagon_search_ME() */
+#define SEA_SEARCH	8	/* use SEA_search_ME() */
+
+/*************************************************************************/
+/* matching metric of motion estimation */
+/* if (me_metric==%d) => ... */
+#define SUB64_METRIC	0	/* use sub64_metric() */
+#define SAD_METRIC	1	/* use SAD_metric() */
+#define SATD_METRIC	2	/* use SATD_metric() */
 
 /*************************************************************************/
 /* for debug */
@@ -159,19 +186,33 @@ EHUFF {
 };
 
 /* Decoder-Huffman-table */
+/* a look-up table indexed by the next VLD_MAX_LENGTH bits in the stream:
+ * the first VLD_LOOKUP_BITS bits index the 1st level, and codes longer
+ * than VLD_LOOKUP_BITS go on to a 2nd level (sub-table) indexed by the
+ * remaining bits */
+#define VLD_MAX_LENGTH	16	/* the longest VLC (GBSC) in H.261 */
+#define VLD_LOOKUP_BITS	8	/* # of bits for the 1st level */
 #define DHUFF struct Decoder_Huffman
 DHUFF {
 	char table_name[8];
-	int16 number_of_states;	/* # of used states (start from 1 (state 0)) */
-	int16 *next_state[2]; /* next_state[LEFT or RIGHT] from current state */
+	int16 number_of_entries;/* # of used entries (1st level+sub-tables) */
+	int16 *value;	/* the value, or the start entry of the sub-table */
+	int16 *length;	/* length of the code, 0 to indicate a sub-table */
 };
 
+/* the pels of Y (of Cb and Cr: the half) around the picture of a frame
+ * store, replicated from the edges by extend_FS() */
+#define FS_BORDER	16
+
 #define MEM struct Memory_Construct
 MEM {
 	int16 width;
 	int16 height;
+	int16 border;	/* # of pels around the picture */
+	int16 stride;	/* distance between lines (width + 2*border) */
 	int32 memloc;
-	unsigned char *data;
+	unsigned char *data;	/* the upper-left pel of the picture */
+	unsigned char *base;	/* the allocated storage (with border) */
 };
 
 /* frame store */
@@ -180,6 +221,16 @@ FSTORE {
 	MEM *fs[NUMBER_OF_COMPONENTS];
 };
 
+/* bits put apart from the write stream (see redirect_write_stream()) */
+#define BIT_BUFFER struct Bit_Buffer
+BIT_BUFFER {
+	byte *data;		/* the whole words of the bits */
+	int32 size;		/* # of bytes allocated for data */
+	int32 bytes;		/* # of bytes in data */
+	bytes8 cache;		/* the rest bits from its MSB */
+	int16 cache_bits;	/* 0, ..., 31 */
+};
+
 /* image infomation */
 #define IMAGE struct Image_Information
 IMAGE {
@@ -197,12 +248,18 @@ IMAGE {
 	int16 height[NUMBER_OF_COMPONENTS];
 	int16 width[NUMBER_OF_COMPONENTS];
 	int32 len[NUMBER_OF_COMPONENTS];
+	/* distance between lines in the frame stores (width + borders) */
+	int16 stride[NUMBER_OF_COMPONENTS];
 
 	boolean display;
 
 	/* frame files */
 	boolean read_from_files;
 	boolean write_to_files;
+	/* _FILES: 3 files per frame (prefix + frame_ID + suffix),
+	 * _YUV or _Y4M: one file for all frames (prefix is the filename) */
+	FrameFileType input_file_type;
+	FrameFileType output_file_type;
 	char frame_suffix[NUMBER_OF_COMPONENTS][MAX_FILENAME_LEN];
 	/* input frame files */
 	char input_frame_prefix[MAX_FILENAME_LEN];
@@ -222,6 +279,14 @@ IMAGE {
 /* replace x%32 by '&0x1f' operation */
 #define MOD_32(x)	((x) & (0x1f))
 
+/*************************************************************************/
+/* storage of each thread (of -j, and of the sessions, see context.h) */
+#define THREAD_LOCAL __thread
+
+/*************************************************************************/
+/* the state of an encoder or decoder session */
+#include "context.h"
+
 /*************************************************************************/
 /* function prototypes */
 #include "prototyp.h"
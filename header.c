@@ -8,6 +8,7 @@
 
 #include "globals.h"
 #include "ctrl.h"	/* codec control: statistics, get time... */
+#include "bitstream.h"	/* bit operations for the read stream */
 
 /*************************************************************************/
 /* public */
@@ -55,9 +56,6 @@ extern EHUFF *MTYPE_Ehuff;
 void write_frame_header(PIC_HEADER *header)
 {
 	DEBUG("write_frame_header");
-	#ifdef CTRL_HEADER_BITS
-	extern int32 HeaderBits;
-	#endif
 
 	put_n_bits(PSC_LENGTH, (int32) PSC);	/* Picture Start Code (20) */
 
@@ -106,9 +104,6 @@ void write_frame_header(PIC_HEADER *header)
 void write_GOB_header(GOB_HEADER *header)
 {
 	DEBUG("write_GOB_header");
-	#ifdef CTRL_HEADER_BITS
-	extern int32 HeaderBits;
-	#endif
 
 	/* Group of Block Start Code (16) */
 	put_n_bits(GBSC_LENGTH, (int32) GBSC);
@@ -162,10 +157,7 @@ void write_GOB_header(GOB_HEADER *header)
 void write_MB_header(int16 Current_MB, MB_HEADER *header)
 {
 	DEBUG("write_MB_header");
-	#ifdef CTRL_HEADER_BITS
-	extern int32 HeaderBits;
-	#endif
-	extern int16 Last_MTYPE, Last_MVDH, Last_MVDV;
+	extern THREAD_LOCAL int16 Last_MTYPE, Last_MVDH, Last_MVDV;
 	int16 WriteMVDH, WriteMVDV;
 	int16 bits1, bits2;
 
@@ -293,7 +285,7 @@ void read_PSC(void)
 		exit(ERROR_HEADER);
 	}
 	#else
-	get_n_bits(PSC_LENGTH);
+	(void) get_n_bits(PSC_LENGTH);
 	#endif
 }
 
@@ -323,7 +315,7 @@ void read_frame_header_tail(PIC_HEADER *header)
 	/* ... */
 
 	while (get_bit())	/* read until PEI=='0' */
-		get_n_bits(8);
+		(void) get_n_bits(8);
 }
 
 /*************************************************************************
@@ -350,7 +342,7 @@ void read_GBSC(void)
 		exit(ERROR_HEADER);
 	}
 	#else
-	get_n_bits(GBSC_LENGTH);
+	(void) get_n_bits(GBSC_LENGTH);
 	#endif
 }
 
@@ -396,7 +388,7 @@ void read_GOB_header_tail(GOB_HEADER *header)
 	/* ... */
 
 	while (get_bit())	/* read until GEI=='0' */
-		get_n_bits(8);
+		(void) get_n_bits(8);
 }
 
 /*************************************************************************
@@ -416,7 +408,7 @@ void read_GOB_header_tail(GOB_HEADER *header)
 int16 read_MB_header(int16 *Current_MB, int16 GQUANT, MB_HEADER *header)
 {
 	DEBUG("read_MB_header");
-	extern int16 Last_MTYPE, Last_MVDH, Last_MVDV;
+	extern THREAD_LOCAL int16 Last_MTYPE, Last_MVDH, Last_MVDV;
 	int16 ReadMVDH,ReadMVDV;
 
 	/* Get rid of stuff bits */
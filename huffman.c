@@ -8,8 +8,15 @@
 
 #include "globals.h"
 #include "huffman.h"
+#include "bitstream.h"	/* bit operations for the read stream */
+#include "ctrl.h"	/* codec control: statistics, get time... */
+#include "mytime.h"     /* TIME-type variables definition & function */
 
-#define MAX_STATE 200	/* maximum # of states for Decoder-Huffman-table */
+#define MAX_SUB_TABLE 8	/* maximum # of sub-tables for Decoder-Huffman-table */
+#define LOOKUP_SIZE (1<<VLD_LOOKUP_BITS)	/* # of entries in the 1st level */
+#define SUB_BITS (VLD_MAX_LENGTH-VLD_LOOKUP_BITS)	/* # of bits for a sub-table */
+#define SUB_SIZE (1<<SUB_BITS)	/* # of entries in a sub-table */
+#define MAX_ENTRY (LOOKUP_SIZE+MAX_SUB_TABLE*SUB_SIZE)
 
 /*************************************************************************/
 /* public */
@@ -19,6 +26,7 @@ extern int16 put_VLC(int16 val, EHUFF *huff);
 /* for decoder */
 extern void init_VLD(void);
 extern int16 get_VLC(DHUFF *huff);
+extern void benchmark_VLD(void);
 
 /* for encoder */
 EHUFF *MBA_Ehuff;
@@ -46,16 +54,19 @@ static void load_DHUFF(DHUFF *huff, int16 *array);
 static void add_code(int16 value, int16 code_length, int16 code, DHUFF *huff);
 
 #define EMPTY_STATE -1	/* ID for empty state */
-#define LEAF_NODE -2	/* ID for leaf node */
+#define SUB_TABLE 0	/* length of the entry pointing to a sub-table */
 
-/* for next_state[RIGHT or LEFT][] */
-enum {RIGHT=0, LEFT=1};
-#define LEAF(sval, huff) (huff->next_state[RIGHT][(sval)] == LEAF_NODE)
-#define SET_LEAF(value, sval, huff) {\
-			huff->next_state[RIGHT][(sval)] = LEAF_NODE;\
-			huff->next_state[LEFT][(sval)] = value;\
-			}
-#define GET_LEAF(sval, huff) (huff->next_state[LEFT][(sval)])
+/* the binary tree walked bit by bit by the former get_VLC(), kept only to
+ * be compared with the look-up table by benchmark_VLD() */
+#define MAX_STATE 200	/* maximum # of states for a VLD_TREE */
+#define LEAF_NODE -2	/* ID for leaf node */
+enum {RIGHT=0, LEFT=1};	/* for next_state[RIGHT or LEFT][] */
+typedef struct {
+	int16 number_of_states;	/* # of used states (start from 1 (state 0)) */
+	int16 next_state[2][MAX_STATE]; /* next_state[LEFT or RIGHT] */
+} VLD_TREE;
+static void load_VLD_tree(VLD_TREE *tree, int16 *array);
+static int16 get_VLC_tree(VLD_TREE *tree);
 
 /*************************************************************************
  *
@@ -166,33 +177,35 @@ void init_VLD(void)
 int16 get_VLC(DHUFF *huff)
 {
 	DEBUG("get_VLC");
-	int16 next;
-	int16 current_state = 0;
-
-	next = huff->next_state[get_bit()][current_state];
-	while (!LEAF(next, huff)) {
-		/* consider 1 bit by 1 bit */
-		/*            */
-		/*   1 /\ 0   */
-		/*    /  \    */
-		/*   .    .   */
-
-		#ifdef DEBUG_ON
-		if (next==EMPTY_STATE) {
-			ERROR_LINE();
-			printf("Invalid state reached in %s-DHUFF\n",
-				huff->table_name);
-			exit(ERROR_HUFFMAN);
-		}
-		#endif
+	int32 bits;
+	int16 entry;
+
+	/* peek the longest code, and look up the 1st level by the
+	 * leading VLD_LOOKUP_BITS bits */
+	bits = peek_bits(VLD_MAX_LENGTH);
+	entry = (int16) (bits >> SUB_BITS);
+
+	if (huff->length[entry]==SUB_TABLE) {
+		/* a long code: look up the sub-table by the rest bits */
+		entry = huff->value[entry] + (int16) (bits & (SUB_SIZE-1));
+	}
 
-		/* try to next state */
-		current_state = next;
-		next = huff->next_state[get_bit()][current_state];
+	#ifdef DEBUG_ON
+	if (huff->length[entry]==EMPTY_STATE) {
+		ERROR_LINE();
+		printf("Invalid code 0x%lx reached in %s-DHUFF\n",
+			bits, huff->table_name);
+		exit(ERROR_HUFFMAN);
 	}
+	#endif
+
+	#ifdef CTRL_VLD_STAT
+	VLD_symbols++;
+	#endif
 
 	/* successful finding */
-	return GET_LEAF(next, huff);
+	skip_bits(huff->length[entry]);
+	return huff->value[entry];
 }
 
 /*************************************************************************
@@ -264,7 +277,7 @@ static void load_EHUFF(EHUFF *huff, int16 *array)
  *	Description:	make a decoder-huffman-table for VLD
  *	Input:          the name of the decoder-huffman-table
  *	Return:		the pointer to the constructed huffman-table
- *	Side effects:   all next_state of ?_Dhuff will be set to EMPTY_STATE
+ *	Side effects:   all length of ?_Dhuff will be set to EMPTY_STATE
  *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
  *
  *************************************************************************/
@@ -277,19 +290,19 @@ static DHUFF *make_DHUFF(char *table_name)
 	/* get memory */
 	MAKE_STRUCTURE(temp, DHUFF);
 	strcpy(temp->table_name, table_name);
-	temp->next_state[RIGHT] = (int16 *) malloc(MAX_STATE * sizeof(int16));
-	temp->next_state[LEFT] = (int16 *) malloc(MAX_STATE * sizeof(int16));
-	if ((!temp->next_state[RIGHT]) || (!temp->next_state[LEFT])) {
+	temp->value = (int16 *) malloc(MAX_ENTRY * sizeof(int16));
+	temp->length = (int16 *) malloc(MAX_ENTRY * sizeof(int16));
+	if ((!temp->value) || (!temp->length)) {
 		ERROR_LINE();
 		printf("Cannot make a structure: %s-DHUFF\n", table_name);
 		exit(ERROR_MEMORY);
 	}
 
-	/* initialize */
-	temp->number_of_states = 1;
-	for (i=0; i<MAX_STATE; i++) {
-		temp->next_state[RIGHT][i] =
-		temp->next_state[LEFT][i] = EMPTY_STATE;
+	/* initialize: only the 1st level is used */
+	temp->number_of_entries = LOOKUP_SIZE;
+	for (i=0; i<MAX_ENTRY; i++) {
+		temp->value[i] = 0;
+		temp->length[i] = EMPTY_STATE;
 	}
 
 	return temp;
@@ -299,7 +312,7 @@ static DHUFF *make_DHUFF(char *table_name)
  *
  *	Name:		load_DHUFF()
  *	Description:	load an array into a decoder-huffman-table for VLD
- *			(indeed, the table is a binary tree)
+ *			(indeed, the table is a 2-level look-up table)
  *	Input:         	the pointer to the encoder-huffman-table, and the
  *			loaded array
  *	Return:		none
@@ -321,11 +334,20 @@ static void load_DHUFF(DHUFF *huff, int16 *array)
 	}
 }
 
+/* the code conflicts with an added code */
+#define NON_UNIQUE_PREFIX() {\
+		ERROR_LINE();\
+		printf("Non-unique prefix in %s-DHUFF\n", huff->table_name);\
+		printf("Length: %d   Code: %d|%x  Value: %d|%x\n",\
+			code_length, code, code, value, value);\
+		exit(ERROR_HUFFMAN);\
+	}
+
 /*************************************************************************
  *
  *	Name:		add_code()
  *	Description:	add a huffman code into a decoder-huffman-table
- *			(indeed, the table is a binary tree)
+ *			(indeed, the table is a 2-level look-up table)
  *	Input:         	the value, the code-length, the code, and
  *			the pointer to the decoder-huffman-table
  *	Return:		none
@@ -336,48 +358,246 @@ static void load_DHUFF(DHUFF *huff, int16 *array)
 static void add_code(int16 value, int16 code_length, int16 code, DHUFF *huff)
 {
 	DEBUG("add_code");
-	int16 i, next;
-	int16 go_left;
-	int16 current_state = 0;
+	int16 i, first, last;
+	int16 prefix, table;
 
 	if (value<0) {
 		ERROR_LINE();
 		printf("Negative addcode value in %s-DHUFF: %d\n",
-			value, huff->table_name);
+			huff->table_name, value);
+		exit(ERROR_HUFFMAN);
+	}
+	if ((code_length<=0) || (code_length>VLD_MAX_LENGTH)) {
+		ERROR_LINE();
+		printf("Out of bounds code length in %s-DHUFF: %d\n",
+			huff->table_name, code_length);
 		exit(ERROR_HUFFMAN);
 	}
 
-	for (i=code_length-1; i>=0; i--) {
-		/* consider i-th bit in code */
-		/*            */
-		/*   1 /\ 0   */
-		/*    /  \    */
-		/*   .    .   */
-
-		go_left = ((code & (1<<i)) ? LEFT : RIGHT);
-		next = huff->next_state[go_left][current_state];
-
-		if (next==EMPTY_STATE) {	/* a new branch */
-			/* add a new state */
-			if ((next=huff->number_of_states) > MAX_STATE) {
+	if (code_length<=VLD_LOOKUP_BITS) {
+		/* a short code fills all 1st level entries led by it */
+		first = code << (VLD_LOOKUP_BITS - code_length);
+		last = first + (1 << (VLD_LOOKUP_BITS - code_length));
+	} else {
+		/* a long code: its leading bits point to a sub-table */
+		prefix = code >> (code_length - VLD_LOOKUP_BITS);
+		if (huff->length[prefix]==EMPTY_STATE) {
+			/* add a new sub-table */
+			if ((table=huff->number_of_entries)+SUB_SIZE > MAX_ENTRY) {
 				ERROR_LINE();
 				printf("%s-DHUFF overflow: %d>%d\n",
-					huff->table_name, next, MAX_STATE);
+					huff->table_name, table+SUB_SIZE,
+					MAX_ENTRY);
 				exit(ERROR_HUFFMAN);
 			}
-			huff->number_of_states++;
-			huff->next_state[go_left][current_state] = next;
-		} else if (LEAF(next, huff)) {	/* a leaf node => wrong! */
-			ERROR_LINE();
-			printf("Non-unique prefix in %s-DHUFF\n",
-				huff->table_name);
-			printf("Length: %d   Code: %d|%x  Value: %d|%x\n",
-				code_length, code, code, value, value);
-			exit(ERROR_HUFFMAN);
+			huff->number_of_entries += SUB_SIZE;
+			huff->value[prefix] = table;
+			huff->length[prefix] = SUB_TABLE;
+		} else if (huff->length[prefix]!=SUB_TABLE) {
+			/* a shorter code has used the prefix => wrong! */
+			NON_UNIQUE_PREFIX();
 		}
 
-		current_state = next;
+		/* fill all sub-table entries led by the rest bits */
+		first = (code & ((1 << (code_length - VLD_LOOKUP_BITS)) - 1))
+			<< (VLD_MAX_LENGTH - code_length);
+		last = first + (1 << (VLD_MAX_LENGTH - code_length));
+		first += huff->value[prefix];
+		last += huff->value[prefix];
+	}
+
+	for (i=first; i<last; i++) {
+		/* the entry has been used by other code => wrong! */
+		if (huff->length[i]!=EMPTY_STATE) NON_UNIQUE_PREFIX();
+
+		huff->value[i] = value;
+		huff->length[i] = code_length;
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		load_VLD_tree()
+ *	Description:	load an array into a binary tree for the bit by
+ *			bit VLD (as the former load_DHUFF())
+ *	Input:         	the pointer to the tree, and the loaded array
+ *	Return:		none
+ *	Side effects:   entries of tree will be filled
+ *
+ *************************************************************************/
+static void load_VLD_tree(VLD_TREE *tree, int16 *array)
+{
+	DEBUG("load_VLD_tree");
+	int16 i, next, go_left, current_state;
+
+	tree->number_of_states = 1;
+	for (i=0; i<MAX_STATE; i++)
+		tree->next_state[RIGHT][i] = tree->next_state[LEFT][i]
+			= EMPTY_STATE;
+
+	/* the trios of the value, the code-length and the code */
+	for (; *array!=EOT; array+=3) {
+		for (current_state=0,i=array[1]-1; i>=0; i--) {
+			/* consider i-th bit in code */
+			go_left = ((array[2] & (1<<i)) ? LEFT : RIGHT);
+			next = tree->next_state[go_left][current_state];
+			if (next==EMPTY_STATE) {	/* a new branch */
+				if ((next=tree->number_of_states) >= MAX_STATE) {
+					ERROR_LINE();
+					printf("VLD tree overflow: %d>=%d\n",
+						next, MAX_STATE);
+					exit(ERROR_HUFFMAN);
+				}
+				tree->number_of_states++;
+				tree->next_state[go_left][current_state] = next;
+			}
+			current_state = next;
+		}
+		/* the leaf */
+		tree->next_state[RIGHT][current_state] = LEAF_NODE;
+		tree->next_state[LEFT][current_state] = array[0];
 	}
-	SET_LEAF(value, current_state, huff);
 }
 
+/*************************************************************************
+ *
+ *	Name:	       	get_VLC_tree()
+ *	Description:	get a value by walking the binary tree bit by bit
+ *			(as the former get_VLC())
+ *	Input:		the pointer to the tree
+ *	Return:		the value of current VLC
+ *	Side effects:   the read position of bitstream file will be updated
+ *
+ *************************************************************************/
+static int16 get_VLC_tree(VLD_TREE *tree)
+{
+	DEBUG("get_VLC_tree");
+	int16 next;
+
+	next = tree->next_state[get_bit()][0];
+	while (tree->next_state[RIGHT][next]!=LEAF_NODE)
+		next = tree->next_state[get_bit()][next];
+
+	return tree->next_state[LEFT][next];
+}
+
+/*************************************************************************
+ *
+ *	Name:		benchmark_VLD()
+ *	Description:	compare the speed and the results of the bit by bit
+ *			tree walk and the 2-level look-up table (get_VLC())
+ *			on the same random symbols of all VLC tables
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	exit while the results are different
+ *
+ *************************************************************************/
+#define BENCH_SYMBOLS 1000000
+#define BENCH_ROUNDS 10
+#define BENCH_TABLES 6
+void benchmark_VLD(void)
+{
+	DEBUG("benchmark_VLD");
+	static char *name[2] = {"tree walk", "2-level table"};
+	int16 *array[BENCH_TABLES] = {MBAtable, MTYPEtable, MVDtable,
+		CBPtable, TCOEFFtable1, TCOEFFtable2};
+	DHUFF *huff[BENCH_TABLES];
+	VLD_TREE *tree;
+	H261_CONTEXT *ctx, *bound_ctx = Ctx;
+	int16 n_code[BENCH_TABLES], min_length[BENCH_TABLES];
+	int16 *table, *value, *result;
+	byte *stream;
+	bytes8 acc = 0;
+	int16 acc_bits = 0;
+	int32 i, k, r, n, t_ID, e, bits, len;
+	TIME t1, t2;
+	long t;
+
+	if (!T1_Dhuff) init_VLD();
+	huff[0] = MBA_Dhuff;	huff[1] = MTYPE_Dhuff;	huff[2] = MVD_Dhuff;
+	huff[3] = CBP_Dhuff;	huff[4] = T1_Dhuff;	huff[5] = T2_Dhuff;
+
+	tree = (VLD_TREE *) malloc(BENCH_TABLES * sizeof(VLD_TREE));
+	table = (int16 *) malloc(BENCH_SYMBOLS * sizeof(int16));
+	value = (int16 *) malloc(BENCH_SYMBOLS * sizeof(int16));
+	result = (int16 *) malloc(BENCH_SYMBOLS * sizeof(int16));
+	stream = (byte *) malloc(BENCH_SYMBOLS * VLD_MAX_LENGTH / 8 + 8);
+	ctx = (H261_CONTEXT *) calloc(1, sizeof(H261_CONTEXT));
+	if (!tree || !table || !value || !result || !stream || !ctx) {
+		ERROR_LINE();
+		printf("Cannot allocate symbols for benchmark.\n");
+		exit(ERROR_MEMORY);
+	}
+	for (t_ID=0; t_ID<BENCH_TABLES; t_ID++) {
+		load_VLD_tree(&tree[t_ID], array[t_ID]);
+		min_length[t_ID] = VLD_MAX_LENGTH;
+		for (n_code[t_ID]=0; array[t_ID][3*n_code[t_ID]]!=EOT;
+		     n_code[t_ID]++)
+			if (array[t_ID][3*n_code[t_ID]+1]<min_length[t_ID])
+				min_length[t_ID] = array[t_ID][3*n_code[t_ID]+1];
+	}
+
+	/* random symbols (half of them TCOEFFs), a code of length l taken
+	 * 2^-l as often as in a stream, written one after another */
+	srand(261);
+	for (len=i=0; i<BENCH_SYMBOLS; i++) {
+		t_ID = rand() % (BENCH_TABLES+2);
+		if (t_ID>=BENCH_TABLES) t_ID -= 2;
+		do {
+			e = 3 * (rand() % n_code[t_ID]);
+			bits = array[t_ID][e+1];
+		} while (rand() & ((1 << (bits - min_length[t_ID])) - 1));
+		table[i] = (int16) t_ID;
+		value[i] = array[t_ID][e];
+
+		acc = (acc << bits) | (bytes8) (array[t_ID][e+2]
+			& ((1 << bits) - 1));
+		for (acc_bits+=bits; acc_bits>=8; acc_bits-=8)
+			stream[len++] = (byte) (acc >> (acc_bits - 8));
+	}
+	if (acc_bits>0) stream[len++] = (byte) (acc << (8 - acc_bits));
+
+	/* both read the stream by the read cache of a session of their own */
+	Ctx = ctx;
+	make_IO_state();
+
+	printf("VLD (%d symbols of %ld bytes, %d rounds):\n",
+		BENCH_SYMBOLS, len, BENCH_ROUNDS);
+	for (k=0; k<2; k++) {
+		memset(result, 0xff, BENCH_SYMBOLS * sizeof(int16));
+		get_time(t1);
+		for (n=r=0; r<BENCH_ROUNDS; r++) {
+			open_read_stream();
+			push_read_stream_in_place(stream, len);
+			if (k==0) {
+				for (i=0; i<BENCH_SYMBOLS; i++,n++)
+					result[i] = get_VLC_tree(&tree[table[i]]);
+			} else {
+				for (i=0; i<BENCH_SYMBOLS; i++,n++)
+					result[i] = get_VLC(huff[table[i]]);
+			}
+			close_read_stream();
+		}
+		get_time(t2);
+		t = diff_time(t2, t1);
+		printf("\t%-13s: %8.2f M symbols/sec\n", name[k],
+			(t>0) ? (double) n / (t * TIME_UNIT) / 1e6 : 0.0);
+
+		/* both must give the symbols written */
+		if (memcmp(result, value, BENCH_SYMBOLS * sizeof(int16))) {
+			ERROR_LINE();
+			printf("%s is different from the symbols written.\n",
+				name[k]);
+			exit(ERROR_OTHERS);
+		}
+	}
+
+	free_IO_state();
+	free(ctx);
+	Ctx = bound_ctx;
+	free(tree);
+	free(table);
+	free(value);
+	free(result);
+	free(stream);
+}
@@ -9,8 +9,13 @@
 
 #include "globals.h"
 #include "ctrl.h"
+#include <unistd.h>	/* dup(), dup2() for the write stream to stdout */
+#if defined(CTRL_WRITE_THREAD) || defined(CTRL_READ_THREAD) \
+	|| defined(CTRL_SAVE_THREAD)
+#include <pthread.h>
+#endif
 
-#define MAX_BUFFER_SIZE 65530	/* maximum buffer size for read or write */
+#define MIN_WRITE_BUFFER_SIZE 1024	/* minimum size of a write_buffer half */
 
 /* definitions for fseek */
 #ifndef SEEK_SET
@@ -24,8 +29,21 @@
 /* for image-files (Y, Cb and Cr) IO */
 /* 	for encoder */
 extern boolean read_and_show_frame(int32 frame_ID, FSTORE *fs);
+extern void start_frame_loader(int32 first_ID, int32 last_ID, int32 skip);
+extern FSTORE *load_frame(int32 frame_ID);
+extern void stop_frame_loader(void);
 /* 	for decoder */
 extern boolean write_or_show_frame(int32 end_frame_ID, FSTORE *fs);
+extern void start_frame_saver(void);
+extern FSTORE *get_frame_buffer(void);
+extern void release_frame_buffer(FSTORE *fs);
+extern void save_frame(int32 end_frame_ID, FSTORE *fs);
+extern void stop_frame_saver(void);
+/*	for both (_YUV or _Y4M frame files) */
+extern void close_frame_files(void);
+/*	the state of the session */
+extern void make_IO_state(void);
+extern void free_IO_state(void);
 /* for bit-stream IO */
 /* 	for encoder (write_stream) */
 extern void open_write_stream(char *filename);
@@ -33,44 +51,201 @@ extern void close_write_stream(void);
 extern void put_bit(int16 bit);
 extern void put_n_bits(int16 n, int32 word);
 extern int32 ftell_write_stream(void);
+extern void redirect_write_stream(BIT_BUFFER *buf);
+extern void append_write_stream(BIT_BUFFER *buf);
 /* 	for decoder (read_stream) */
-extern void open_read_stream(char *filename);
+extern void open_read_stream(void);
+extern void push_read_stream(byte *data, int32 len);
+extern void push_read_stream_in_place(byte *data, int32 len);
+extern boolean PSC_in_read_stream(int32 n);
 extern void close_read_stream(void);
-extern int16 get_bit(void);
-extern int32 get_n_bits(int16 n);
+extern int16 fill_read_cache(void);
+extern int16 eof_read_error(void);
 extern int32 ftell_read_stream(void);
 extern boolean eof_read_stream(void);
 
-extern IMAGE *Image;		/* global info. of image */
-
 /*************************************************************************/
 /* private */
-/* for bit-stream IO */
-/* ?_buffer_ptr pointers the start-position in the ?_stream */
-/* ?_buffer_end pointers the end-position in the ?_stream */
-static byte *write_buffer, *write_buffer_ptr, *write_buffer_end;
-static byte *read_buffer, *read_buffer_ptr, *read_buffer_end;
-static int32 write_buffer_size;
-static int32 read_buffer_size;
-
-static FILE *write_stream;
-static FILE *read_stream;
-static int16 write_position;	/* 0, ..., 7 */
-static int16 read_position;	/* 0, ..., 7 */
+/* for one file of all frames (Image->?_file_type is _YUV or _Y4M) */
+/* frame i is at ?_file_header + i * (?_frame_header + frame length) */
+#define MAX_Y4M_HEADER 256	/* max. length of a .y4m (frame) header */
 
-/* for bit operations */
-/* 0...0001, 0...0010, 0...0100, 0...1000, ... */
-static bytes4 bit_set_mask[] = {
-	0x00000001,0x00000002,0x00000004,0x00000008,
-	0x00000010,0x00000020,0x00000040,0x00000080,
-	0x00000100,0x00000200,0x00000400,0x00000800,
-	0x00001000,0x00002000,0x00004000,0x00008000,
-	0x00010000,0x00020000,0x00040000,0x00080000,
-	0x00100000,0x00200000,0x00400000,0x00800000,
-	0x01000000,0x02000000,0x04000000,0x08000000,
-	0x10000000,0x20000000,0x40000000,0x80000000
+static void open_input_file(void);
+static int32 read_y4m_header(FILE *fp, char *header);
+static boolean read_frame_file(int32 frame_ID, FSTORE *fs);
+static void write_frame_file(FSTORE *fs);
+static boolean read_MEM(MEM *mem, FILE *fp);
+static boolean write_MEM(MEM *mem, FILE *fp);
+static void refer_frame_buffer(FSTORE *fs, int16 n);
+#ifdef CTRL_READ_THREAD
+static void *loader_thread(void *arg);
+#endif
+#ifdef CTRL_SAVE_THREAD
+static void *saver_thread(void *arg);
+#endif
+#ifdef CTRL_WRITE_THREAD
+static void *writer_thread(void *arg);
+#endif
+static void write_out(byte *data, int32 len);
+static void hand_write_buffer(void);
+
+/* the IO state of a session (see make_IO_state()) */
+struct IO_State {
+	/* for one file of all frames */
+	FILE *input_file, *output_file;
+	int32 input_file_header;	/* bytes of the file header */
+	int32 input_frame_header;	/* bytes of each frame header */
+	int32 input_next_ID;		/* the frame ID at file position */
+	int32 start_frame_ID;	/* the next frame ID to be written */
+
+	/* for the frame loader (read ahead) of encoder */
+	/* load_ring[load_head ... load_head+load_count-1] are loaded frames,
+	 * and load_ring[load_head-1] is used by the encoder (got by
+	 * load_frame) */
+	FSTORE **load_ring;
+	int32 *load_ring_ID;	/* frame ID of load_ring[], -1: no frame */
+	int16 load_ring_size;	/* Read_ahead + 1 */
+	int16 load_head, load_count;
+	int32 load_next_ID;	/* the next frame ID to be loaded */
+	int32 load_last_ID;	/* End_frame */
+	int32 load_skip;	/* Frame_skip */
+	#ifdef CTRL_READ_THREAD
+	pthread_t loader;
+	pthread_mutex_t loader_lock;
+	pthread_cond_t loader_cond;
+	boolean loader_quit;
+	#endif
+
+	/* for the frame saver (write behind) of decoder */
+	/* save_pool[] are reference-counted frame buffers (save_refs[]):
+	 * referred by the decoder (get_frame_buffer) and by each save_queue
+	 * entry */
+	FSTORE *save_pool[WRITE_BEHIND+2];
+	int16 save_refs[WRITE_BEHIND+2];
+	/* save_queue[save_head ... save_head+save_count-1] are to be
+	 * written: frames till save_queue_ID[] by the frame buffer
+	 * save_queue[] */
+	FSTORE *save_queue[WRITE_BEHIND];
+	int32 save_queue_ID[WRITE_BEHIND];
+	int16 save_head, save_count;
+	#ifdef CTRL_SAVE_THREAD
+	pthread_t saver;
+	pthread_mutex_t saver_lock;
+	pthread_cond_t saver_cond;
+	boolean saver_quit;
+	boolean saver_started;
+	#endif
+
+	/* for bit-stream IO */
+	/* ?_buffer_ptr pointers the start-position in the ?_stream */
+	/* ?_buffer_end pointers the end-position in the ?_stream */
+	byte *write_buffer, *write_buffer_ptr, *write_buffer_end;
+	byte *read_buffer, *read_buffer_ptr, *read_buffer_end;
+	int32 write_buffer_size;	/* size of each half of write_buffer */
+	int32 read_buffer_size;
+
+	/* for the write stream */
+	/* write_buffer is a double buffer: write_buffer_ptr fills the half
+	 * starting at write_half, while the other half is written out */
+	FILE *write_stream;
+	byte *write_half;
+	int32 write_stream_bytes;	/* # of bytes handed to write_stream */
+	boolean write_to_pipe;	/* write_stream is opened by popen() */
+	#ifdef CTRL_WRITE_THREAD
+	/* the writer thread writes out the half handed by
+	 * hand_write_buffer() */
+	pthread_t writer;
+	pthread_mutex_t writer_lock;
+	pthread_cond_t writer_cond;
+	byte *writer_data;	/* the handed half (NULL: none) */
+	int32 writer_len;	/* # of bytes in the handed half */
+	boolean writer_quit;
+	#endif
+
+	/* write_cache keeps write_cache_bits unwritten bits from its MSB,
+	 * and is flushed into write_buffer a word (32 bits) at a time */
+	bytes8 write_cache;
+	int16 write_cache_bits;	/* 0, ..., 63 */
+
+	/* for the read stream: the bytes pushed by push_read_stream(),
+	 * the read_cache is kept in the session (see bitstream.h) */
+	int32 read_stream_bytes;	/* # of bytes pushed */
+	boolean read_ended;	/* the end of the stream has been pushed */
+	boolean read_in_place;	/* read_buffer is the caller's bytes (see
+				 * push_read_stream_in_place()) */
+	bytes4 PSC_window;	/* the last bits pushed (for PSC_count) */
+	int32 PSC_count;	/* # of PSCs pushed */
+	int32 PSC_end;		/* read_stream_bytes at the last PSC */
 };
 
+#define IO_state		(Ctx->IO_state)
+#define input_file		(IO_state->input_file)
+#define output_file		(IO_state->output_file)
+#define input_file_header	(IO_state->input_file_header)
+#define input_frame_header	(IO_state->input_frame_header)
+#define input_next_ID		(IO_state->input_next_ID)
+#define start_frame_ID		(IO_state->start_frame_ID)
+#define load_ring		(IO_state->load_ring)
+#define load_ring_ID		(IO_state->load_ring_ID)
+#define load_ring_size		(IO_state->load_ring_size)
+#define load_head		(IO_state->load_head)
+#define load_count		(IO_state->load_count)
+#define load_next_ID		(IO_state->load_next_ID)
+#define load_last_ID		(IO_state->load_last_ID)
+#define load_skip		(IO_state->load_skip)
+#define loader			(IO_state->loader)
+#define loader_lock		(IO_state->loader_lock)
+#define loader_cond		(IO_state->loader_cond)
+#define loader_quit		(IO_state->loader_quit)
+#define save_pool		(IO_state->save_pool)
+#define save_refs		(IO_state->save_refs)
+#define save_queue		(IO_state->save_queue)
+#define save_queue_ID		(IO_state->save_queue_ID)
+#define save_head		(IO_state->save_head)
+#define save_count		(IO_state->save_count)
+#define saver			(IO_state->saver)
+#define saver_lock		(IO_state->saver_lock)
+#define saver_cond		(IO_state->saver_cond)
+#define saver_quit		(IO_state->saver_quit)
+#define saver_started		(IO_state->saver_started)
+#define write_buffer		(IO_state->write_buffer)
+#define write_buffer_ptr	(IO_state->write_buffer_ptr)
+#define write_buffer_end	(IO_state->write_buffer_end)
+#define read_buffer		(IO_state->read_buffer)
+#define read_buffer_ptr		(IO_state->read_buffer_ptr)
+#define read_buffer_end		(IO_state->read_buffer_end)
+#define write_buffer_size	(IO_state->write_buffer_size)
+#define read_buffer_size	(IO_state->read_buffer_size)
+#define write_stream		(IO_state->write_stream)
+#define write_half		(IO_state->write_half)
+#define write_stream_bytes	(IO_state->write_stream_bytes)
+#define write_to_pipe		(IO_state->write_to_pipe)
+#define writer			(IO_state->writer)
+#define writer_lock		(IO_state->writer_lock)
+#define writer_cond		(IO_state->writer_cond)
+#define writer_data		(IO_state->writer_data)
+#define writer_len		(IO_state->writer_len)
+#define writer_quit		(IO_state->writer_quit)
+#define write_cache		(IO_state->write_cache)
+#define write_cache_bits	(IO_state->write_cache_bits)
+#define read_stream_bytes	(IO_state->read_stream_bytes)
+#define read_ended		(IO_state->read_ended)
+#define read_in_place		(IO_state->read_in_place)
+#define PSC_window		(IO_state->PSC_window)
+#define PSC_count		(IO_state->PSC_count)
+#define PSC_end			(IO_state->PSC_end)
+
+/* bytes pushed after a PSC for the picture header (TR, PTYPE, PEI and
+ * PSPARE) following it, see PSC_in_read_stream() */
+#define PSC_TAIL_BYTES 4
+
+#define SAVE_POOL_SIZE (sizeof(save_pool) / sizeof(FSTORE *))
+
+/* the bits put by this thread go to put_buffer instead of write_stream
+ * if it is set (see redirect_write_stream()) */
+static THREAD_LOCAL BIT_BUFFER *put_buffer = NULL;
+
+/* for bit operations */
 /* 0...0001, 0...0011, 0...0111, 0...1111, ... */
 static bytes4 bits_enable_mask[] = {
 	0x00000001,0x00000003,0x00000007,0x0000000F,
@@ -83,6 +258,84 @@ static bytes4 bits_enable_mask[] = {
 	0x1FFFFFFF,0x3FFFFFFF,0x7FFFFFFF,0xFFFFFFFF,
 };
 
+/*************************************************************************
+ *
+ *	Name:		make_IO_state()
+ *	Description:	make the IO state of the session: frame files, the
+ *			frame loader and saver, and the bitstream
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	Ctx->IO_state is set, and exit while error occurs
+ *
+ *************************************************************************/
+void make_IO_state(void)
+{
+	DEBUG("make_IO_state");
+
+	if (!(IO_state = (struct IO_State *) calloc(1, sizeof(struct IO_State)))) {
+		ERROR_LINE();
+		printf("Cannot allocate the IO state.\n");
+		exit(ERROR_MEMORY);
+	}
+	start_frame_ID = -1;	/* set by the first write_or_show_frame() */
+
+	#ifdef CTRL_READ_THREAD
+	pthread_mutex_init(&loader_lock, NULL);
+	pthread_cond_init(&loader_cond, NULL);
+	#endif
+	#ifdef CTRL_SAVE_THREAD
+	pthread_mutex_init(&saver_lock, NULL);
+	pthread_cond_init(&saver_cond, NULL);
+	#endif
+	#ifdef CTRL_WRITE_THREAD
+	pthread_mutex_init(&writer_lock, NULL);
+	pthread_cond_init(&writer_cond, NULL);
+	#endif
+}
+
+/*************************************************************************
+ *
+ *	Name:		free_IO_state()
+ *	Description:	free the IO state of the session: the threads
+ *			are stopped, and the files and streams are closed
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	Ctx->IO_state is reset to NULL
+ *
+ *************************************************************************/
+void free_IO_state(void)
+{
+	DEBUG("free_IO_state");
+	int16 i;
+
+	if (!IO_state) return;
+
+	stop_frame_loader();
+	stop_frame_saver();
+	if (write_buffer) close_write_stream();
+	if (read_buffer) close_read_stream();
+	close_frame_files();
+
+	for (i=0; i<SAVE_POOL_SIZE; i++)
+		if (save_pool[i]) free_FS(save_pool[i]);
+
+	#ifdef CTRL_READ_THREAD
+	pthread_mutex_destroy(&loader_lock);
+	pthread_cond_destroy(&loader_cond);
+	#endif
+	#ifdef CTRL_SAVE_THREAD
+	pthread_mutex_destroy(&saver_lock);
+	pthread_cond_destroy(&saver_cond);
+	#endif
+	#ifdef CTRL_WRITE_THREAD
+	pthread_mutex_destroy(&writer_lock);
+	pthread_cond_destroy(&writer_cond);
+	#endif
+
+	free(IO_state);
+	IO_state = NULL;
+}
+
 /*************************************************************************
  *
  *	Name:		read_and_show_frame()
@@ -102,7 +355,10 @@ boolean read_and_show_frame(int32 frame_ID, FSTORE *fs)
 	FILE *inp;
 	ComponentType type;
 
-	if (Image->read_from_files) {
+	if (Image->read_from_files && (Image->input_file_type!=_FILES)) {
+		/* read from one file of all frames */
+		return read_frame_file(frame_ID, fs);
+	} else if (Image->read_from_files) {
 		/* read from 3 files */
 		for (type=0; type<NUMBER_OF_COMPONENTS; type++) {
 			/* make input frame filenames */
@@ -127,8 +383,7 @@ boolean read_and_show_frame(int32 frame_ID, FSTORE *fs)
 				exit(ERROR_IO);
 			}
 
-			fread((void *) fs->fs[type]->data,
-				sizeof(byte), Image->len[type], inp);
+			read_MEM(fs->fs[type], inp);
 			fclose(inp);
 		}
 	} else {
@@ -142,6 +397,188 @@ boolean read_and_show_frame(int32 frame_ID, FSTORE *fs)
 	return TRUE;	/* successful read */
 }
 
+/*************************************************************************
+ *
+ *	Name:		start_frame_loader()
+ *	Description:	start to load the frames first_ID, first_ID+skip,
+ *			..., last_ID by read_and_show_frame() (Read_ahead
+ *			frames are read ahead by the loader thread)
+ *	Input:          the first and the last frame ID, and # of frames
+ *			per coded frame
+ *	Return:		none
+ *	Side effects:	allocate Read_ahead+1 frame stores for load_ring,
+ *			and exit while error occurs
+ *
+ *************************************************************************/
+void start_frame_loader(int32 first_ID, int32 last_ID, int32 skip)
+{
+	DEBUG("start_frame_loader");
+	int16 i;
+
+	#ifndef CTRL_READ_THREAD
+	Read_ahead = 0;
+	#endif
+
+	/* make the ring of frame stores */
+	load_ring_size = (int16) Read_ahead + 1;
+	if (!(load_ring = (FSTORE **) malloc(load_ring_size * sizeof(FSTORE *)))
+	    || !(load_ring_ID = (int32 *) malloc(load_ring_size * sizeof(int32)))) {
+		ERROR_LINE();
+		printf("Cannot allocate load_ring.\n");
+		exit(ERROR_MEMORY);
+	}
+	for (i=0; i<load_ring_size; i++) {
+		load_ring[i] = make_FS(Image->width[_Y], Image->height[_Y]);
+		load_ring_ID[i] = -1;
+	}
+	load_head = load_count = 0;
+	load_next_ID = first_ID;
+	load_last_ID = last_ID;
+	load_skip = skip;
+
+	#ifdef CTRL_READ_THREAD
+	if (Read_ahead>0) {
+		loader_quit = FALSE;
+		if (pthread_create(&loader, NULL, loader_thread, (void *) Ctx)) {
+			ERROR_LINE();
+			printf("Cannot create the loader thread.\n");
+			exit(ERROR_OTHERS);
+		}
+	}
+	#endif
+}
+
+/*************************************************************************
+ *
+ *	Name:		load_frame()
+ *	Description:	get the designated frame loaded by the frame loader
+ *			(read it now without reading ahead)
+ *	Input:          frame ID (must be the next one to be loaded)
+ *	Return:		pointer to frame store of the frame,
+ *			NULL if no such frame (or no capture supported)
+ *	Side effects:	the frame store got by the last call is free
+ *			for the loader thread, and wait while the frame
+ *			is not loaded
+ *
+ *************************************************************************/
+FSTORE *load_frame(int32 frame_ID)
+{
+	DEBUG("load_frame");
+	#ifdef CTRL_READ_THREAD
+	int16 entry;
+	#endif
+
+	if (load_ring_size==1) {
+		/* without reading ahead */
+		load_next_ID = frame_ID + load_skip;
+		return (((frame_ID<=load_last_ID)
+			&& read_and_show_frame(frame_ID, load_ring[0])) ?
+			load_ring[0] : NULL);
+	}
+
+	#ifdef CTRL_READ_THREAD
+	/* wait for the frame */
+	pthread_mutex_lock(&loader_lock);
+	while (load_count==0) pthread_cond_wait(&loader_cond, &loader_lock);
+	entry = load_head;
+	load_head = (load_head + 1) % load_ring_size;
+	load_count--;
+	pthread_cond_broadcast(&loader_cond);
+	pthread_mutex_unlock(&loader_lock);
+
+	if (load_ring_ID[entry]<0) return NULL;	/* no more frames */
+	if (load_ring_ID[entry]!=frame_ID) {
+		ERROR_LINE();
+		printf("Frame %ld is loaded instead of frame %ld.\n",
+			load_ring_ID[entry], frame_ID);
+		exit(ERROR_OTHERS);
+	}
+	return load_ring[entry];
+	#else
+	return NULL;
+	#endif
+}
+
+/*************************************************************************
+ *
+ *	Name:		stop_frame_loader()
+ *	Description:	stop the frame loader
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	the loader thread is stopped, and load_ring is free
+ *
+ *************************************************************************/
+void stop_frame_loader(void)
+{
+	DEBUG("stop_frame_loader");
+	int16 i;
+
+	if (!load_ring) return;
+
+	#ifdef CTRL_READ_THREAD
+	if (load_ring_size>1) {
+		pthread_mutex_lock(&loader_lock);
+		loader_quit = TRUE;
+		pthread_cond_broadcast(&loader_cond);
+		pthread_mutex_unlock(&loader_lock);
+		pthread_join(loader, NULL);
+	}
+	#endif
+
+	for (i=0; i<load_ring_size; i++) free_FS(load_ring[i]);
+	free(load_ring);
+	free(load_ring_ID);
+	load_ring = NULL;
+}
+
+#ifdef CTRL_READ_THREAD
+/*************************************************************************
+ *
+ *	Name:		loader_thread()
+ *	Description:	the loader thread: read frames into load_ring ahead
+ *			of the encoder until no such frame
+ *	Input:		the session (arg)
+ *	Return:		NULL
+ *	Side effects:	wait while load_ring is full
+ *
+ *************************************************************************/
+static void *loader_thread(void *arg)
+{
+	DEBUG("loader_thread");
+	int16 entry;
+	int32 frame_ID;
+	boolean loaded;
+
+	Ctx = (H261_CONTEXT *) arg;
+
+	do {
+		/* wait for a free entry (the encoder holds one entry) */
+		pthread_mutex_lock(&loader_lock);
+		while ((load_count==load_ring_size-1) && !loader_quit)
+			pthread_cond_wait(&loader_cond, &loader_lock);
+		if (loader_quit) {
+			pthread_mutex_unlock(&loader_lock);
+			break;
+		}
+		entry = (load_head + load_count) % load_ring_size;
+		frame_ID = load_next_ID;
+		pthread_mutex_unlock(&loader_lock);
+
+		loaded = ((frame_ID<=load_last_ID)
+			&& read_and_show_frame(frame_ID, load_ring[entry]));
+
+		pthread_mutex_lock(&loader_lock);
+		load_ring_ID[entry] = (loaded ? frame_ID : -1);
+		load_next_ID += load_skip;
+		load_count++;
+		pthread_cond_broadcast(&loader_cond);
+		pthread_mutex_unlock(&loader_lock);
+	} while (loaded);
+
+	return NULL;
+}
+#endif
+
 /*************************************************************************
  *
  *	Name:		write_or_show_frame()
@@ -149,24 +586,29 @@ boolean read_and_show_frame(int32 frame_ID, FSTORE *fs)
  *	Input:          the last written frame ID and pointer to frame store
  *	Return:		TRUE for successful writing,
  *			FALSE if no supported display
- *	Side effects:   Start_frame_ID will be increased to end_frame_ID
+ *	Side effects:   start_frame_ID will be increased to end_frame_ID
  *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
  *
  *************************************************************************/
 boolean write_or_show_frame(int32 end_frame_ID, FSTORE *fs)
 {
 	DEBUG("write_or_show_frame");
-	extern int32 Start_frame;
 	char filename[MAX_FILENAME_LEN];
 	FILE *out;
 	ComponentType type;
-	static int32 start_frame_ID = -1;
 
 	if (Image->write_to_files) {
 		/* set start_frame_ID while first time calling the procedure */
 		if (start_frame_ID<0) start_frame_ID = Start_frame;
 
 		while (start_frame_ID<=end_frame_ID) {
+			if (Image->output_file_type!=_FILES) {
+				/* append to one file of all frames */
+				write_frame_file(fs);
+				start_frame_ID++;
+				continue;
+			}
+
 			/* write to 3 files */
 			for (type=0; type<NUMBER_OF_COMPONENTS; type++) {
 				/* make output frame filenames */
@@ -182,8 +624,7 @@ boolean write_or_show_frame(int32 end_frame_ID, FSTORE *fs)
 					exit(ERROR_IO);
 				}
 
-				fwrite((void *) fs->fs[type]->data,
-					sizeof(byte), Image->len[type], out);
+				write_MEM(fs->fs[type], out);
 				fclose(out);
 			}
 			start_frame_ID++;
@@ -206,57 +647,587 @@ boolean write_or_show_frame(int32 end_frame_ID, FSTORE *fs)
 	return TRUE;
 }
 
+/*************************************************************************
+ *
+ *	Name:		close_frame_files()
+ *	Description:	close the input and output file of all frames
+ *			(opened for Image->?_file_type _YUV or _Y4M)
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	exit while error occurs in writing
+ *
+ *************************************************************************/
+void close_frame_files(void)
+{
+	DEBUG("close_frame_files");
+
+	if (input_file) {
+		fclose(input_file);
+		input_file = NULL;
+	}
+	if (output_file) {
+		if (fclose(output_file)) {
+			ERROR_LINE();
+			printf("Cannot write to %s.\n",
+				Image->output_frame_prefix);
+			exit(ERROR_IO);
+		}
+		output_file = NULL;
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		read_y4m_header()
+ *	Description:	read a .y4m (file or frame) header line
+ *	Input:		file pointer and buffer for the header
+ *			(MAX_Y4M_HEADER bytes)
+ *	Return:		# of bytes of the header (including '\n'),
+ *			0 at EOF
+ *	Side effects:	the header is ended by '\0' instead of '\n'
+ *
+ *************************************************************************/
+static int32 read_y4m_header(FILE *fp, char *header)
+{
+	DEBUG("read_y4m_header");
+	int32 len;
+	int c;
+
+	for (len=0; (c = getc(fp)) != '\n'; len++) {
+		if (c==EOF) return 0;
+		if (len>=MAX_Y4M_HEADER-1) {
+			ERROR_LINE();
+			printf("Too long header in %s.\n",
+				Image->input_frame_prefix);
+			exit(ERROR_IO);
+		}
+		header[len] = (char) c;
+	}
+	header[len] = '\0';
+
+	return len+1;
+}
+
+/*************************************************************************
+ *
+ *	Name:		open_input_file()
+ *	Description:	open the input file of all frames and check its
+ *			header (for _Y4M) or its length (for _YUV)
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	input_file, input_file_header and input_frame_header
+ *			will be set, and exit while error occurs
+ *
+ *************************************************************************/
+static void open_input_file(void)
+{
+	DEBUG("open_input_file");
+	char header[MAX_Y4M_HEADER], *p;
+	char *save;	/* for strtok_r() (sessions may open at once) */
+	int32 frame_len, file_len;
+
+	if ((input_file = fopen(Image->input_frame_prefix, "rb")) == NULL) {
+		ERROR_LINE();
+		printf("Cannot open filename %s.\n", Image->input_frame_prefix);
+		exit(ERROR_IO);
+	}
+	frame_len = Image->len[_Y] + Image->len[_Cb] + Image->len[_Cr];
+	input_file_header = input_frame_header = 0;
+
+	if (Image->input_file_type==_Y4M) {
+		/* YUV4MPEG2 W<width> H<height> [F.. I.. A.. C.. X..] */
+		input_file_header = read_y4m_header(input_file, header);
+		if (strncmp(header, Y4M_MAGIC, strlen(Y4M_MAGIC))) {
+			ERROR_LINE();
+			printf("Not a YUV4MPEG2 file: %s.\n",
+				Image->input_frame_prefix);
+			exit(ERROR_IO);
+		}
+		for (p=strtok_r(header, " ", &save); p;
+		     p=strtok_r(NULL, " ", &save)) {
+			if (((*p=='W') && (atol(p+1)!=Image->width[_Y]))
+			    || ((*p=='H') && (atol(p+1)!=Image->height[_Y]))) {
+				ERROR_LINE();
+				printf("Frame size is not corret: %s.\n",
+					Image->input_frame_prefix);
+				exit(ERROR_IO);
+			}
+			/* 8-bit 4:2:0 only (not C420p10 etc.) */
+			if ((*p=='C') && strcmp(p+1, "420")
+			    && strcmp(p+1, "420jpeg")
+			    && strcmp(p+1, "420paldv")
+			    && strcmp(p+1, "420mpeg2")) {
+				ERROR_LINE();
+				printf("Only 4:2:0 is supported: %s.\n",
+					Image->input_frame_prefix);
+				exit(ERROR_IO);
+			}
+		}
+
+		/* frame headers are taken to be as long as the 1st one */
+		input_frame_header = read_y4m_header(input_file, header);
+	} else {
+		/* check the file length */
+		fseek(input_file, 0, SEEK_END);
+		file_len = ftell(input_file);
+		if (file_len % frame_len) {
+			ERROR_LINE();
+			printf("File size is not corret: %s.\n",
+				Image->input_frame_prefix);
+			exit(ERROR_IO);
+		}
+	}
+
+	/* seek to frame 0 */
+	fseek(input_file, input_file_header, SEEK_SET);
+	input_next_ID = 0;
+}
+
+/*************************************************************************
+ *
+ *	Name:		read_frame_file()
+ *	Description:	read the designated frame from the input file
+ *			of all frames (seek to it if not the next one)
+ *	Input:		frame ID (index in the file) and pointer to
+ *			frame store
+ *	Return:		TRUE for successful reading,
+ *			FALSE if no such frame
+ *	Side effects:	exit while error occurs
+ *
+ *************************************************************************/
+static boolean read_frame_file(int32 frame_ID, FSTORE *fs)
+{
+	DEBUG("read_frame_file");
+	char header[MAX_Y4M_HEADER];
+	ComponentType type;
+
+	if (!input_file) open_input_file();
+
+	/* seek by frame index */
+	if (frame_ID!=input_next_ID) {
+		if (fseek(input_file, input_file_header + frame_ID
+				* (input_frame_header + Image->len[_Y]
+				   + Image->len[_Cb] + Image->len[_Cr]),
+				SEEK_SET))
+			return FALSE;
+	}
+	input_next_ID = -1;	/* unknown position while error */
+
+	if (Image->input_file_type==_Y4M) {
+		if (read_y4m_header(input_file, header)==0)
+			return FALSE;	/* EOF */
+		if (strncmp(header, Y4M_FRAME, strlen(Y4M_FRAME))) {
+			ERROR_LINE();
+			printf("No frame header of frame %ld: %s.\n",
+				frame_ID, Image->input_frame_prefix);
+			exit(ERROR_IO);
+		}
+	}
+
+	for (type=0; type<NUMBER_OF_COMPONENTS; type++) {
+		if (!read_MEM(fs->fs[type], input_file))
+			return FALSE;	/* EOF */
+	}
+	input_next_ID = frame_ID + 1;
+
+	return TRUE;
+}
+
+/*************************************************************************
+ *
+ *	Name:		write_frame_file()
+ *	Description:	append the frame to the output file of all frames
+ *			(the file and its header are written for the
+ *			first frame)
+ *	Input:		pointer to frame store
+ *	Return:		none
+ *	Side effects:	exit while error occurs
+ *
+ *************************************************************************/
+static void write_frame_file(FSTORE *fs)
+{
+	DEBUG("write_frame_file");
+	ComponentType type;
+
+	if (!output_file) {
+		if ((output_file = fopen(Image->output_frame_prefix, "wb"))
+				== NULL) {
+			ERROR_LINE();
+			printf("Cannot open filename %s.\n",
+				Image->output_frame_prefix);
+			exit(ERROR_IO);
+		}
+		if (Image->output_file_type==_Y4M)
+			fprintf(output_file, "%s W%d H%d F%ld:1000 Ip A0:0 C420jpeg\n",
+				Y4M_MAGIC, Image->width[_Y], Image->height[_Y],
+				(int32) (Frame_rate * 1000 + 0.5));
+	}
+
+	if (Image->output_file_type==_Y4M)
+		fprintf(output_file, "%s\n", Y4M_FRAME);
+	for (type=0; type<NUMBER_OF_COMPONENTS; type++) {
+		if (!write_MEM(fs->fs[type], output_file)) {
+			ERROR_LINE();
+			printf("Cannot write to %s.\n",
+				Image->output_frame_prefix);
+			exit(ERROR_IO);
+		}
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		read_MEM()
+ *	Description:	read the picture of a MEM structure from a file
+ *			(line by line, the border is skipped)
+ *	Input:		the pointers to the MEM structure and the file
+ *	Return:		TRUE for successful reading, FALSE for EOF
+ *	Side effects:	the picture in mem will be changed
+ *
+ *************************************************************************/
+static boolean read_MEM(MEM *mem, FILE *fp)
+{
+	DEBUG("read_MEM");
+	int16 i;
+	unsigned char *ptr;
+
+	for (i=0,ptr=mem->data; i<mem->height; i++,ptr+=mem->stride)
+		if (fread((void *) ptr, sizeof(byte), mem->width, fp)
+				!= (size_t) mem->width)
+			return FALSE;
+
+	return TRUE;
+}
+
+/*************************************************************************
+ *
+ *	Name:		write_MEM()
+ *	Description:	write the picture of a MEM structure to a file
+ *			(line by line, the border is skipped)
+ *	Input:		the pointers to the MEM structure and the file
+ *	Return:		TRUE for successful writing, FALSE while error
+ *	Side effects:	none
+ *
+ *************************************************************************/
+static boolean write_MEM(MEM *mem, FILE *fp)
+{
+	DEBUG("write_MEM");
+	int16 i;
+	unsigned char *ptr;
+
+	for (i=0,ptr=mem->data; i<mem->height; i++,ptr+=mem->stride)
+		if (fwrite((void *) ptr, sizeof(byte), mem->width, fp)
+				!= (size_t) mem->width)
+			return FALSE;
+
+	return TRUE;
+}
+
+/*************************************************************************
+ *
+ *	Name:		start_frame_saver()
+ *	Description:	start the frame saver: the decoded frames are given
+ *			by save_frame() and written (or shown) behind the
+ *			decoder by the saver thread
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	exit while error occurs
+ *
+ *************************************************************************/
+void start_frame_saver(void)
+{
+	DEBUG("start_frame_saver");
+
+	save_head = save_count = 0;
+
+	#ifdef CTRL_SAVE_THREAD
+	saver_quit = FALSE;
+	if (pthread_create(&saver, NULL, saver_thread, (void *) Ctx)) {
+		ERROR_LINE();
+		printf("Cannot create the saver thread.\n");
+		exit(ERROR_OTHERS);
+	}
+	saver_started = TRUE;
+	#endif
+}
+
+/*************************************************************************
+ *
+ *	Name:		get_frame_buffer()
+ *	Description:	get a free frame buffer for decoding a frame
+ *	Input:		none
+ *	Return:		pointer to the frame buffer (referred once)
+ *	Side effects:	the frame buffers are allocated at the first time
+ *			(after set_image_type()), and wait while all frame
+ *			buffers are referred
+ *
+ *************************************************************************/
+FSTORE *get_frame_buffer(void)
+{
+	DEBUG("get_frame_buffer");
+	int16 i;
+
+	if (!save_pool[0]) {
+		for (i=0; i<SAVE_POOL_SIZE; i++) {
+			save_pool[i] = make_FS(Image->width[_Y], Image->height[_Y]);
+			save_refs[i] = 0;
+		}
+	}
+
+	#ifdef CTRL_SAVE_THREAD
+	pthread_mutex_lock(&saver_lock);
+	#endif
+	for (;;) {
+		for (i=0; i<SAVE_POOL_SIZE; i++)
+			if (save_refs[i]==0) break;
+		if (i<SAVE_POOL_SIZE) break;
+		#ifdef CTRL_SAVE_THREAD
+		pthread_cond_wait(&saver_cond, &saver_lock);
+		#else
+		ERROR_LINE();
+		printf("No free frame buffer.\n");
+		exit(ERROR_MEMORY);
+		#endif
+	}
+	save_refs[i] = 1;
+	#ifdef CTRL_SAVE_THREAD
+	pthread_mutex_unlock(&saver_lock);
+	#endif
+
+	return save_pool[i];
+}
+
+/*************************************************************************
+ *
+ *	Name:		refer_frame_buffer()
+ *	Description:	add n to the reference count of a frame buffer
+ *			(saver_lock should be locked by CTRL_SAVE_THREAD)
+ *	Input:		pointer to the frame buffer and n (1 or -1)
+ *	Return:		none
+ *	Side effects:	exit if fs is not in save_pool
+ *
+ *************************************************************************/
+static void refer_frame_buffer(FSTORE *fs, int16 n)
+{
+	DEBUG("refer_frame_buffer");
+	int16 i;
+
+	for (i=0; i<SAVE_POOL_SIZE; i++) {
+		if (save_pool[i]==fs) {
+			save_refs[i] += n;
+			return;
+		}
+	}
+	ERROR_LINE();
+	printf("Not a frame buffer.\n");
+	exit(ERROR_MEMORY);
+}
+
+/*************************************************************************
+ *
+ *	Name:		release_frame_buffer()
+ *	Description:	release a frame buffer got by get_frame_buffer()
+ *	Input:		pointer to the frame buffer
+ *	Return:		none
+ *	Side effects:	the frame buffer is free if not referred any more
+ *
+ *************************************************************************/
+void release_frame_buffer(FSTORE *fs)
+{
+	DEBUG("release_frame_buffer");
+
+	#ifdef CTRL_SAVE_THREAD
+	pthread_mutex_lock(&saver_lock);
+	refer_frame_buffer(fs, -1);
+	pthread_cond_broadcast(&saver_cond);
+	pthread_mutex_unlock(&saver_lock);
+	#else
+	refer_frame_buffer(fs, -1);
+	#endif
+}
+
+/*************************************************************************
+ *
+ *	Name:		save_frame()
+ *	Description:	write or show the frames till end_frame_ID by the
+ *			frame buffer (repeated frames share the buffer)
+ *			behind the decoder (without CTRL_SAVE_THREAD:
+ *			write or show them now)
+ *	Input:          the last frame ID to be written and pointer to
+ *			the frame buffer
+ *	Return:		none
+ *	Side effects:	the frame buffer is referred till written, and
+ *			wait while save_queue is full
+ *
+ *************************************************************************/
+void save_frame(int32 end_frame_ID, FSTORE *fs)
+{
+	DEBUG("save_frame");
+
+	#ifdef CTRL_SAVE_THREAD
+	pthread_mutex_lock(&saver_lock);
+	while (save_count==WRITE_BEHIND)
+		pthread_cond_wait(&saver_cond, &saver_lock);
+	refer_frame_buffer(fs, 1);
+	save_queue[(save_head + save_count) % WRITE_BEHIND] = fs;
+	save_queue_ID[(save_head + save_count) % WRITE_BEHIND] = end_frame_ID;
+	save_count++;
+	pthread_cond_broadcast(&saver_cond);
+	pthread_mutex_unlock(&saver_lock);
+	#else
+	write_or_show_frame(end_frame_ID, fs);
+	#endif
+}
+
+/*************************************************************************
+ *
+ *	Name:		stop_frame_saver()
+ *	Description:	stop the frame saver after all frames are written
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	the saver thread is stopped (the frame buffers
+ *			are free by free_IO_state())
+ *
+ *************************************************************************/
+void stop_frame_saver(void)
+{
+	DEBUG("stop_frame_saver");
+
+	#ifdef CTRL_SAVE_THREAD
+	if (!saver_started) return;
+	pthread_mutex_lock(&saver_lock);
+	saver_quit = TRUE;
+	pthread_cond_broadcast(&saver_cond);
+	pthread_mutex_unlock(&saver_lock);
+	pthread_join(saver, NULL);
+	saver_started = FALSE;
+	#endif
+}
+
+#ifdef CTRL_SAVE_THREAD
+/*************************************************************************
+ *
+ *	Name:		saver_thread()
+ *	Description:	the saver thread: write or show the frames in
+ *			save_queue until stop_frame_saver() and save_queue
+ *			is empty
+ *	Input:		the session (arg)
+ *	Return:		NULL
+ *	Side effects:	the frame buffer is released after written
+ *
+ *************************************************************************/
+static void *saver_thread(void *arg)
+{
+	DEBUG("saver_thread");
+	FSTORE *fs;
+	int32 end_frame_ID;
+
+	Ctx = (H261_CONTEXT *) arg;
+
+	for (;;) {
+		pthread_mutex_lock(&saver_lock);
+		while ((save_count==0) && !saver_quit)
+			pthread_cond_wait(&saver_cond, &saver_lock);
+		if (save_count==0) {
+			/* quit after all frames are written */
+			pthread_mutex_unlock(&saver_lock);
+			break;
+		}
+		fs = save_queue[save_head];
+		end_frame_ID = save_queue_ID[save_head];
+		pthread_mutex_unlock(&saver_lock);
+
+		write_or_show_frame(end_frame_ID, fs);
+
+		pthread_mutex_lock(&saver_lock);
+		refer_frame_buffer(fs, -1);
+		save_head = (save_head + 1) % WRITE_BEHIND;
+		save_count--;
+		pthread_cond_broadcast(&saver_cond);
+		pthread_mutex_unlock(&saver_lock);
+	}
+
+	return NULL;
+}
+#endif
+
 /*************************************************************************
  *
  *	Name:		open_write_stream()
  *	Description:	open bitstream file for write
- *	Input:          bitstream filename
+ *	Input:          bitstream filename (STREAM_STDIO: to stdout,
+ *			"|command": to a pipe)
  *	Return:		none
- *	Side effects:	allocate memory for write_buffer as large as possible
+ *	Side effects:	allocate a double buffer for write_buffer
+ *			(Stream_buffer_size bytes, or smaller if no memory),
+ *			stdout is moved to stderr while writing to stdout,
+ *			and the writer thread is started by CTRL_WRITE_THREAD
  *	Date: 96/04/25	Author: Chu Ching-Wen in N.T.H.U., Tainwan
  *
  *************************************************************************/
 void open_write_stream(char *filename)
 {
 	DEBUG("open_write_stream");
-	extern int32 Number_frame;
-	int32 write_buffer_size_in_byte;
+	int fd;
 
-	if ((write_stream = fopen(filename, "w+b")) == NULL) {
+	write_to_pipe = FALSE;
+	if (!strcmp(filename, STREAM_STDIO)) {
+		/* write to stdout, and the messages go to stderr */
+		fflush(stdout);
+		if (((fd = dup(fileno(stdout))) < 0)
+		    || ((write_stream = fdopen(fd, "wb")) == NULL)) {
+			ERROR_LINE();
+			printf("Cannot open stdout for write_stream\n");
+			exit(ERROR_IO);
+		}
+		dup2(fileno(stderr), fileno(stdout));
+	} else if (*filename=='|') {
+		/* write to a pipe */
+		if ((write_stream = popen(filename+1, "w")) == NULL) {
+			ERROR_LINE();
+			printf("Cannot open write_stream pipe %s\n", filename+1);
+			exit(ERROR_IO);
+		}
+		write_to_pipe = TRUE;
+	} else if ((write_stream = fopen(filename, "w+b")) == NULL) {
 		ERROR_LINE();
 		printf("Cannot open write_stream file %s\n", filename);
 		exit(ERROR_EOF);
 	}
 
-	/* allocate write_buffer to fasten file I/O */
-	/* suppose under 5 frames/sec and 128k bits/sec: */
-	write_buffer_size_in_byte = ((int32) (Number_frame * (128000/8) / 5)
-					* sizeof(byte));
-	/* maximum buffer size is MAX_BUFFER_SIZE bytes */
-	if (write_buffer_size_in_byte>MAX_BUFFER_SIZE)
-		write_buffer_size_in_byte = MAX_BUFFER_SIZE;
-
-	write_buffer_size = write_buffer_size_in_byte;
-	while (!(write_buffer = (byte *) malloc(write_buffer_size))) {
+	/* allocate the two halves of write_buffer */
+	write_buffer_size = Stream_buffer_size / 2;
+	if (write_buffer_size<MIN_WRITE_BUFFER_SIZE)
+		write_buffer_size = MIN_WRITE_BUFFER_SIZE;
+	while (!(write_buffer = (byte *) malloc(2 * write_buffer_size))) {
 		write_buffer_size >>= 1;	/* helf size */
-		if (write_buffer_size<=0) {
-			/* no allocated buffer, we can only use file I/O */
+		if (write_buffer_size<MIN_WRITE_BUFFER_SIZE) {
 			ERROR_LINE();
 			printf("Cannot allocate write_buffer.\n");
-			break;
+			exit(ERROR_MEMORY);
 		}
 	}
 
 	#ifdef DEBUG_ON
-	printf("write_buffer_size = %ld\n", write_buffer_size);
+	printf("write_buffer_size = 2 * %ld\n", write_buffer_size);
 	#endif
 
-	/* initialize write_buffer */
-	write_buffer_ptr = write_buffer;
-	*write_buffer_ptr = 0;
-	write_buffer_end = (byte *) ((int32) write_buffer
-			+ write_buffer_size);
-	write_position = 7;
+	/* initialize write_buffer and write_cache */
+	write_half = write_buffer_ptr = write_buffer;
+	write_buffer_end = write_buffer + write_buffer_size;
+	write_stream_bytes = 0;
+	write_cache = 0;
+	write_cache_bits = 0;
+
+	#ifdef CTRL_WRITE_THREAD
+	writer_data = NULL;
+	writer_quit = FALSE;
+	if (pthread_create(&writer, NULL, writer_thread, (void *) Ctx)) {
+		ERROR_LINE();
+		printf("Cannot create the writer thread.\n");
+		exit(ERROR_OTHERS);
+	}
+	#endif
 }
 
 /*************************************************************************
@@ -265,7 +1236,8 @@ void open_write_stream(char *filename)
  *	Description:	close bitstream file for write
  *	Input:		none
  *	Return:		none
- *	Side effects:	free memory for write_buffer
+ *	Side effects:	write out all data, stop the writer thread and
+ *			free memory for write_buffer
  *	Date: 96/04/25	Author: Chu Ching-Wen in N.T.H.U., Tainwan
  *
  *************************************************************************/
@@ -273,29 +1245,132 @@ void close_write_stream(void)
 {
 	DEBUG("close_write_stream");
 
-	/* fill '0' at the tail of one byte */
-	if (write_position != 7)
-		write_buffer_ptr = (byte *) ((int32) write_buffer_ptr + 1);
+	/* flush write_cache byte by byte,
+	 * and fill '0' at the tail of the last byte */
+	while (write_cache_bits>0) {
+		if (write_buffer_ptr==write_buffer_end) hand_write_buffer();
+		*(write_buffer_ptr++) = (byte) (write_cache >> 56);
+		write_cache <<= 8;
+		write_cache_bits -= 8;
+	}
 
 	/* clear write_buffer */
-	fwrite((void *) write_buffer, sizeof(byte),
-		(int32)write_buffer_ptr - (int32)write_buffer, write_stream);
+	hand_write_buffer();
+
+	#ifdef CTRL_WRITE_THREAD
+	/* wait for the last half, then stop the writer thread */
+	pthread_mutex_lock(&writer_lock);
+	while (writer_data) pthread_cond_wait(&writer_cond, &writer_lock);
+	writer_quit = TRUE;
+	pthread_cond_broadcast(&writer_cond);
+	pthread_mutex_unlock(&writer_lock);
+	pthread_join(writer, NULL);
+	#endif
 
 	free(write_buffer);
-	fclose(write_stream);
+	write_buffer = NULL;
+	if (write_to_pipe) pclose(write_stream);
+	else fclose(write_stream);
+}
+
+/*************************************************************************
+ *
+ *	Name:		write_out()
+ *	Description:	write data to write_stream
+ *	Input:		pointer to data and # of bytes
+ *	Return:		none
+ *	Side effects:	exit while error occurs
+ *
+ *************************************************************************/
+static void write_out(byte *data, int32 len)
+{
+	DEBUG("write_out");
+
+	if (fwrite((void *) data, sizeof(byte), len, write_stream)
+			!= (size_t) len) {
+		ERROR_LINE();
+		printf("Cannot write to write_stream.\n");
+		exit(ERROR_IO);
+	}
 }
 
-#define NEXT_WORD(type) {\
-	write_buffer_ptr = (type *) ((int32) write_buffer_ptr + sizeof(type));\
-	if (write_buffer_ptr==write_buffer_end) {\
-		/* write_buffer is full */\
-		/* write out data from write_buffer */\
-		fwrite((void *) write_buffer, sizeof(type),\
-				write_buffer_size, write_stream);\
-		write_buffer_ptr = write_buffer;\
-	}\
-	*write_buffer_ptr = 0;\
+/*************************************************************************
+ *
+ *	Name:		hand_write_buffer()
+ *	Description:	hand the filled half of write_buffer to the writer
+ *			(or write it out directly without CTRL_WRITE_THREAD)
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	write_buffer_ptr will be moved to the other half,
+ *			waiting for the writer if the other half is still
+ *			being written
+ *
+ *************************************************************************/
+static void hand_write_buffer(void)
+{
+	DEBUG("hand_write_buffer");
+	int32 len = (int32) (write_buffer_ptr - write_half);
+
+	if (len<=0) return;
+	write_stream_bytes += len;
+
+	#ifdef CTRL_WRITE_THREAD
+	pthread_mutex_lock(&writer_lock);
+	while (writer_data) pthread_cond_wait(&writer_cond, &writer_lock);
+	writer_data = write_half;
+	writer_len = len;
+	pthread_cond_broadcast(&writer_cond);
+	pthread_mutex_unlock(&writer_lock);
+
+	/* change to the other half */
+	write_half = (write_half==write_buffer) ?
+		(write_buffer + write_buffer_size) : write_buffer;
+	#else
+	write_out(write_half, len);
+	#endif
+
+	write_buffer_ptr = write_half;
+	write_buffer_end = write_half + write_buffer_size;
+}
+
+#ifdef CTRL_WRITE_THREAD
+/*************************************************************************
+ *
+ *	Name:		writer_thread()
+ *	Description:	the writer thread: write out each half handed by
+ *			hand_write_buffer() until close_write_stream()
+ *	Input:		the session (arg)
+ *	Return:		NULL
+ *	Side effects:	writer_data will be reset after writing
+ *
+ *************************************************************************/
+static void *writer_thread(void *arg)
+{
+	DEBUG("writer_thread");
+	byte *data;
+	int32 len;
+
+	Ctx = (H261_CONTEXT *) arg;
+
+	for (;;) {
+		pthread_mutex_lock(&writer_lock);
+		while (!writer_data && !writer_quit)
+			pthread_cond_wait(&writer_cond, &writer_lock);
+		data = writer_data;
+		len = writer_len;
+		pthread_mutex_unlock(&writer_lock);
+		if (!data) break;	/* quit */
+
+		write_out(data, len);
+
+		pthread_mutex_lock(&writer_lock);
+		writer_data = NULL;
+		pthread_cond_broadcast(&writer_cond);
+		pthread_mutex_unlock(&writer_lock);
 	}
+	return NULL;
+}
+#endif
 
 /*************************************************************************
  *
@@ -303,7 +1378,7 @@ void close_write_stream(void)
  *	Description:	put 1 bit to bitstream file for write
  *	Input:		the bit to be put (bit==0: '0', else: '1')
  *	Return:         none
- *	Side effects:	write_position and write_buffer_ptr will be updated
+ *	Side effects:	write_cache and write_buffer_ptr will be updated
  *	Date: 96/04/25	Author: Chu Ching-Wen in N.T.H.U., Tainwan
  *
  *************************************************************************/
@@ -311,19 +1386,7 @@ void put_bit(int16 bit)
 {
 	DEBUG("put_bit");
 
-	if (bit) {
-		/* set (write_position in write_buffer = '1' */
-		(*write_buffer_ptr) |= bit_set_mask[write_position--];
-	} else {
-		/* set (write_position in write_buffer = '0' => do nothing */
-		write_position--;
-	}
-
-	if (write_position<0) {
-		/* *write_buffer_ptr is full (8-bits), change to next byte */
-		NEXT_WORD(byte);
-		write_position = 7;
-	}
+	put_n_bits(1, (int32) (bit ? 1 : 0));
 }
 
 /*************************************************************************
@@ -332,7 +1395,7 @@ void put_bit(int16 bit)
  *	Description:	put n bits (n<=32) to bitstream file for write
  *	Input:		number of bits and bits to be put
  *	Return:         none
- *	Side effects:	write_position and write_buffer_ptr will be updated
+ *	Side effects:	write_cache and write_buffer_ptr will be updated
  *	Date: 96/04/24	Author: Chu Ching-Wen in N.T.H.U., Tainwan
  *
  *************************************************************************/
@@ -340,22 +1403,57 @@ void put_n_bits(int16 n, int32 word)
 {
 	DEBUG("put_n_bits");
 
-	while (n--) {
-	if (((bytes4)word&bit_set_mask[n])) {
-		/* set (write_position in write_buffer = '1' */
-		(*write_buffer_ptr) |= bit_set_mask[write_position--];
-	} else {
-		/* set (write_position in write_buffer = '0' => do nothing */
-		write_position--;
+	if (n<=0) return;
+
+	if (put_buffer) {
+		/* append the right n bits in word to put_buffer */
+		put_buffer->cache_bits += n;
+		put_buffer->cache |= ((bytes8) ((bytes4) word
+			& bits_enable_mask[n-1]) << (64 - put_buffer->cache_bits));
+
+		if (put_buffer->cache_bits>=32) {
+			/* a whole word in the cache, move it to data */
+			if (put_buffer->bytes+4>put_buffer->size) {
+				put_buffer->size = (put_buffer->size<<1) + 1024;
+				if (!(put_buffer->data = (byte *) realloc(
+					put_buffer->data, put_buffer->size))) {
+					ERROR_LINE();
+					printf("Cannot allocate bit buffer.\n");
+					exit(ERROR_MEMORY);
+				}
+			}
+			put_buffer->data[put_buffer->bytes] =
+				(byte) (put_buffer->cache >> 56);
+			put_buffer->data[put_buffer->bytes+1] =
+				(byte) (put_buffer->cache >> 48);
+			put_buffer->data[put_buffer->bytes+2] =
+				(byte) (put_buffer->cache >> 40);
+			put_buffer->data[put_buffer->bytes+3] =
+				(byte) (put_buffer->cache >> 32);
+			put_buffer->bytes += 4;
+			put_buffer->cache <<= 32;
+			put_buffer->cache_bits -= 32;
+		}
+		return;
 	}
 
-	if (write_position<0) {
-		/* *write_buffer_ptr is full (8-bits), change to next byte */
-		NEXT_WORD(byte);
-		write_position = 7;
+	/* append the right n bits in word to write_cache */
+	write_cache_bits += n;
+	write_cache |= ((bytes8) ((bytes4) word & bits_enable_mask[n-1])
+			<< (64 - write_cache_bits));
+
+	if (write_cache_bits>=32) {
+		/* a whole word in write_cache, move it to write_buffer */
+		if (write_buffer_end-write_buffer_ptr<4) hand_write_buffer();
+		write_buffer_ptr[0] = (byte) (write_cache >> 56);
+		write_buffer_ptr[1] = (byte) (write_cache >> 48);
+		write_buffer_ptr[2] = (byte) (write_cache >> 40);
+		write_buffer_ptr[3] = (byte) (write_cache >> 32);
+		write_buffer_ptr += 4;
+		write_cache <<= 32;
+		write_cache_bits -= 32;
 	}
 }
-}
 
 /*************************************************************************
  *
@@ -371,68 +1469,214 @@ int32 ftell_write_stream(void)
 {
 	DEBUG("ftell_write_stream");
 
-	return (((ftell(write_stream)
-		+ ((int32) write_buffer_ptr - (int32) write_buffer))<<3)
-		+ (7 - write_position));
+	/* bits handed to write_stream (also for stdout and pipes)
+	 * + bits in write_buffer + bits in write_cache */
+	return (((write_stream_bytes
+		+ (int32) (write_buffer_ptr - write_half))<<3)
+		+ write_cache_bits);
+}
+
+/*************************************************************************
+ *
+ *	Name:		redirect_write_stream()
+ *	Description:	put the bits of this thread into a bit buffer
+ *			instead of the write stream, so that the parts of
+ *			a frame can be coded apart (by the threads)
+ *	Input:		the bit buffer to be emptied (NULL: back to the
+ *			write stream)
+ *	Return:		none
+ *	Side effects:	put_buffer will be changed
+ *
+ *************************************************************************/
+void redirect_write_stream(BIT_BUFFER *buf)
+{
+	DEBUG("redirect_write_stream");
+
+	put_buffer = buf;
+	if (buf) {
+		buf->bytes = 0;
+		buf->cache = 0;
+		buf->cache_bits = 0;
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		append_write_stream()
+ *	Description:	append the bits of a bit buffer to the write stream
+ *	Input:		the bit buffer (filled by redirect_write_stream())
+ *	Return:		none
+ *	Side effects:	write_cache and write_buffer_ptr will be updated
+ *
+ *************************************************************************/
+void append_write_stream(BIT_BUFFER *buf)
+{
+	DEBUG("append_write_stream");
+	int32 i;
+
+	for (i=0; i<buf->bytes; i+=4)
+		put_n_bits(32, (int32) (((bytes4) buf->data[i] << 24)
+			| ((bytes4) buf->data[i+1] << 16)
+			| ((bytes4) buf->data[i+2] << 8) | buf->data[i+3]));
+	if (buf->cache_bits>0)
+		put_n_bits(buf->cache_bits,
+			(int32) (buf->cache >> (64 - buf->cache_bits)));
 }
 
 /*************************************************************************
  *
  *	Name:		open_read_stream()
- *	Description:	open bitstream file for read
- *	Input:          bitstream filename
+ *	Description:	open the bitstream for read: the bytes of the stream
+ *			are pushed by push_read_stream() (or by
+ *			push_read_stream_in_place())
+ *	Input:          none
  *	Return:		none
- *	Side effects:	allocate memory for write_buffer as large as possible
+ *	Side effects:	read_buffer is allocated by the first push
  *	Date: 96/04/24	Author: Chu Ching-Wen in N.T.H.U., Tainwan
  *
  *************************************************************************/
-void open_read_stream(char *filename)
+void open_read_stream(void)
 {
 	DEBUG("open_read_stream");
 
-	if ((read_stream = fopen(filename, "rb")) == NULL) {
-		printf("Cannot open read_stream file %s\n", filename);
-		exit(ERROR_EOF);
-	}
+	read_ended = FALSE;
+	read_in_place = FALSE;
+	read_stream_bytes = 0;
+	read_cache = 0;
+	read_cache_bits = 0;
+	PSC_window = 0xffffffff;	/* no PSC at the start */
+	PSC_count = PSC_end = 0;
+
+	/* initialize read_buffer (empty) */
+	read_buffer_size = 0;
+	read_buffer = read_buffer_ptr = read_buffer_end = NULL;
+}
+
+/*************************************************************************
+ *
+ *	Name:		push_read_stream()
+ *	Description:	append bytes to the read stream, and count the PSCs
+ *			in them
+ *	Input:		pointer to the bytes and # of bytes (0: the end of
+ *			the stream)
+ *	Return:		none
+ *	Side effects:	the unread bytes are moved to the start of
+ *			read_buffer, which is allocated (Stream_buffer_size
+ *			bytes at least) or enlarged if needed
+ *
+ *************************************************************************/
+void push_read_stream(byte *data, int32 len)
+{
+	DEBUG("push_read_stream");
+	int32 left = (int32) (read_buffer_end - read_buffer_ptr);
+	int16 s;
 
-	/* allocate read_buffer */
-	fseek(read_stream, 0, SEEK_END);		/* goto EOF */
-	read_buffer_size = ftell(read_stream);	/* get file size */
-	rewind(read_stream);
-	if (read_buffer_size<=0) {
+	if (len<=0) {
+		read_ended = TRUE;
+		return;
+	}
+	if (read_in_place) {
 		ERROR_LINE();
-		printf("read_stream file %s is empty.\n", filename);
-		exit(ERROR_EOF);
+		printf("Cannot push bytes after the bitstream read in place.\n");
+		exit(ERROR_OTHERS);
 	}
 
-	/* maximum buffer size is MAX_BUFFER_SIZE bytes */
-	if (read_buffer_size>MAX_BUFFER_SIZE)
-		read_buffer_size = MAX_BUFFER_SIZE;
-
-	while (!(read_buffer=(byte *) malloc(read_buffer_size))) {
-		read_buffer_size >>= 1;		/* helf size */
+	/* move the unread bytes to the start of read_buffer */
+	if (read_buffer_ptr!=read_buffer)
+		memmove((void *) read_buffer, (void *) read_buffer_ptr, left);
+	if (left+len>read_buffer_size) {
 		if (read_buffer_size<=0) {
+			read_buffer_size = Stream_buffer_size;
+			#ifdef CTRL_STAT
+			printf("read_buffer_size = %d \n", read_buffer_size);
+			#endif
+		}
+		while (left+len>read_buffer_size) read_buffer_size <<= 1;
+		if (!(read_buffer = (byte *) realloc(read_buffer, read_buffer_size))) {
 			ERROR_LINE();
-			printf("Cannot allocate read_buffer.\n");
+			printf("Cannot enlarge read_buffer.\n");
 			exit(ERROR_MEMORY);
 		}
 	}
-	#ifdef CTRL_STAT
-	printf("read_buffer_size = %d \n", read_buffer_size);
-	#endif
+	read_buffer_ptr = read_buffer;
+	read_buffer_end = read_buffer + left;
+	memcpy((void *) read_buffer_end, (void *) data, len);
+
+	/* count the PSCs (at any bit position) ended in each byte */
+	for (; len>0; len--) {
+		PSC_window = (PSC_window << 8) | *(read_buffer_end++);
+		read_stream_bytes++;
+		for (s=0; s<8; s++)
+			if (((PSC_window >> s) & bits_enable_mask[PSC_LENGTH-1])
+					== PSC) {
+				PSC_count++;
+				PSC_end = read_stream_bytes;
+			}
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		push_read_stream_in_place()
+ *	Description:	read the whole stream from the bytes of the caller
+ *			(e.g. a mapped file) without copying them: the bit
+ *			reader works directly on them, and EOF is at their
+ *			end
+ *	Input:		pointer to the bytes (kept by the caller until
+ *			close_read_stream()) and # of bytes
+ *	Return:		none
+ *	Side effects:	read_buffer is the bytes, and no more bytes can be
+ *			pushed
+ *
+ *************************************************************************/
+void push_read_stream_in_place(byte *data, int32 len)
+{
+	DEBUG("push_read_stream_in_place");
+
+	if (read_buffer) {
+		ERROR_LINE();
+		printf("Cannot read in place after the bytes pushed.\n");
+		exit(ERROR_OTHERS);
+	}
+
+	read_in_place = TRUE;
+	read_buffer = read_buffer_ptr = data;
+	read_buffer_end = data + len;
+	read_buffer_size = read_stream_bytes = len;
+
+	/* no PSCs to be counted: the whole stream is here */
+	read_ended = TRUE;
+}
+
+/*************************************************************************
+ *
+ *	Name:		PSC_in_read_stream()
+ *	Description:	check if the n-th PSC of the read stream (with the
+ *			picture header after it) has been pushed, i.e. the
+ *			frames before it can be read
+ *	Input:		n (1: the first PSC)
+ *	Return:		TRUE if pushed (or the end of the stream has been
+ *			pushed), FALSE if more bytes are needed
+ *	Side effects:
+ *
+ *************************************************************************/
+boolean PSC_in_read_stream(int32 n)
+{
+	DEBUG("PSC_in_read_stream");
 
-	/* initialize read_buffer */
-	read_buffer_ptr = read_buffer_end - 1;
-	read_position = -1;
+	if (read_ended || (PSC_count>n)) return TRUE;
+	return (((PSC_count==n) && (read_stream_bytes-PSC_end>=PSC_TAIL_BYTES))
+		? TRUE : FALSE);
 }
 
 /*************************************************************************
  *
  *	Name:		close_read_stream()
- *	Description:	close bitstream file for read
+ *	Description:	close the bitstream for read
  *	Input:		none
  *	Return:		none
- *	Side effects:	free memory for write_buffer
+ *	Side effects:	free memory for read_buffer (but not the bytes of
+ *			the caller read in place)
  *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Tainwan
  *
  *************************************************************************/
@@ -440,66 +1684,68 @@ void close_read_stream(void)
 {
 	DEBUG("close_read_stream");
 
-	fclose(read_stream);
-	free(read_buffer);
+	if (!read_in_place) free(read_buffer);
+	read_buffer = NULL;
 }
 
 /*************************************************************************
  *
- *	Name:		get_bit()
- *	Description:	get 1 bit from bitstream file for read
+ *	Name:		fill_read_cache()
+ *	Description:	fill read_cache up to at least 32 bits from
+ *			read_buffer, a word (32 bits) at a time
  *	Input:		none
- *	Return:         the bit ('1' or '0') in one byte
- *	Side effects:	read_position and read_buffer_ptr will be updated
- *	Date: 96/04/24	Author: Chu Ching-Wen in N.T.H.U., Tainwan
+ *	Return:         the number of bits in read_cache, which may be
+ *			less than 32 at EOF (and '0's are filled)
+ *	Side effects:	read_cache, read_cache_bits and read_buffer_ptr will
+ *			be updated
  *
  *************************************************************************/
-int16 get_bit(void)
+int16 fill_read_cache(void)
 {
-	DEBUG("get_bit");
-
-	if (read_position < 0) {
-		if ((++read_buffer_ptr)==read_buffer_end) {
-			/* out of data in read_buffer */
-			/* fill data into read_buffer */
-			read_buffer_size = fread((void *) read_buffer,
-				sizeof(byte), read_buffer_size, read_stream);
-			if (read_buffer_size==0) {
-				ERROR_LINE();
-				printf("EOF at wrong place in read_stream!\n");
-				exit(ERROR_EOF);
-			}
+	DEBUG("fill_read_cache");
 
-			read_buffer_ptr = read_buffer;
-			read_buffer_end = read_buffer + read_buffer_size;
+	while (read_cache_bits<=32) {
+		if (read_buffer_ptr+4<=read_buffer_end) {
+			/* a word (big-endian) at a time */
+			read_cache |= ((bytes8) (((bytes4) read_buffer_ptr[0]<<24)
+				| ((bytes4) read_buffer_ptr[1]<<16)
+				| ((bytes4) read_buffer_ptr[2]<<8)
+				| (bytes4) read_buffer_ptr[3])
+				<< (32 - read_cache_bits));
+			read_buffer_ptr += 4;
+			read_cache_bits += 32;
+		} else if (read_buffer_ptr<read_buffer_end) {
+			/* the tail of read_buffer: a byte at a time */
+			read_cache |= ((bytes8) *(read_buffer_ptr++)
+				<< (56 - read_cache_bits));
+			read_cache_bits += 8;
+		} else {
+			/* out of the bytes pushed */
+			break;
 		}
-		read_position = 7;
 	}
 
-	return ((*read_buffer_ptr) & ((int16) bit_set_mask[read_position--])
-		? 1 : 0);
+	return read_cache_bits;
 }
 
 /*************************************************************************
  *
- *	Name:		get_n_bits()
- *	Description:	get n bits from bitstream file for read
+ *	Name:		eof_read_error()
+ *	Description:	stop decoding when we have read beyond EOF
+ *			(called by skip_bits() in bitstream.h)
  *	Input:		none
- *	Return:         the n bits (1/0 bitstream) in one word
- *	Side effects:	read_position and read_buffer_ptr will be updated
- *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Tainwan
+ *	Return:         none (never returns)
+ *	Side effects:	exit
  *
  *************************************************************************/
-int32 get_n_bits(int16 n)
+int16 eof_read_error(void)
 {
-	DEBUG("get_n_bits");
-	int32 word = 0;
+	DEBUG("eof_read_error");
 
-	while (n--) {
-		word <<= 1;
-		if (get_bit())	word |= 0x1;
-	}
-	return word;
+	ERROR_LINE();
+	printf("EOF at wrong place in read_stream!\n");
+	exit(ERROR_EOF);
+	return 0;
 }
 
 /*************************************************************************
@@ -516,9 +1762,10 @@ int32 ftell_read_stream(void)
 {
 	DEBUG("ftell_read_stream");
 
-	return ((( ftell(read_stream) -
-		  (read_buffer_end-read_buffer_ptr) ) << 3)
-		+ (7 - read_position));
+	/* bits pushed - bits left in read_buffer - bits in read_cache */
+	return (((read_stream_bytes -
+		  (int32) (read_buffer_end-read_buffer_ptr) ) << 3)
+		- read_cache_bits);
 }
 
 /*************************************************************************
@@ -535,15 +1782,12 @@ int32 ftell_read_stream(void)
 boolean eof_read_stream(void)
 {
 	DEBUG("eof_read_stream");
-	boolean eof;
-	byte s[1];
-
-	/* if read_buffer not empty => not EOF */
-	if (read_buffer_ptr+1<read_buffer_end) return FALSE;
 
-	eof = ((fread((void *)s, 1, 1, read_stream)==0) ? TRUE : FALSE);
-	if (!eof) fseek(read_stream, -1, SEEK_CUR);
+	/* if a whole byte is left in read_cache or read_buffer => not EOF */
+	if (read_cache_bits>=8) return FALSE;
+	if (read_buffer_ptr<read_buffer_end) return FALSE;
 
-	return eof;
+	/* all bytes pushed have been read */
+	return TRUE;
 }
 
@@ -0,0 +1,1582 @@
+/*************************************************************************
+ *
+ *	Name:		libh261.c
+ *	Description:	H.261 encoder/decoder sessions: each session keeps
+ *			the state of its stream in an H261_CONTEXT, so that
+ *			many streams can be coded in one process
+ *
+ *************************************************************************/
+
+#include "globals.h"
+#include "ctrl.h"	/* codec controls: statistics, get time... */
+#include "mytime.h"     /* TIME-type variables definition & function */
+#include "thresh.h"	/* threshold values definition */
+#include <pthread.h>	/* pthread_once() for H261_init() */
+
+/*************************************************************************/
+/* public */
+extern void H261_default_param(H261_PARAM *param);
+extern void H261_bind(H261_CONTEXT *ctx);
+extern H261_CONTEXT *H261_encoder_create(H261_PARAM *param);
+extern FSTORE *H261_load_frame(H261_CONTEXT *enc, int32 frame_ID);
+extern FSTORE *H261_encode_frame(H261_CONTEXT *enc, FSTORE *fs,
+	int32 frame_ID);
+extern void H261_encoder_flush(H261_CONTEXT *enc, int32 end_frame_ID);
+extern void H261_encoder_destroy(H261_CONTEXT *enc);
+extern H261_CONTEXT *H261_decoder_create(H261_PARAM *param);
+extern void H261_decoder_push_bits(H261_CONTEXT *dec, byte *data, int32 len);
+extern void H261_decoder_push_bits_in_place(H261_CONTEXT *dec, byte *data,
+	int32 len);
+extern FSTORE *H261_decoder_get_frame(H261_CONTEXT *dec, int32 *frame_ID);
+extern void H261_decoder_destroy(H261_CONTEXT *dec);
+
+/* the session bound to this thread (see context.h) */
+THREAD_LOCAL H261_CONTEXT *Ctx = NULL;
+
+/*************************************************************************/
+/* coding control (according to MTYPE) (TABLE 2/H.261) */
+boolean MQUANT_used[] = {0,1,0,1,0,0,1,0,0,1,0};/* Quantization used */
+boolean MVD_used[] =    {0,0,0,0,1,1,1,1,1,1,0};/* Motion Vector Data used */
+boolean CBP_used[] =    {0,0,1,1,0,1,1,0,1,1,0};/* CBP used in coding */
+boolean TCOEFF_used[] = {1,1,1,1,0,1,1,0,1,1,0};/* Transform coeff. coded */
+boolean Intra_used[] =  {1,1,0,0,0,0,0,0,0,0,0};/* Intra coded macroblock */
+boolean Filter_used[] = {0,0,0,0,0,0,0,1,1,1,0};/* Filter flags */
+
+/*************************************************************************/
+/* the state within a call (of this thread) */
+THREAD_LOCAL int16 Current_B = 0;	/* Current Block ID */
+THREAD_LOCAL int16 Current_MB = 0;	/* Current MB ID */
+THREAD_LOCAL int16 Current_GOB = 0;	/* Current GOB ID (1st: 0 => differ from GN) */
+
+/* last MB's info. (for checking to use DPCM or not) */
+THREAD_LOCAL int16 Last_MVDH = 0;
+THREAD_LOCAL int16 Last_MVDV = 0;
+THREAD_LOCAL int16 Last_MTYPE = 0;
+
+/*************************************************************************/
+/* the GOBs of a P-frame are coded in parallel by the workers of ME, but
+ * the statistics of MTYPEs, header bits and all times are not kept apart
+ * for the GOBs */
+#if defined(CTRL_GOB_THREAD) && ((!defined(CTRL_ME_THREAD)) || \
+	defined(CTRL_STAT_MTYPE) || defined(CTRL_HEADER_BITS) || \
+	(CTRL_GET_TIME==GET_ALL_TIME))
+#undef CTRL_GOB_THREAD
+#endif
+
+/*************************************************************************/
+/* private */
+static pthread_once_t H261_once = PTHREAD_ONCE_INIT;
+static void H261_init(void);
+static H261_CONTEXT *make_context(H261_PARAM *param, boolean decoder);
+static void free_context(void);
+/* H.261 encoder */
+static int16 obtain_GQUANT(int32 GQUANT, int32 remainder_size);
+static void encode_I_frame(void);
+static void encode_P_frame(void);
+static void encode_P_GOB(int16 GOB);
+#ifdef CTRL_GOB_THREAD
+static void encode_P_GOB_apart(int16 GOB);
+#endif
+static void set_frame_views(void);
+static void encode_intra_MB(void);
+static void encode_inter_MB(void);
+static void write_inter_MB(void);
+/* H.261 decoder */
+static void decode_frame(void);
+static void decode_MB(void);
+/* shared functions for encoder and decoder */
+static void set_image_type(void);
+
+/*************************************************************************/
+/* block type defition {Y1, Y2, Y3, Y4, Cb, Cr} */
+static ComponentType Block_type[]
+		= {_Y, _Y, _Y, _Y, _Cb, _Cr};	/* for each block in a MB */
+
+/*************************************************************************/
+/* CCITT p*64 header info. (H.261 sec.4) of the bound session */
+#define pic_header	(Ctx->pic_header)	/* defined in globals.h */
+#define gob_header	(Ctx->gob_header)	/* defined in globals.h */
+/* MB header is used within a MB (of this thread) */
+static THREAD_LOCAL MB_HEADER MB_header;
+#define mb_header	(&MB_header)		/* defined in globals.h */
+
+/* very-often-used variables in header (of this thread) */
+static THREAD_LOCAL int16 MTYPE;	/* Macro-block TYPE */
+static THREAD_LOCAL int16 MVDH;	/* Motion Vector Data for Horizontal offset */
+static THREAD_LOCAL int16 MVDV;	/* Motion Vector Data for Vertical offset */
+static THREAD_LOCAL int16 Last_MB;	/* for obtaining MBA */
+
+/*************************************************************************/
+/* temporary integer storage for block operation (e.g. DCT, quantization) */
+static THREAD_LOCAL int16 MBbuf[6][64];	/* buffers of macroclock (6 blocks) */
+
+/*************************************************************************/
+/* the frame stores in encoder of this thread: own copies of the MEMs of
+ * ori_frame, rec_frame and ref_frame (for their memloc), so that the GOBs
+ * can be coded in parallel (see set_frame_views()) */
+static THREAD_LOCAL MEM View_mem[3][NUMBER_OF_COMPONENTS];
+static THREAD_LOCAL FSTORE Ori_view, Rec_view, Ref_view;
+#define ori_view	(&Ori_view)
+#define rec_view	(&Rec_view)
+#define ref_view	(&Ref_view)
+
+/*************************************************************************/
+/* for rate control in encoder (by changing GQUANT) of the bound session */
+#define bits_per_frame	(Ctx->bits_per_frame)
+#define buffer_size	(Ctx->buffer_size)
+#define target_bits	(Ctx->target_bits)
+
+/* the progress of the bound session */
+#define coded_frames	(Ctx->coded_frames)
+#define first_TR	(Ctx->first_TR)
+#define end_of_stream	(Ctx->end_of_stream)
+
+/*************************************************************************/
+/* use_DCT_blocks() */
+/* 2D DCT kernel (dct.c) of n blocks one after the other (the 6 blocks of
+ * MBbuf), chosen by init_DCT() (the IDCT of TCOEFFs is by sparse_IDCT()) */
+extern void (*default_DCT_blocks)(int16 *, int16 *, int16);
+#define use_DCT_blocks (*default_DCT_blocks)
+
+/*************************************************************************/
+/* different motion-estimation algo. and matching metric (by the codes
+ * FULL_SEARCH, ..., SEA_SEARCH and SUB64_METRIC, ..., SATD_METRIC) */
+static int16 (*me_algo[])(MEM *, MEM *) = {
+	full_search_ME, three_step_search_ME, new_three_step_search_ME,
+	my_search_ME, pyramid_search_ME, EPZS_search_ME,
+	diamond_search_ME, hexagon_search_ME, SEA_search_ME
+};
+static char *me_algo_name[] = {	/* for statistics */
+	"full_search", "three_step_search", "new_three_step_search",
+	"my_search", "pyramid_search", "EPZS_search",
+	"diamond_search", "hexagon_search", "SEA_search"
+};
+static int16 (*me_metric[])(MEM *, MEM *, int16) = {
+	sub64_metric, SAD_metric, SATD_metric
+};
+#define NUMBER_OF_ME_ALGOS (sizeof(me_algo) / sizeof(me_algo[0]))
+#define NUMBER_OF_ME_METRICS (sizeof(me_metric) / sizeof(me_metric[0]))
+
+/*************************************************************************/
+/* for PTYPE and PSPARE */
+#define CIF_PTYPE 0x04		/* PTYPE pattern for image type CIF */
+/* in PSPARE: the left 4-bits indicates NTSC type */
+#define NTSC_PSPARE 0xf0	/* PSPARE pattern for image type NTSC */
+#define P64_NTSC_PSPARE 0x8c	/* PSPARE pattern for NTSC of p64 codec */
+
+/*************************************************************************/
+/* set mem->memloc to the right position by Current_GOB and Current_MB */
+#define SET_memloc(mem, Y_memloc, CbCr_memloc) {\
+		mem->fs[_Y]->memloc = Y_memloc;\
+		mem->fs[_Cb]->memloc = mem->fs[_Cr]->memloc = CbCr_memloc;\
+	}
+
+/*************************************************************************
+ *
+ *	Name:		H261_default_param()
+ *	Description:	set the default parameters of a session
+ *	Input:		the pointer to the parameters
+ *	Return:		none
+ *	Side effects:	entries of param will be changed (but param->image)
+ *
+ *************************************************************************/
+void H261_default_param(H261_PARAM *param)
+{
+	DEBUG("H261_default_param");
+
+	param->start_frame = 0;
+	param->end_frame = 999;
+	param->frame_skip = 1;
+
+	/* default bits_per_frame is under 64k bits/sec (bps), 15 frames/sec (fps) */
+	param->bit_rate = 64000.0;
+	param->frame_rate = 15.0;
+	param->bit_per_pixel = 0.0;
+
+	param->stream_buffer_size = STREAM_BUFFER_SIZE;
+	param->read_ahead = READ_AHEAD;
+	param->me_algo = THREE_STEP_SEARCH;
+	param->me_metric = SUB64_METRIC;
+	param->me_threads = 1;
+	param->me_ahead = 0;
+	param->me_open_loop = FALSE;
+}
+
+/*************************************************************************
+ *
+ *	Name:		H261_bind()
+ *	Description:	bind a session to the running thread: Image,
+ *			rec_frame, ... refer to the session after it
+ *	Input:		the session
+ *	Return:		none
+ *	Side effects:	Ctx will be changed
+ *
+ *************************************************************************/
+void H261_bind(H261_CONTEXT *ctx)
+{
+	DEBUG("H261_bind");
+
+	Ctx = ctx;
+}
+
+/*************************************************************************
+ *
+ *	Name:		H261_init()
+ *	Description:	build the tables shared by all sessions (once per
+ *			process, see pthread_once())
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	the VLC/VLD tables and the SAD and DCT kernels
+ *			will be set
+ *
+ *************************************************************************/
+static void H261_init(void)
+{
+	DEBUG("H261_init");
+
+	init_VLC();
+	init_VLD();
+	init_SAD();
+	init_DCT();
+
+	#ifdef CTRL_GET_TIME
+	tTIME_COST = get_time_cost();
+	#endif
+}
+
+/*************************************************************************
+ *
+ *	Name:		make_context()
+ *	Description:	make a session by the parameters, and bind it to
+ *			the running thread
+ *	Input:		the parameters, and boolean to indicate a decoder
+ *	Return:		the session
+ *	Side effects:	exit while error occurs
+ *
+ *************************************************************************/
+static H261_CONTEXT *make_context(H261_PARAM *param, boolean decoder)
+{
+	DEBUG("make_context");
+	H261_CONTEXT *ctx;
+
+	pthread_once(&H261_once, H261_init);
+
+	if (!(ctx = (H261_CONTEXT *) malloc(sizeof(H261_CONTEXT)))) {
+		ERROR_LINE();
+		printf("Cannot allocate the context of a session.\n");
+		exit(ERROR_MEMORY);
+	}
+	memset((void *) ctx, 0, sizeof(H261_CONTEXT));
+	H261_bind(ctx);
+
+	Ctx->decoder = decoder;
+	Image = param->image;
+	Start_frame = param->start_frame;
+	End_frame = param->end_frame;
+	Frame_skip = param->frame_skip;
+	Bit_rate = param->bit_rate;
+	Frame_rate = param->frame_rate;
+	Stream_buffer_size = param->stream_buffer_size;
+	Read_ahead = param->read_ahead;
+	ME_threads = param->me_threads;
+	ME_ahead = param->me_ahead;
+	ME_open_loop = (param->me_open_loop || (ME_ahead>0));
+
+	MAKE_STRUCTURE(pic_header, PIC_HEADER);
+	MAKE_STRUCTURE(gob_header, GOB_HEADER);
+
+	pic_header->PTYPE =	pic_header->PEI = pic_header->PSPARE =
+	gob_header->GEI = gob_header->GSPARE = 0;
+
+	/* motion-estimation algo. and matching metric */
+	if ((param->me_algo<0) || (param->me_algo>=NUMBER_OF_ME_ALGOS)) {
+		ERROR_LINE();
+		printf("Unknown motion estimation algorithm: %d\n",
+			param->me_algo);
+		exit(ERROR_ARGV);
+	}
+	if ((param->me_metric<0) || (param->me_metric>=NUMBER_OF_ME_METRICS)) {
+		ERROR_LINE();
+		printf("Unknown matching metric of ME: %d\n",
+			param->me_metric);
+		exit(ERROR_ARGV);
+	}
+	default_me_algo = me_algo[param->me_algo];
+	ME_algo_name = me_algo_name[param->me_algo];
+	default_me_metric = me_metric[param->me_metric];
+
+	make_IO_state();
+	if (!decoder) make_ME_state();
+
+	return ctx;
+}
+
+/*************************************************************************
+ *
+ *	Name:		free_context()
+ *	Description:	free the bound session (its states have been freed)
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	Ctx will be NULL
+ *
+ *************************************************************************/
+static void free_context(void)
+{
+	DEBUG("free_context");
+	int16 i;
+
+	for (i=0; i<12; i++) free(Ctx->GOB_bits[i].data);
+	free(pic_header);
+	free(gob_header);
+	free(Ctx);
+	Ctx = NULL;
+}
+
+/*************************************************************************
+ *
+ *	Name:		H261_encoder_create()
+ *	Description:	make an encoder session, and open its bitstream
+ *			(param->image->Stream_filename)
+ *	Input:		the parameters
+ *	Return:		the session (bound to the running thread)
+ *	Side effects:	exit while error occurs
+ *
+ *************************************************************************/
+H261_CONTEXT *H261_encoder_create(H261_PARAM *param)
+{
+	DEBUG("H261_encoder_create");
+	H261_CONTEXT *enc;
+
+	enc = make_context(param, FALSE);
+
+	/* set image type : PTYPE */
+	switch (Image->type) {
+	case _NTSC:		/* NTSC */
+		pic_header->PTYPE |= CIF_PTYPE;
+
+		/* Since NTSC type is not included in H.261 standard */
+		/* so we need to add extra info. here for decoder use. */
+		pic_header->PEI = 1;
+		pic_header->PSPARE |= NTSC_PSPARE;
+		break;
+	case _CIF:		/* CIF */
+		pic_header->PTYPE |= CIF_PTYPE;
+		break;
+	case _QCIF:		/* QCIF */
+		pic_header->PTYPE |= 0x00;
+		break;
+	default:
+		ERROR_LINE();
+		printf("Image Type not supported: %d\n", Image->type);
+		exit(ERROR_ARGV);
+	}
+
+	Number_frame = End_frame - Start_frame + 1;
+	if (Number_frame<=0) {
+		ERROR_LINE();
+		printf("Need positive number of frames.\n");
+		exit(ERROR_ARGV);
+	}
+
+	/* make frame store after we have set image type */
+	set_image_type();
+	alloc_mem_encoder();
+	open_write_stream(Image->Stream_filename);
+
+	/* set rate control parameter */
+	if (param->bit_per_pixel!=0.0) {
+		/* [-p] (bit/pixel) override [-r] (kbits/sec) */
+		Bit_rate = Frame_rate * param->bit_per_pixel
+			* Image->Width * Image->Height;
+	}
+	bits_per_frame = (int32) (Frame_skip * Bit_rate / Frame_rate);
+
+	/* motion-estimate the frames (ahead) against the originals by the
+	 * ME stage */
+	if (ME_open_loop) make_pipe_state();
+
+	return enc;
+}
+
+/*************************************************************************
+ *
+ *	Name:		H261_load_frame()
+ *	Description:	get a frame to be encoded from the frame loader
+ *			(see start_frame_loader()), through the pipeline
+ *			of the session if ME is pipelined
+ *	Input:		the session and the frame ID
+ *	Return:		the frame (valid till the next call), or NULL if
+ *			no such frame
+ *	Side effects:	the session will be bound to the running thread
+ *
+ *************************************************************************/
+FSTORE *H261_load_frame(H261_CONTEXT *enc, int32 frame_ID)
+{
+	DEBUG("H261_load_frame");
+
+	H261_bind(enc);
+	if (Ctx->Pipe_state) return pipe_load_frame(frame_ID);
+	return load_frame(frame_ID);
+}
+
+/*************************************************************************
+ *
+ *	Name:		H261_encode_frame()
+ *	Description:	encode a frame (the 1st one is an I-frame)
+ *	Input:		the session, the frame and its frame ID
+ *	Return:		the reconstructed frame (kept by the session till
+ *			the next call)
+ *	Side effects:	the session will be bound to the running thread
+ *
+ *************************************************************************/
+FSTORE *H261_encode_frame(H261_CONTEXT *enc, FSTORE *fs, int32 frame_ID)
+{
+	DEBUG("H261_encode_frame");
+
+	H261_bind(enc);
+	ori_frame = fs;
+	Current_frame = frame_ID;
+
+	if (coded_frames==0) {
+		/* print encoder info before processing the 1st frame */
+		print_codec_info(FALSE);
+
+		/* the 1st frame must be I-frame */
+		/* save the reconstructed (coded) frame in rec_frame */
+		encode_I_frame();
+		First_frame_bits = ftell_write_stream();
+
+		buffer_size = bits_per_frame << 4;
+		target_bits = First_frame_bits;	/* exculding the 1st frame */
+	} else {
+		/* set timer to obtain total time */
+		#ifdef CTRL_GET_TIME
+		get_time(tTOTAL1);
+		#endif
+
+		/* save the reconstructed frame in rec_frame */
+		#ifdef CTRL_ALL_INTRA
+		encode_I_frame();
+		#else	/* not CTRL_ALL_INTRA */
+		encode_P_frame();
+		#endif
+
+		/* total time excludes I/O time */
+		#ifdef CTRL_GET_TIME
+		get_time(tTOTAL2);
+		ntTOTAL++;
+		tTOTAL += diff_time(tTOTAL2, tTOTAL1);
+		#endif
+	}
+	coded_frames++;
+
+	#ifdef CTRL_PSNR
+	statistics(ori_frame, rec_frame);
+	#endif
+	#ifdef CTRL_FRAME_INFO
+	print_frame_info(Current_frame);
+	printf("\tGQUANT = %d\n", gob_header->GQUANT);
+	#endif
+
+	if (coded_frames>1) {
+		/* change GQUANT by current buffer remains */
+		target_bits += bits_per_frame;
+		gob_header->GQUANT = obtain_GQUANT(gob_header->GQUANT,
+			target_bits - ftell_write_stream());
+	}
+
+	return rec_frame;
+}
+
+/*************************************************************************
+ *
+ *	Name:		H261_encoder_flush()
+ *	Description:	end the bitstream of an encoder session, and print
+ *			the info. of the sequence
+ *	Input:		the session and the last frame ID
+ *	Return:		none
+ *	Side effects:	the bitstream will be closed
+ *
+ *************************************************************************/
+void H261_encoder_flush(H261_CONTEXT *enc, int32 end_frame_ID)
+{
+	DEBUG("H261_encoder_flush");
+
+	H261_bind(enc);
+	End_frame = end_frame_ID;
+	Number_frame = End_frame - Start_frame + 1;
+
+	/* use a extra frame-header as EOF-code */
+	pic_header->TR = MOD_32(End_frame);
+	write_frame_header(pic_header);
+
+	Total_bits = ftell_write_stream();
+
+	/* stop the ME stage (and get its statistics) */
+	free_pipe_state();
+
+	/* we always print info. for the last frame */
+	print_sequence_info(FALSE);
+	close_write_stream();
+}
+
+/*************************************************************************
+ *
+ *	Name:		H261_encoder_destroy()
+ *	Description:	free an encoder session
+ *	Input:		the session
+ *	Return:		none
+ *	Side effects:	the worker threads of the session will be stopped
+ *
+ *************************************************************************/
+void H261_encoder_destroy(H261_CONTEXT *enc)
+{
+	DEBUG("H261_encoder_destroy");
+
+	H261_bind(enc);
+	free_pipe_state();
+	free_ME_state();
+	free_IO_state();
+	free_mem_encoder();
+	free_context();
+}
+
+/*************************************************************************
+ *
+ *	Name:	       	obtain_GQUANT()
+ *	Description:	obtain GQUANT by quantizer and remainder_size
+ *	Input:         	GQUANT is the present GQUANT, and 
+ *			remainder_size insicates the remaiander size of the
+ *  			buffer
+ *	Return:	       	the quantizer (GQUNAT)
+ *	Side effects:	none
+ *	Date: 97/12/05	Author: Chu Ching-Wen in N.T.H.U., Taiwan
+ *
+ *************************************************************************/
+static int16 obtain_GQUANT(int32 GQUANT, int32 remainder_size)
+{
+	DEBUG("obtain_GQUANT");
+    
+    float delta,temp;
+
+	/* MODIFY CODES HERE */
+ 
+	delta = (float) (buffer_size-remainder_size) / buffer_size;
+	//printf("buffer_size = %ld,\t\t remainder_size = %ld\n", buffer_size, remainder_size);
+	printf("delta=%f\t\t",delta);
+    if (delta<0)           delta=0;
+     else if (delta>1)   delta=1;
+    temp = (float)(31*delta);
+	printf("GQUANT = %2ld --> ", GQUANT);
+	GQUANT=ceil(temp);
+	printf("%2ld\n", GQUANT);
+
+	/* buffer is under-flow of toleratable range (buffer_size) ? */
+	if (remainder_size>=buffer_size) {
+		/* => we can produce more bits for the next frame */
+		/* we should decrease GQUANT..... */
+		printf("Buffer is underflow ! (%ld)\n", remainder_size);
+	} else 
+	/* buffer is over-flow of toleratable range (buffer_size) ? */
+	if (-remainder_size>=buffer_size) {
+		/* => we should produce less bits for the next frame */
+		/* we should increase GQUANT..... */
+		printf("Buffer is overflow ! (%ld)\n", remainder_size);
+	}
+	return GQUANT;
+}
+
+/*************************************************************************
+ *
+ *	Name:	       	encode_I_frame()
+ *	Description:	encode a single intra frame (all MBs are intra)
+ *	Input:          none
+ *	Return:	       	none
+ *	Side effects:   entries of rec_frame will be changed
+ *	Date: 96/04/29	Author: Chu Ching-Wen in N.T.H.U., Taiwan
+ *
+ *************************************************************************/
+static void encode_I_frame(void)
+{
+	DEBUG("encode_I_frame");
+	int32 YGOB_memloc1, GOB_memloc1;
+	int32 Y_memloc, CbCr_memloc;
+
+	/* write picture header (PSC TR PTYPE [PEI PSPARE])*/
+	pic_header->TR = MOD_32(Current_frame);
+	write_frame_header(pic_header);
+
+	memset(MTYPE_frame, INTRA, Size_frame);
+	memset(MVDH_frame, 0, Size_frame);
+	memset(MVDV_frame, 0, Size_frame);
+	memset(Last_update, 0, Size_frame);
+	MTYPE = INTRA;
+
+	/* quantization stepsize for intra is unchanged for each blocks */
+	gob_header->GQUANT = DEFAULT_QUANTIZER;
+
+	set_frame_views();
+
+	/* start to encode each GOB ... */
+	for (Current_GOB=0; Current_GOB<Number_GOB; Current_GOB++) {
+		/* write GOB header (GBSC GN GQUANT [GEI GSPARE]) */
+		/* get gob_header->GN */
+		gob_header->GN = ((Image->type==_QCIF) ?
+				((Current_GOB<<1) + 1) : (Current_GOB + 1));
+		write_GOB_header(gob_header);
+
+		YGOB_memloc1 = YGOB_memloc[Current_GOB];
+		GOB_memloc1 = GOB_memloc[Current_GOB];
+
+		/* start to encode each MB ... */
+		Last_MB = -1;
+		for (Current_MB=0; Current_MB<Number_MB; Current_MB++
+				#ifdef CTRL_STAT_MTYPE
+				, MTYPE_count[MTYPE]++
+				#endif
+				) {
+			/* get the memory location of current MB
+			 * consult FIGURE 6, 8/H.261,
+			 * set memloc in ori_frame->fs and rec_frame->fs */
+			Y_memloc = YGOB_memloc1 + YMB_memloc[Current_MB];
+			CbCr_memloc = GOB_memloc1 + MB_memloc[Current_MB];
+
+			SET_memloc(ori_view, Y_memloc, CbCr_memloc);
+
+			/* current MB --> encoder --> decoder : for next frame */
+			SET_memloc(rec_view, Y_memloc, CbCr_memloc);
+
+			/* read current MB from ori_frame to MBbuf
+			 * for "block operation" (DCT etc.) */
+			read_MB(MBbuf, ori_view);
+
+			encode_intra_MB();
+		}/* end of one MB */
+	}/* end of one GOB */
+
+	/* replicate the edges into the borders for the next frame */
+	extend_FS(rec_frame);
+}
+
+/*************************************************************************
+ *
+ *	Name:	       	encode_P_frame()
+ *	Description:	encode a single inter frame using motion estimation
+ *			(the last reconstructed frame becomes ref_frame,
+ *			and is not changed in the frame)
+ *	Input:          none
+ *	Return:	       	none
+ *	Side effects:   rec_frame and ref_frame are swapped, and entries
+ *			of rec_frame will be changed
+ *	Date: 96/04/29	Author: Chu Ching-Wen in N.T.H.U., Taiwan
+ *
+ *************************************************************************/
+static void encode_P_frame(void)
+{
+	DEBUG("encode_P_frame");
+	int16 i;
+	FSTORE *fs;
+
+	/* write picture header (PSC TR PTYPE [PEI PSPARE])*/
+	pic_header->TR = MOD_32(Current_frame);
+	write_frame_header(pic_header);
+
+	/* reconstruct into the other frame store, so that the reference
+	 * is never overwritten by the MBs coded before */
+	fs = ref_frame;
+	ref_frame = rec_frame;
+	rec_frame = fs;
+
+	/* by the ME stage (against the original frame before) if ME is
+	 * pipelined */
+	if (Ctx->Pipe_state) piped_motion_estimation();
+	else motion_estimation();
+
+	/* start to encode each GOB ... */
+	#ifdef CTRL_GOB_THREAD
+	if (ME_threads>1) {
+		/* each GOB is coded into its own bits by the workers
+		 * (the reference is not changed in the frame, and each GOB
+		 * restarts the MV prediction), then the bits are appended
+		 * in the order of GN */
+		run_worker_tasks(Number_GOB, encode_P_GOB_apart);
+		for (i=0; i<Number_GOB; i++)
+			append_write_stream(&Ctx->GOB_bits[i]);
+	} else
+	#endif
+	for (i=0; i<Number_GOB; i++) encode_P_GOB(i);
+
+	/* replicate the edges into the borders for the next frame */
+	extend_FS(rec_frame);
+}
+
+/*************************************************************************
+ *
+ *	Name:	       	encode_P_GOB()
+ *	Description:	encode a GOB of an inter frame by the MTYPEs and
+ *			MVs of motion estimation
+ *	Input:          the GOB (Current_GOB)
+ *	Return:	       	none
+ *	Side effects:   the MBs of the GOB in rec_frame will be changed
+ *
+ *************************************************************************/
+static void encode_P_GOB(int16 GOB)
+{
+	DEBUG("encode_P_GOB");
+	int16 nMB;
+	int32 YGOB_memloc1, GOB_memloc1;
+	int32 cur_Y_memloc, cur_CbCr_memloc;
+	int32 ref_Y_memloc, ref_CbCr_memloc;
+	GOB_HEADER header;
+
+	Current_GOB = GOB;
+	nMB = Current_GOB * Number_MB;
+	set_frame_views();
+	Last_MTYPE = Last_MVDH = Last_MVDV = 0;
+
+	/* write GOB header (GBSC GN GQUANT [GEI GSPARE]) */
+	/* get GN (GQUANT of the frame is in gob_header) */
+	header = *gob_header;
+	header.GN = ((Image->type==_QCIF) ?
+			((Current_GOB<<1) + 1) : (Current_GOB + 1));
+	write_GOB_header(&header);
+
+	YGOB_memloc1 = YGOB_memloc[Current_GOB];
+	GOB_memloc1 = GOB_memloc[Current_GOB];
+
+	/* start to encode each MB ... */
+	Last_MB = -1;
+	for (Current_MB=0; Current_MB<Number_MB; Current_MB++,nMB++
+			#ifdef CTRL_STAT_MTYPE
+			, MTYPE_count[MTYPE]++
+			#endif
+			) {
+		/* ME for superblock between Y_frame and MBbuf,
+		 * it defines MTYPE and MV (MVDH, MVDV)
+		 * NOTE: MTYPE may be changed according to CBP */
+		MTYPE = MTYPE_frame[nMB];
+
+		cur_Y_memloc = ref_Y_memloc
+			= YGOB_memloc1 + YMB_memloc[Current_MB];
+		cur_CbCr_memloc = ref_CbCr_memloc
+			= GOB_memloc1 + MB_memloc[Current_MB];
+
+		SET_memloc(rec_view, cur_Y_memloc, cur_CbCr_memloc);
+		SET_memloc(ref_view, ref_Y_memloc, ref_CbCr_memloc);
+
+		/* We first skip backgrond MB... not trans. */
+		if (MTYPE==MB_NOT_TRANSMIT) {
+			/* no MV and no TCOEFF */
+			/* do not transmit current MB */
+			copy_MB(rec_view, ref_view);
+			continue;
+		}
+
+		SET_memloc(ori_view, cur_Y_memloc, cur_CbCr_memloc);
+
+		/* read current MB from ori_frame to MBbuf
+		 * for "block operation" (DCT etc.) */
+		read_MB(MBbuf, ori_view);
+
+		/* process each block in current MB */
+
+		/* Intra */
+		if (Intra_used[MTYPE]) {
+			encode_intra_MB();
+			continue;
+		}
+
+		/* Inter */
+		if (MVD_used[MTYPE]) {
+			MVDH = mb_header->MVDH = MVDH_frame[nMB];
+			MVDV = mb_header->MVDV = MVDV_frame[nMB];
+
+			/* the reference frames
+			 * (ref_frame and Y_frame) may move (MVDH, MVDV) */
+			/* obtain memloc by current MV */
+			if (MVDV>=0) {
+				ref_Y_memloc +=
+				(YMVDV_memloc[MVDV] + MVDH);
+				ref_CbCr_memloc +=
+				(MVDV_memloc[MVDV] + (MVDH>>1));
+			} else {
+				ref_Y_memloc +=
+				(-YMVDV_memloc[-MVDV] + MVDH);
+				ref_CbCr_memloc +=
+				(-MVDV_memloc[-MVDV] + (MVDH>>1));
+			}
+		}
+
+		/* reference MB : for residual */
+		SET_memloc(ref_view, ref_Y_memloc, ref_CbCr_memloc);
+
+		if (TCOEFF_used[MTYPE]) {
+			/* MC with residual (TCOEFF) */
+
+			/* obtain CBP and coded-residual (TCOEFF) */
+			encode_inter_MB();
+
+			/* MTYPE may be changed to (without residual)
+			 * due to small enough coded-residual */
+			if (mb_header->CBP==0) {
+				/* TCOEFFs<CBP_THRESHOLD */
+				/* => do not use CBP and TCOEFF */
+				if (MVD_used[MTYPE]) {
+					MTYPE = INTER_MC;
+
+					#ifdef CTRL_STAT_MTYPE
+					nMTYPE_mc++;
+					#endif
+				} else {
+					MTYPE = MB_NOT_TRANSMIT;
+
+					#ifdef CTRL_STAT_MTYPE
+					nMTYPE_not++;
+					#endif
+
+					/* (no MV: ref_frame is at
+					 * current MB) */
+					copy_MB(rec_view, ref_view);
+					continue;
+				}
+			}
+		}
+
+		/* write out MB data */
+		/* at least need to trans. MB header */
+		/* MBA : current MacroBlock Address */
+		mb_header->MBA = Current_MB - Last_MB;
+		mb_header->MTYPE = MTYPE;
+		write_MB_header(Current_MB, mb_header);
+		Last_MB = Current_MB;
+
+		if (TCOEFF_used[MTYPE]) {
+			/* Inter with residual
+			 * (residual is not too small) */
+			write_inter_MB();
+		} else {
+			/* MC without residual */
+			/* write header only (with MV) */
+			/* MTYPE = 4 or 7 */
+			copy_MB(rec_view, ref_view);
+		}
+	}/* end of one MB */
+}
+
+#ifdef CTRL_GOB_THREAD
+/*************************************************************************
+ *
+ *	Name:	       	encode_P_GOB_apart()
+ *	Description:	encode a GOB of an inter frame into its own bits
+ *			(a task of run_worker_tasks())
+ *	Input:          the GOB
+ *	Return:	       	none
+ *	Side effects:   Ctx->GOB_bits[GOB] will be changed
+ *
+ *************************************************************************/
+static void encode_P_GOB_apart(int16 GOB)
+{
+	DEBUG("encode_P_GOB_apart");
+
+	redirect_write_stream(&Ctx->GOB_bits[GOB]);
+	encode_P_GOB(GOB);
+	redirect_write_stream(NULL);
+}
+#endif
+
+/*************************************************************************
+ *
+ *	Name:	       	set_frame_views()
+ *	Description:	copy the MEMs of the frame stores of the encoder to
+ *			this thread (ori_view, rec_view and ref_view)
+ *	Input:          none
+ *	Return:	       	none
+ *	Side effects:   View_mem will be changed
+ *
+ *************************************************************************/
+static void set_frame_views(void)
+{
+	DEBUG("set_frame_views");
+	int16 i;
+
+	for (i=0; i<NUMBER_OF_COMPONENTS; i++) {
+		View_mem[0][i] = *(ori_frame->fs[i]);
+		View_mem[1][i] = *(rec_frame->fs[i]);
+		View_mem[2][i] = *(ref_frame->fs[i]);
+		Ori_view.fs[i] = &View_mem[0][i];
+		Rec_view.fs[i] = &View_mem[1][i];
+		Ref_view.fs[i] = &View_mem[2][i];
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:	       	encode_intra_MB()
+ *	Description:	encode each block in current MB using intra type
+ *	Input:          none
+ *	Return:	       	none
+ *	Side effects:	entries of rec_frame will be changed
+ *	Date: 96/04/29	Author: Chu Ching-Wen in N.T.H.U., Taiwan
+ *
+ *************************************************************************/
+static void encode_intra_MB(void)
+{
+	DEBUG("encode_intra_MB");
+	int16 *block;
+	int16 last;	/* the last non-zero TCOEFF and the mask of them */
+	bytes8 mask;	/* (for sparse_IDCT()) */
+	ComponentType Btype;	/* for block type (= _Y, _U or _V) */
+
+	/* MBA : current MacroBlock Address */
+	mb_header->MBA = Current_MB - Last_MB;
+	mb_header->MTYPE = MTYPE;
+	write_MB_header(Current_MB, mb_header);
+	Last_MB = Current_MB;
+
+	/* the DCT of the 6 blocks of MBbuf[][] at once */
+	use_DCT_blocks(MBbuf[0], MBbuf[0], 6);
+
+	/* for each block data */
+	/* obtain TCOEFF */
+	for (Current_B=0; Current_B<6; Current_B++) {
+		Btype = Block_type[Current_B];
+		block = MBbuf[Current_B];
+
+		/* encode MBbuf[][] */
+		quantize(Intra_used[MTYPE], block, gob_header->GQUANT);
+		last = transfer_TCOEFF(1, block, &mask); /* 1 ==> Intra_used */
+
+		/* reconstruct block: */
+		/* a "small decoder" in the encoder */
+		Iquantize(Intra_used[MTYPE], block, gob_header->GQUANT);
+		sparse_IDCT(block, last, mask);
+		clip_reconstructed_block(block);
+
+		/* write out data to rec_frame for next frame's rec_frame */
+		write_block(rec_view->fs[Btype], block);
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:	       	encode_inter_MB()
+ *	Description:	encode each block's residual in current MB and obatin
+ *			the CBP (but MBbuf has NOT written to the bitstream)
+ *	Input:          none
+ *	Return:	       	none
+ *	Side effects:	entries of MBbuf and mb_header->CBP will be changed
+ *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
+ *
+ *************************************************************************/
+static void encode_inter_MB(void)
+{
+	DEBUG("encode_inter_MB");
+	int16 *block;
+	int16 CBPmask = 0x20; 	/* (10 0000) */
+	ComponentType Btype;	/* for block type (= _Y, _U or _V) */
+
+	/* load residual blocks into MBbuf[][] */
+	for (Current_B=0; Current_B<6; Current_B++) {
+		Btype = Block_type[Current_B];
+		load_residual(ref_view->fs[Btype], MBbuf[Current_B],
+				Filter_used[MTYPE]);
+	}
+
+	/* the DCT of the 6 blocks at once */
+	use_DCT_blocks(MBbuf[0], MBbuf[0], 6);
+
+	/* for each block data */
+	/* obtain CBP and TCOEFF */
+	for (mb_header->CBP=Current_B=0; Current_B<6; Current_B++,CBPmask>>=1) {
+		block = MBbuf[Current_B];
+
+		/* encode MBbuf[][] */
+		if (quantize(Intra_used[MTYPE], block, gob_header->GQUANT)) {
+			/* set current block into CBP */
+			mb_header->CBP |= CBPmask;
+		} 
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:	       	write_inter_MB()
+ *	Description:	write out the encoded-MB to the bitstream
+ *	Input:          none
+ *	Return:	       	none
+ *	Side effects:	entries of MBbuf and rec_frame will be changed
+ *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
+ *
+ *************************************************************************/
+static void write_inter_MB(void)
+{
+	DEBUG("write_inter_MB");
+	int16 *block;
+	int16 last;	/* the last non-zero TCOEFF and the mask of them */
+	bytes8 mask;	/* (for sparse_IDCT()) */
+	int16 CBPmask = 0x20;	/* (10 0000) */
+	ComponentType Btype;	/* for block type (= _Y, _U or _V) */
+
+	/* for each block data */
+	for (Current_B=0; Current_B<6; Current_B++,CBPmask>>=1) {
+		Btype = Block_type[Current_B];
+		block = MBbuf[Current_B];
+
+		/* encode MBbuf[][]: intra block or residual block */
+		if (mb_header->CBP&CBPmask) {
+			/* CBP => current block should be transfered */
+			last = transfer_TCOEFF(0, block, &mask); /* 0 ==> !Intra_used */
+
+			/* reconstruct block: */
+			/* a 'small decoder' in the encoder */
+			Iquantize(Intra_used[MTYPE], block, gob_header->GQUANT);
+			sparse_IDCT(block, last, mask);
+
+			/* save residual block to block[] */
+			save_residual(ref_view->fs[Btype], block,
+					Filter_used[MTYPE]);
+			clip_reconstructed_block(block);
+
+			/* write out data to rec_frame */
+			write_block(rec_view->fs[Btype], block);
+		} else {
+			/* for motion estimation of the next frame */
+			copy_block(rec_view->fs[Btype], ref_view->fs[Btype]);
+		}
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		H261_decoder_create()
+ *	Description:	make a decoder session: the bitstream is pushed by
+ *			H261_decoder_push_bits() (or as a whole by
+ *			H261_decoder_push_bits_in_place())
+ *	Input:		the parameters (param->image->type is set by the
+ *			bitstream)
+ *	Return:		the session (bound to the running thread)
+ *	Side effects:	exit while error occurs
+ *
+ *************************************************************************/
+H261_CONTEXT *H261_decoder_create(H261_PARAM *param)
+{
+	DEBUG("H261_decoder_create");
+	H261_CONTEXT *dec;
+
+	dec = make_context(param, TRUE);
+	open_read_stream();
+
+	return dec;
+}
+
+/*************************************************************************
+ *
+ *	Name:		H261_decoder_push_bits()
+ *	Description:	append bytes to the bitstream of a decoder session
+ *	Input:		the session, the pointer to the bytes and # of
+ *			bytes (0: the end of the bitstream)
+ *	Return:		none
+ *	Side effects:	the bytes are copied (data can be reused after it)
+ *
+ *************************************************************************/
+void H261_decoder_push_bits(H261_CONTEXT *dec, byte *data, int32 len)
+{
+	DEBUG("H261_decoder_push_bits");
+
+	H261_bind(dec);
+	push_read_stream(data, len);
+}
+
+/*************************************************************************
+ *
+ *	Name:		H261_decoder_push_bits_in_place()
+ *	Description:	give the whole bitstream to a decoder session,
+ *			which reads the bytes in place (without copying or
+ *			scanning them) up to their end
+ *	Input:		the session, the pointer to the bytes (e.g. a
+ *			mapped file) and # of bytes
+ *	Return:		none
+ *	Side effects:	the bytes must be kept until the session is
+ *			destroyed, and no more bytes can be pushed
+ *
+ *************************************************************************/
+void H261_decoder_push_bits_in_place(H261_CONTEXT *dec, byte *data,
+	int32 len)
+{
+	DEBUG("H261_decoder_push_bits_in_place");
+
+	H261_bind(dec);
+	push_read_stream_in_place(data, len);
+}
+
+/*************************************************************************
+ *
+ *	Name:		H261_decoder_get_frame()
+ *	Description:	decode the next frame if the bitstream of it has
+ *			been pushed
+ *	Input:		the session, and the pointer to get the frame ID
+ *	Return:		the decoded frame (released at the next call), or
+ *			NULL if more bytes are needed or at the end of the
+ *			bitstream (the info. of the sequence is printed)
+ *	Side effects:	exit while error occurs
+ *
+ *************************************************************************/
+FSTORE *H261_decoder_get_frame(H261_CONTEXT *dec, int32 *frame_ID)
+{
+	DEBUG("H261_decoder_get_frame");
+	boolean rest = FALSE;	/* the rest frame(s) at the end */
+
+	H261_bind(dec);
+	if (end_of_stream) return NULL;
+
+	/* wait for the PSC after the frame (and the header after it) */
+	if (!PSC_in_read_stream(coded_frames+2)) return NULL;
+
+	if (coded_frames==0) {
+		/* an empty bitstream is an error */
+		if (eof_read_stream()) {
+			ERROR_LINE();
+			printf("read_stream file %s is empty.\n",
+				Image->Stream_filename);
+			exit(ERROR_EOF);
+		}
+
+		/* decode the 1st frame header for image type definition */
+		read_PSC();
+		read_frame_header_tail(pic_header);
+
+		if (eof_read_stream()) {
+			printf("No image data in the bitstream file: %s.\n",
+				Image->Stream_filename);
+			exit(ERROR_EOF);
+		}
+
+		/* set image type : CIF or QCIF or NTSC */
+		if ((pic_header->PTYPE&CIF_PTYPE)==CIF_PTYPE) {
+			if (pic_header->PEI &&
+			   ((pic_header->PSPARE&NTSC_PSPARE)==NTSC_PSPARE ||
+			     pic_header->PSPARE==P64_NTSC_PSPARE))
+				Image->type = _NTSC;
+			else
+				Image->type = _CIF;
+		} else {
+			Image->type = _QCIF;
+		}
+		set_image_type();
+
+		/* make frame store after we have set image type */
+		alloc_mem_decoder();
+
+		/* print decoder info before processing the 1st frame */
+		print_codec_info(TRUE);
+
+		/* decode the 1st frame */
+		#ifdef CTRL_STAT_MTYPE
+		MTYPE_count[MB_NOT_TRANSMIT] += (Number_GOB * Number_MB);
+		#endif
+		Current_frame = Start_frame;
+		first_TR = pic_header->TR - Start_frame;
+		decode_frame();
+
+		/* here we have got a PSC after decode_frame() */
+		First_frame_bits = ftell_read_stream() - PSC_LENGTH;
+
+		#ifdef CTRL_GET_TIME
+		tTOTAL = 0;
+		#if (CTRL_GET_TIME==GET_ALL_TIME)
+		tDCT = tME = tQUAN = 0;
+		tIDCT = tIQUAN = 0;
+		#endif
+		#endif
+
+		/* symbols/sec excludes the 1st frame as the total time does */
+		#ifdef CTRL_VLD_STAT
+		VLD_symbols = 0;
+		#endif
+	} else {
+		/* here we have got a PSC after decode_frame() */
+		read_frame_header_tail(pic_header);
+
+		/* here we have got a frame header */
+		/* but we skip checking PTYPE */
+
+		if (eof_read_stream()) {
+			/* the last TR indicates End_frame */
+			end_of_stream = TRUE;
+			if (pic_header->TR != MOD_32(Current_frame+first_TR)) {
+				/* Current_frame != End_frame == pic_header->TR */
+				/* => pic_header->TR's frame is a skip frame */
+
+				/* set Current_frame = pic_header->TR */
+				rest = TRUE;
+				do {
+					Current_frame++;
+
+					#ifdef CTRL_STAT_MTYPE
+					MTYPE_count[MB_NOT_TRANSMIT]
+						+= (Number_GOB * Number_MB);
+					#endif
+				} while (pic_header->TR
+					!= MOD_32(Current_frame+first_TR));
+			}
+			End_frame = Current_frame;
+			Number_frame = End_frame - Start_frame + 1;
+			printf("The last frame ID is %ld.\n", End_frame);
+
+			Total_bits = ftell_read_stream();
+			print_sequence_info(TRUE);
+
+			/* the rest frame(s) after the last coded frame */
+			if (!rest) return NULL;
+			*frame_ID = Current_frame;
+			return reco_frame;
+		}
+
+		/* set Current_frame = pic_header->TR */
+		do {
+			Current_frame++;
+
+			#ifdef CTRL_STAT_MTYPE
+			MTYPE_count[MB_NOT_TRANSMIT]
+				+= (Number_GOB * Number_MB);
+			#endif
+		} while (pic_header->TR != MOD_32(Current_frame+first_TR));
+
+		/* set timer to obtain total time */
+		#ifdef CTRL_GET_TIME
+		get_time(tTOTAL1);
+		#endif
+
+		/* decode the pic_header->TR's frame into a new frame
+		 * buffer, reco_frame may be still being written */
+		release_frame_buffer(last_frame);
+		last_frame = reco_frame;
+		reco_frame = get_frame_buffer();
+		copy_FS(reco_frame, last_frame);
+		decode_frame();
+		/* here we have got a PSC after decode_frame() */
+
+		/* total time excludes I/O time */
+		#ifdef CTRL_GET_TIME
+		get_time(tTOTAL2);
+		ntTOTAL++;
+		tTOTAL += diff_time(tTOTAL2, tTOTAL1);
+		#endif
+	}
+	coded_frames++;
+
+	*frame_ID = Current_frame;
+	return reco_frame;
+}
+
+/*************************************************************************
+ *
+ *	Name:		H261_decoder_destroy()
+ *	Description:	free a decoder session
+ *	Input:		the session
+ *	Return:		none
+ *	Side effects:	the frames got from the session will be freed
+ *
+ *************************************************************************/
+void H261_decoder_destroy(H261_CONTEXT *dec)
+{
+	DEBUG("H261_decoder_destroy");
+
+	H261_bind(dec);
+	free_IO_state();
+	free_context();
+}
+
+/*************************************************************************
+ *
+ *	Name:	       	decode_frame()
+ *	Description:	decode the pic_header->TR's frame
+ *	Input:          none
+ *	Return:	       	none
+ *	Side effects:   entries of rec_frame will be changed
+ *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
+ *
+ *************************************************************************/
+static void decode_frame(void)
+{
+	DEBUG("decode_frame");
+
+	/* here we have read the frame header */
+
+	/* decode each GOB in pic_header->TR's frame */
+	read_GBSC();
+	while ((gob_header->GN=read_GN())!=0) {
+		/* not PSC */
+		/* obtain Current_GOB by gob_header->GN */
+		Current_GOB = ((Image->type==_QCIF) ?
+				((gob_header->GN-1)>>1) : gob_header->GN-1);
+		#ifdef DEBUG_ON
+		if (Current_GOB>Number_GOB) {
+			ERROR_LINE();
+			printf("GN read error: GN=%d, Current_GOB=%d>%d\n",
+				gob_header->GN, Current_GOB, Number_GOB);
+			exit(ERROR_BOUNDS);
+		}
+		#endif
+
+		/* here we have got GBSC and GN */
+		read_GOB_header_tail(gob_header);
+
+		/* decode each MB in the GOB */
+		Last_MTYPE = Last_MVDH = Last_MVDV = 0;
+		Current_MB = -1;
+		while (read_MB_header(&Current_MB, gob_header->GQUANT,
+				mb_header)!=GBSC_code) {
+			MTYPE = mb_header->MTYPE;
+			MVDH = mb_header->MVDH;
+			MVDV = mb_header->MVDV;
+			#ifdef DEBUG_ON
+			if (Current_MB>=Number_MB) {
+				ERROR_LINE();
+				printf("MB out of range: %d >= %d.\n",
+					Current_MB, Number_MB);
+				exit(ERROR_BOUNDS);
+			}
+			#endif
+			decode_MB();
+
+			#ifdef CTRL_STAT_MTYPE
+			MTYPE_count[MTYPE]++;
+			MTYPE_count[MB_NOT_TRANSMIT]--;
+			#endif
+		}
+	}
+	/* we have got a PSC here */
+}
+
+/*************************************************************************
+ *
+ *	Name:	       	decode_MB()
+ *	Description:	decode each block in current MB
+ *	Input:          none
+ *	Return:	       	none
+ *	Side effects:	entries of rec_frame will be changed
+ *	Date: 96/04/29	Author: Chu Ching-Wen in N.T.H.U., Taiwan
+ *
+ *************************************************************************/
+static void decode_MB(void)
+{
+	DEBUG("decode_MB");
+	int32 Y_memloc, CbCr_memloc;
+	int16 CBPmask = 0x20;	/* (10 0000) */
+	int16 *block;
+	int16 last;	/* the last non-zero TCOEFF and the mask of them */
+	bytes8 mask;	/* (for sparse_IDCT()) */
+	ComponentType Btype;	/* for block type (= _Y, _U or _V) */
+
+	/* here we have read the MB header */
+
+	/* set memloc for writing into frame stores */
+	Y_memloc = YGOB_memloc[Current_GOB] + YMB_memloc[Current_MB];
+	CbCr_memloc = GOB_memloc[Current_GOB] + MB_memloc[Current_MB];
+
+	/* to save current decoded MB */
+	SET_memloc(reco_frame, Y_memloc, CbCr_memloc);
+
+	/* reference MB */
+	if (MVD_used[MTYPE] && ((MVDH!=0)||(MVDV!=0))) {
+		/* obtain memloc by current MV for reference frame */
+		if (MVDV>=0) {
+			Y_memloc += (YMVDV_memloc[MVDV] + MVDH);
+			CbCr_memloc += (MVDV_memloc[MVDV] + (MVDH>>1));
+		} else {
+			Y_memloc += (-YMVDV_memloc[-MVDV] + MVDH);
+			CbCr_memloc += (-MVDV_memloc[-MVDV] + (MVDH>>1));
+		}
+	}
+	SET_memloc(last_frame, Y_memloc, CbCr_memloc);
+
+	if (!TCOEFF_used[MTYPE]) {
+		/* without TCOEFF */
+		if (MVD_used[MTYPE])
+			copy_MB(reco_frame, last_frame);
+	} else {
+		/* with TCOEFF */
+		/* for blocks specified by CBP */
+		if (Intra_used[MTYPE])
+			mb_header->CBP = 0x3f;	/* all blocks */
+		for (Current_B=0; Current_B<6; Current_B++,CBPmask>>=1) {
+			Btype = Block_type[Current_B];
+			block = MBbuf[Current_B];
+
+			if (mb_header->CBP&CBPmask) {
+				/* receive TCOEFF */
+				last = Itransfer_TCOEFF(Intra_used[MTYPE], block,
+					&mask);
+				if (MQUANT_used[MTYPE]) {
+					Iquantize(Intra_used[MTYPE], block, mb_header->MQUANT);
+				} else {
+					Iquantize(Intra_used[MTYPE], block, gob_header->GQUANT);
+				}
+				sparse_IDCT(block, last, mask);
+
+				if (!Intra_used[MTYPE]) {
+					/* save residual block to block[] */
+					save_residual(last_frame->fs[Btype],
+						block, Filter_used[MTYPE]);
+				}
+				clip_reconstructed_block(block);
+
+				/* write 1 block to reco_frame */
+				write_block(reco_frame->fs[Btype], block);
+			} else if (MVD_used[MTYPE]) {
+				copy_block(reco_frame->fs[Btype],
+					last_frame->fs[Btype]);
+			}
+		}
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		set_image_type()
+ *	Description:	set the Image parameters for CCITT coding
+ *	Input:          none
+ *	Return:		none
+ *	Side effects:	entries of Image, ?_memloc, ?_posX and ?_posY
+ *			will be changed
+ *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
+ *
+ *************************************************************************/
+static void set_image_type(void)
+{
+	DEBUG("set_image_type");
+	ComponentType type;
+	int16 i, j;
+	int32 last;
+
+	switch (Image->type) {
+	case _NTSC:	/* Parameters for NTSC type */
+		Number_GOB = 10;
+		Number_MB = 33;
+		Image->Width = Image->width[_Y] = 352;
+		Image->Height = Image->height[_Y] = 240;
+		Image->width[_Cb] = Image->width[_Cr] = 176;
+		Image->height[_Cb] = Image->height[_Cr] = 120;
+		break;
+	case _CIF:	/* Parameters for CIF type */
+		Number_GOB = 12;
+		Number_MB = 33;
+		Image->Width = Image->width[_Y] = 352;
+		Image->Height = Image->height[_Y] = 288;
+		Image->width[_Cb] = Image->width[_Cr] = 176;
+		Image->height[_Cb] = Image->height[_Cr] = 144;
+		break;
+	case _QCIF:	/* Parameters for QCIF type */
+		Number_GOB = 3;
+		Number_MB = 33;
+		Image->Width = Image->width[_Y] = 176;
+		Image->Height = Image->height[_Y] = 144;
+		Image->width[_Cb] = Image->width[_Cr] = 88;
+		Image->height[_Cb] = Image->height[_Cr] = 72;
+		break;
+	default:
+		ERROR_LINE();
+		printf("Unknown image type: %d\n", Image->type);
+		exit(ERROR_OTHERS);
+	}
+
+	for (type=0; type<NUMBER_OF_COMPONENTS; type++) {
+		Image->len[type] = (int32) Image->width[type]
+				* Image->height[type] * sizeof(unsigned char);
+		/* the same as make_FS() */
+		Image->stride[type] = Image->width[type]
+				+ ((type==_Y) ? (FS_BORDER<<1) : FS_BORDER);
+	}
+
+	/* Row-major in MEM->data => Image->stride[] should be set */
+
+	/* set GOB_memloc for Y, Cb and Cr */
+	if (Image->type==_QCIF) {
+		YGOB_memloc[0] = GOB_memloc[0] = 0;
+		GOB_posX[0] = GOB_posY[0] = 0;
+		for (Current_GOB=1; Current_GOB<Number_GOB; Current_GOB++) {
+			YGOB_memloc[Current_GOB] = YGOB_memloc[Current_GOB-1]
+					+ (Image->stride[_Y] * 48);
+			GOB_memloc[Current_GOB] = GOB_memloc[Current_GOB-1]
+					+ (Image->stride[_Cb] * 24);
+
+			GOB_posX[Current_GOB] = 0;
+			GOB_posY[Current_GOB] = GOB_posY[Current_GOB-1] + 48;
+		}
+	} else {
+		YGOB_memloc[0] = GOB_memloc[0] = 0;
+		YGOB_memloc[1] = 176;
+		GOB_memloc[1] = 88;
+
+		GOB_posX[0] = GOB_posY[0] = 0;
+		GOB_posX[1] = 176;
+		GOB_posY[1] = 0;
+		for (Current_GOB=2; Current_GOB<Number_GOB; Current_GOB+=2) {
+			/* (Current_GOB)-th GOB */
+			YGOB_memloc[Current_GOB] = YGOB_memloc[Current_GOB-2]
+					+ (Image->stride[_Y] * 48);
+			GOB_memloc[Current_GOB] = GOB_memloc[Current_GOB-2]
+					+ (Image->stride[_Cb] * 24);
+			GOB_posX[Current_GOB] = 0;
+			GOB_posY[Current_GOB] = GOB_posY[Current_GOB-2] + 48;
+
+			/* (Current_GOB+1)-th GOB */
+			YGOB_memloc[Current_GOB+1] = YGOB_memloc[Current_GOB]
+					+ 176;
+			GOB_memloc[Current_GOB+1] = GOB_memloc[Current_GOB]
+					+ 88;
+			GOB_posX[Current_GOB+1] = 176;
+			GOB_posY[Current_GOB+1] = GOB_posY[Current_GOB];
+		}
+	}
+
+	/* set MB_memloc for Y */
+	Current_MB = 0;
+	last = 0;
+	for (i=0; i<3; i++) {
+		MB_posX[Current_MB] = 0;
+		MB_posY[Current_MB] = i * 16;
+		YMB_memloc[Current_MB++] = last;
+		for (j=1; j<11; j++,Current_MB++) {
+			YMB_memloc[Current_MB] = YMB_memloc[Current_MB-1] + 16;
+			MB_posX[Current_MB] = j * 16;
+			MB_posY[Current_MB] = i * 16;
+		}
+		last += (Image->stride[_Y] * 16);
+	}
+	/* set MB_memloc for Cb and Cr */
+	Current_MB = last = 0;
+	for (i=0; i<3; i++) {
+		MB_memloc[Current_MB++] = last;
+		for (j=1; j<11; j++,Current_MB++)
+			MB_memloc[Current_MB] = MB_memloc[Current_MB-1] + 8;
+		last += (Image->stride[_Cb] * 8);
+	}
+	Current_MB = 0;
+
+	/* set B_memloc for Y, Cb and Cr */
+	B_memloc[0] = 0;
+	B_memloc[1] = B_memloc[0] + 8;
+	B_memloc[2] = B_memloc[0] + (Image->stride[_Y] * 8);
+	B_memloc[3] = B_memloc[1] + (Image->stride[_Y] * 8);
+	B_memloc[4] = 0;
+	B_memloc[5] = 0;
+	Current_B = 0;
+
+	/* set MVDV_memloc for Y (MVDV should be abs(MVDV))*/
+	YMVDV_memloc[0] = 0;
+	for (MVDV=1; MVDV<31; MVDV++)
+		YMVDV_memloc[MVDV] = YMVDV_memloc[MVDV-1]
+					+ Image->stride[_Y];
+	/* set MVDV_memloc for Cb and Cr (MVDV should be abs(MVDV))*/
+	/* NOTE: MVDV instead of MVDV/2 */
+	MVDV_memloc[0] = 0;
+	for (MVDV=1; MVDV<31; MVDV+=2) {
+		MVDV_memloc[MVDV] = MVDV_memloc[MVDV-1];
+		MVDV_memloc[MVDV+1] = MVDV_memloc[MVDV-1]
+					+ Image->stride[_Cb];
+	}
+	MVDV = MVDH = 0;
+}
+
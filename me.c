@@ -13,101 +13,249 @@
 /*************************************************************************/
 /* public */
 extern void motion_estimation(void);
+extern void decide_MTYPE(void);
 extern int16 full_search_ME(MEM *preBLK, MEM *curBLK);
 extern int16 three_step_search_ME(MEM *preBLK, MEM *curBLK);
 extern int16 new_three_step_search_ME(MEM *preBLK, MEM *curBLK);
 extern int16 my_search_ME(MEM *preBLK, MEM *curBLK);
-
-/*************************************************************************/
-/* frame stores */
-/* frame stores for encoder */
-extern FSTORE *ori_frame;	/* original frame in encoder */
-extern FSTORE *rec_frame;	/* reconstructed frame in encoder */
-/* for motion estimation in encoder */
-extern FSTORE *rec_frame_backup;/* save some "uncovered" MBs in encoder
-				 * if MVD points to upper or left MB */
-extern FSTORE *ref_frame;	/* point to reference frame
-				 * rec_frame or rec_frame_backup
-				 * it's just a pointer */
-/* frame stores for decoder */
-extern FSTORE *reco_frame;	/* reconstructed frame in decoder */
-extern FSTORE *last_frame;	/* last reconstructed frame in decoder */
-
-/*************************************************************************/
-/* to store MB info. of the last frame: MTYPE, MVDH and MVDV */
-extern int16 *MTYPE_frame;/* (MVDH_frame[i] == n)  =>
-			   *   MTYPE of the i-th MB of last frame is n */
-extern int16 *MVDH_frame; /* (MVDH_frame[i] == n)  =>
-			   *   MVDH of the i-th MB of last frame is n */
-extern int16 *MVDV_frame; /* (MVDH_frame[i] == n)  =>
-			   *   MVDV of the i-th MB of last frame is n */
-extern int16 *Last_update;/* (Last_update[i] == n) =>
-			   *   the i-th MB has not updated in last n frames */
-
-/*************************************************************************/
-/* Look-up-table for obtaining memloc in MEM: */
-/* Position of the upper-left connor in the GurrentGOB-th GOB for Y-type */
-extern int32 YGOB_memloc[12];
-/* Position of the upper-left connor in the GurrentGOB-th GOB for Cb, Cr */
-extern int32 GOB_memloc[12];
-
-/* Position of the upper-left connor in the Current_MB-th MB for Y-type */
-extern int32 YMB_memloc[33];
-/* Position of the upper-left connor in the Current_MB-th MB for Cb, Cr */
-extern int32 MB_memloc[33];
-
-/* Distance due to MVDV for Y-type */
-extern int32 YMVDV_memloc[31];
-/* Distance due to MVDV for Cb, Cr */
-extern int32 MVDV_memloc[31];
-
-/* (GOB_posX[i], GOB_poxY[i]) is the position of the i-th GOB */
-extern int32 GOB_posX[12];
-extern int32 GOB_posY[12];
-
-/* (MB_posX[i], MB_poxY[i]) is the position of the i-th MB */
-extern int32 MB_posX[33];
-extern int32 MB_posY[33];
+extern int16 pyramid_search_ME(MEM *preBLK, MEM *curBLK);
+extern int16 EPZS_search_ME(MEM *preBLK, MEM *curBLK);
+extern int16 diamond_search_ME(MEM *preBLK, MEM *curBLK);
+extern int16 hexagon_search_ME(MEM *preBLK, MEM *curBLK);
+extern int16 SEA_search_ME(MEM *preBLK, MEM *curBLK);
+extern int16 sub64_metric(MEM *preBLK, MEM *curBLK, int16 bound);
+extern int16 SAD_metric(MEM *preBLK, MEM *curBLK, int16 bound);
+extern int16 SATD_metric(MEM *preBLK, MEM *curBLK, int16 bound);
+extern void make_ME_state(void);
+extern void free_ME_state(void);
+extern void run_worker_tasks(int16 n, void (*function)(int16));
 
 extern boolean MVD_used[];		/* Motion Vector Data used */
-extern int16 Current_GOB;
-extern int16 Current_MB;
-extern int16 Number_GOB;
-extern int16 Number_MB;
 
-extern IMAGE *Image;		/* global info. of image */
+#ifdef CTRL_ME_THREAD
+#include <pthread.h>
+#endif
 
 /*************************************************************************/
 /* private */
+static void estimate_MB_row(int16 t);
 static int16 obtain_MTYPE(MEM *pmem, MEM *cmem);
+static void decide_MB_row(int16 t);
+static int16 MTYPE_by_MV(MEM *pmem, MEM *cmem);
+static int16 MTYPE_by_AE(void);
 static int16 absolute_error_SB(MEM *preBLK, MEM *curBLK);
 static int16 absolute_error_SB_shortcut(MEM *preBLK, MEM *curBLK, int16 bound);
+static void make_pyramid(MEM *preBLK, MEM *curBLK);
+static int32 absolute_error_NxN(byte *p_ptr, byte *c_ptr, int32 width,
+	int16 n, int32 bound);
+static void make_block_sum(MEM *preBLK);
+static int32 block_sum(byte *ptr, int32 stride);
+
+/* SAD kernels (sad.c), chosen by init_SAD() */
+extern int32 (*default_SAD_sub64)(byte *, byte *, int32, int32);
+#define use_SAD_sub64 (*default_SAD_sub64)
+extern int32 (*default_SAD_16x16)(byte *, byte *, int32, int32);
+#define use_SAD_16x16 (*default_SAD_16x16)
+
+/* the metric of -c (sub64_metric(), SAD_metric() or SATD_metric()) of the
+ * bound session, for absolute_error_SB() and absolute_error_SB_shortcut() */
+#define use_me_metric (*default_me_metric)
+
+/* the maximum AE: no shortcut by this bound */
+#define MAX_AE 0x7fff
 
 /*************************************************************************/
 /* program used */
-static int16 CurrentX;
-static int16 CurrentY;
-static int16 nMB;
-static int16 *Last_update_ptr;
-static int16 MVDH;	/* Motion Vector Data for Horizontal offset */
-static int16 MVDV;	/* Motion Vector Data for Vertical offset */
-static int16 AE_zero;	/* AE for the zero-displacement SB (super-block) */
-static int16 AE_best;	/* AE (absolute error) for the best-match SB */
+/* the state of motion estimation: one per task (a row of MBs in a GOB),
+ * so that the rows can be motion-estimated in parallel */
+#define ME_ROWS 3	/* rows of MBs in a GOB */
+typedef struct {
+	int16 CurrentX;
+	int16 CurrentY;
+	int16 nMB;
+	int16 *Last_update_ptr;
+	int16 MVDH;	/* Motion Vector Data for Horizontal offset */
+	int16 MVDV;	/* Motion Vector Data for Vertical offset */
+	int16 AE_zero;	/* AE for the zero-displacement SB (super-block) */
+	int16 AE_best;	/* AE (absolute error) for the best-match SB */
+	int16 GOB;	/* Current_GOB of the MB */
+	int16 MB;	/* Current_MB of the MB */
+	MEM pmem;	/* Y of ref_frame (with its own memloc) */
+	MEM cmem;	/* Y of ori_frame (with its own memloc) */
+	#ifdef CTRL_ME_STAT
+	int32 candidates;
+	int32 coarse;	/* matchings in the decimated frames (pyramid) */
+	#endif
+} ME_TASK;
+static THREAD_LOCAL ME_TASK *Task;	/* the task of this thread */
+
+#ifdef CTRL_ME_THREAD
+/* the worker threads: the rows of a frame are taken by ME_next (and the
+ * GOBs of a frame in encoder, see run_worker_tasks()) */
+static void do_ME_tasks(void);
+static void *ME_thread(void *arg);
+#endif
+
+#define PYRAMID_LEVELS 2
+
+/* the state of motion estimation of a session (see make_ME_state()) */
+struct ME_State {
+	ME_TASK ME_task[12*ME_ROWS];
+
+	#ifdef CTRL_ME_THREAD
+	pthread_t ME_worker[MAX_ME_THREADS];
+	pthread_mutex_t ME_lock;
+	pthread_cond_t ME_start;
+	pthread_cond_t ME_done;
+	int16 ME_workers;	/* # of worker threads started */
+	int16 ME_next;		/* the next task to be taken */
+	int16 ME_ntasks;	/* # of tasks of the frame */
+	int16 ME_ndone;		/* # of tasks done */
+	void (*ME_function)(int16);	/* of the tasks (by task ID) */
+	int32 ME_round;		/* # of frames given to the workers */
+	boolean ME_quit;	/* the workers should quit */
+	#endif
+
+	/* 2:1 and 4:1 decimated Y frames for pyramid_search_ME() */
+	byte *Pre_pyramid[PYRAMID_LEVELS];	/* of ref_frame */
+	byte *Cur_pyramid[PYRAMID_LEVELS];	/* of ori_frame */
+	int16 Pyramid_width[PYRAMID_LEVELS];
+	int16 Pyramid_height[PYRAMID_LEVELS];
+	boolean Pyramid_made;	/* made for the current frame or not */
+
+	/* MVs and AEs of the MBs by their positions for EPZS_search_ME():
+	 * (Map_frame[i] == ME_frame) => of the current frame (i.e. done),
+	 * (Map_frame[i] == ME_frame-1) => of the previous frame */
+	int16 *MVH_map;
+	int16 *MVV_map;
+	int16 *AE_map;
+	int32 *Map_frame;
+	int16 Map_width;	/* # of MBs in a row */
+	int32 ME_frame;		/* # of frames motion-estimated */
+
+	/* sums of the SB (at each position) of the previous Y frame for
+	 * SEA_search_ME(): (Block_sum[y*width+x]>>Block_sum_shift) is the
+	 * lower bound of AE by the metric of -c */
+	int32 *Block_sum;
+	int32 *Row_sum;		/* temporary */
+	int16 Block_sum_shift;
+	boolean Block_sum_made;	/* made for the current frame or not */
+};
+
+#define ME_state	(Ctx->ME_state)
+#define ME_task		(ME_state->ME_task)
+#define ME_worker	(ME_state->ME_worker)
+#define ME_lock		(ME_state->ME_lock)
+#define ME_start	(ME_state->ME_start)
+#define ME_done		(ME_state->ME_done)
+#define ME_workers	(ME_state->ME_workers)
+#define ME_next		(ME_state->ME_next)
+#define ME_ntasks	(ME_state->ME_ntasks)
+#define ME_ndone	(ME_state->ME_ndone)
+#define ME_function	(ME_state->ME_function)
+#define ME_round	(ME_state->ME_round)
+#define ME_quit		(ME_state->ME_quit)
+#define Pre_pyramid	(ME_state->Pre_pyramid)
+#define Cur_pyramid	(ME_state->Cur_pyramid)
+#define Pyramid_width	(ME_state->Pyramid_width)
+#define Pyramid_height	(ME_state->Pyramid_height)
+#define Pyramid_made	(ME_state->Pyramid_made)
+#define MVH_map		(ME_state->MVH_map)
+#define MVV_map		(ME_state->MVV_map)
+#define AE_map		(ME_state->AE_map)
+#define Map_frame	(ME_state->Map_frame)
+#define Map_width	(ME_state->Map_width)
+#define ME_frame	(ME_state->ME_frame)
+#define Block_sum	(ME_state->Block_sum)
+#define Row_sum		(ME_state->Row_sum)
+#define Block_sum_shift	(ME_state->Block_sum_shift)
+#define Block_sum_made	(ME_state->Block_sum_made)
+
+/* the state of the task of this thread */
+#define CurrentX	(Task->CurrentX)
+#define CurrentY	(Task->CurrentY)
+#define nMB		(Task->nMB)
+#define Last_update_ptr	(Task->Last_update_ptr)
+#define MVDH		(Task->MVDH)
+#define MVDV		(Task->MVDV)
+#define AE_zero		(Task->AE_zero)
+#define AE_best		(Task->AE_best)
 
-/* SET_memloc() sets mem->memloc to the right position by Current_GOB
-and Current_MB */
-#define SET_memloc(mem, Y_memloc, CbCr_memloc) {\
-		mem->fs[_Y]->memloc = Y_memloc;\
-		mem->fs[_Cb]->memloc = mem->fs[_Cr]->memloc = CbCr_memloc;\
+/*************************************************************************
+ *
+ *	Name:		make_ME_state()
+ *	Description:	make the state of motion estimation of the bound
+ *			session
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	ME_state will be allocated
+ *
+ *************************************************************************/
+void make_ME_state(void)
+{
+	DEBUG("make_ME_state");
+
+	ME_state = (struct ME_State *) calloc(1, sizeof(struct ME_State));
+	if (!ME_state) {
+		ERROR_LINE();
+		printf("Cannot allocate the state of ME.\n");
+		exit(ERROR_MEMORY);
 	}
+	#ifdef CTRL_ME_THREAD
+	pthread_mutex_init(&ME_lock, NULL);
+	pthread_cond_init(&ME_start, NULL);
+	pthread_cond_init(&ME_done, NULL);
+	#endif
+}
+
+/*************************************************************************
+ *
+ *	Name:		free_ME_state()
+ *	Description:	stop the worker threads and free the state of
+ *			motion estimation of the bound session
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	ME_state will be freed
+ *
+ *************************************************************************/
+void free_ME_state(void)
+{
+	DEBUG("free_ME_state");
+	int16 i;
+
+	if (!ME_state) return;
+
+	#ifdef CTRL_ME_THREAD
+	pthread_mutex_lock(&ME_lock);
+	ME_quit = TRUE;
+	pthread_cond_broadcast(&ME_start);
+	pthread_mutex_unlock(&ME_lock);
+	for (i=0; i<ME_workers; i++) pthread_join(ME_worker[i], NULL);
+	pthread_mutex_destroy(&ME_lock);
+	pthread_cond_destroy(&ME_start);
+	pthread_cond_destroy(&ME_done);
+	#endif
+
+	for (i=0; i<PYRAMID_LEVELS; i++) {
+		free(Pre_pyramid[i]);
+		free(Cur_pyramid[i]);
+	}
+	free(MVH_map);
+	free(MVV_map);
+	free(AE_map);
+	free(Map_frame);
+	free(Block_sum);
+	free(Row_sum);
+
+	free(ME_state);
+	ME_state = NULL;
+}
 
 /*************************************************************************
  *
  *	Name:		motion_estimation()
  *	Description:	apply motion estimation on two frames ((ori_frame
- *			and Y_frame) or (ori_frame and rec_frame)), and
- *                      buffer the referenced macro-blocks with negative
- *			MVDH or MVDV for future use
+ *			and Y_frame) or (ori_frame and ref_frame))
  *	Input:		none
  *	Return:	       	none
  *	Side effects:	MTYPE_frame, MVDH_frame, MVDV_frame will be changed
@@ -117,71 +265,57 @@ and Current_MB */
 void motion_estimation(void)
 {
 	DEBUG("motion_estimation");
-	int32 YGOB_memloc1;
-	int32 Y_memloc, CbCr_memloc;
-	int16 MTYPE;
-	extern boolean Intra_used[];
+	int16 i, n;
 
 	#if (CTRL_GET_TIME==GET_ALL_TIME)
 	get_time(tME1);
 	#endif
 
-	/* set MTYPE and MV for one superblock */
-	Last_update_ptr = Last_update;
-	for (nMB=Current_GOB=0; Current_GOB<Number_GOB; Current_GOB++) {
-		YGOB_memloc1 = YGOB_memloc[Current_GOB];
-		for (Current_MB=0; Current_MB<Number_MB;
-				Current_MB++,nMB++,Last_update_ptr++) {
-			/* get the memory location of current MB */
-			ori_frame->fs[_Y]->memloc = Y_memloc
-				= YGOB_memloc1 + YMB_memloc[Current_MB];
-
-			/* use rec_frame as previous coded frame store */
-			rec_frame->fs[_Y]->memloc = Y_memloc;
-			MTYPE_frame[nMB] = MTYPE
-			= obtain_MTYPE(rec_frame->fs[_Y], ori_frame->fs[_Y]);
-
-			if (Intra_used[MTYPE]) {
-				*Last_update_ptr = 0;
-			} else {
-				(*Last_update_ptr)++;
-			}
-
-			/* if current MB should reference above or left MB,
-			 * then we shold buffer the "uncover" MB for future
-			 * use... get motion compacated block */
-			if (MVD_used[MTYPE]) {
-				if ((MVDH<0) || (MVDV<0)) {
-					/* obtain new memloc by current MV */
-					if (MVDV>=0) {
-						Y_memloc +=
-						(YMVDV_memloc[MVDV] + MVDH);
-
-						CbCr_memloc
-						= GOB_memloc[Current_GOB]
-						+ MB_memloc[Current_MB]
-						+ (MVDV_memloc[MVDV]
-						+ (MVDH>>1));
-					} else {
-						Y_memloc +=
-						(-YMVDV_memloc[-MVDV] + MVDH);
-
-						CbCr_memloc
-						= GOB_memloc[Current_GOB]
-						+ MB_memloc[Current_MB]
-						+ (-MVDV_memloc[-MVDV]
-						+ (MVDH>>1));
-					}
-					//copy_MB(rec_frame, ori_frame);
-					SET_memloc(rec_frame,
-						Y_memloc, CbCr_memloc);
-					SET_memloc(rec_frame_backup,
-						Y_memloc, CbCr_memloc);
-					copy_MB(rec_frame_backup, rec_frame);
-				 }
-			}
+	/* the pyramids and block sums (if used) are made once per frame */
+	Pyramid_made = FALSE;
+	Block_sum_made = FALSE;
+
+	/* the MV map of MBs (by their positions) */
+	if (!Map_frame) {
+		Map_width = Image->width[_Y] >> 4;
+		n = Map_width * (Image->height[_Y] >> 4);
+		MVH_map = (int16 *) malloc(n * sizeof(int16));
+		MVV_map = (int16 *) malloc(n * sizeof(int16));
+		AE_map = (int16 *) malloc(n * sizeof(int16));
+		Map_frame = (int32 *) malloc(n * sizeof(int32));
+		if ((!MVH_map) || (!MVV_map) || (!AE_map) || (!Map_frame)) {
+			ERROR_LINE();
+			printf("Cannot allocate the MV map of ME.\n");
+			exit(ERROR_MEMORY);
 		}
+		while (n--) Map_frame[n] = -2;	/* no MBs */
 	}
+	ME_frame++;
+
+	/* set MTYPE and MV for each row of MBs */
+	n = Number_GOB * ME_ROWS;
+	#ifdef CTRL_ME_THREAD
+	/* EPZS_search_ME() uses the MVs of the neighbors in this frame, so
+	 * it must follow the order of MBs (in one thread) */
+	if ((ME_threads>1) && (default_me_algo!=EPZS_search_ME)) {
+		/* make them before the tasks share them */
+		if (default_me_algo==pyramid_search_ME)
+			make_pyramid(ref_frame->fs[_Y], ori_frame->fs[_Y]);
+		if (default_me_algo==SEA_search_ME)
+			make_block_sum(ref_frame->fs[_Y]);
+		run_worker_tasks(n, estimate_MB_row);
+	} else
+	#endif
+	for (i=0; i<n; i++) estimate_MB_row(i);
+
+	#ifdef CTRL_ME_STAT
+	for (i=0; i<n; i++) {
+		ME_candidates += ME_task[i].candidates;
+		ME_coarse += ME_task[i].coarse;
+		ME_task[i].candidates = ME_task[i].coarse = 0;
+	}
+	ME_MBs += Number_GOB * Number_MB;
+	#endif
 
 	#if (CTRL_GET_TIME==GET_ALL_TIME)
 	get_time(tME2);
@@ -191,6 +325,249 @@ void motion_estimation(void)
 	#endif
 }
 
+/*************************************************************************
+ *
+ *	Name:		estimate_MB_row()
+ *	Description:	apply motion estimation on a row of MBs in a GOB
+ *			(the t-th task: the (t%3)-th row in the (t/3)-th
+ *			GOB) by the state in ME_task[t]
+ *	Input:		the task ID t
+ *	Return:		none
+ *	Side effects:	MTYPE_frame, MVDH_frame, MVDV_frame, Last_update
+ *			and the MV map will be changed for the MBs
+ *
+ *************************************************************************/
+static void estimate_MB_row(int16 t)
+{
+	DEBUG("estimate_MB_row");
+	int16 MTYPE, n, first_MB, last_MB;
+	extern boolean Intra_used[];
+
+	Task = &ME_task[t];
+	Task->GOB = t / ME_ROWS;
+	first_MB = (t % ME_ROWS) * (Number_MB / ME_ROWS);
+	last_MB = first_MB + (Number_MB / ME_ROWS);
+
+	/* own copies of Y of ref_frame and ori_frame (for their memloc) */
+	Task->pmem = *(ref_frame->fs[_Y]);
+	Task->cmem = *(ori_frame->fs[_Y]);
+
+	nMB = Task->GOB * Number_MB + first_MB;
+	Last_update_ptr = Last_update + nMB;
+	for (Task->MB=first_MB; Task->MB<last_MB;
+			Task->MB++,nMB++,Last_update_ptr++) {
+		/* get the memory location of current MB */
+		/* use ref_frame as previous coded frame store */
+		Task->pmem.memloc = Task->cmem.memloc
+			= YGOB_memloc[Task->GOB] + YMB_memloc[Task->MB];
+		MTYPE_frame[nMB] = MTYPE
+			= obtain_MTYPE(&Task->pmem, &Task->cmem);
+
+		/* the ME stage of open-loop ME gives the MVs only (also of
+		 * the MBs not to be motion-compensated by its MTYPE, except
+		 * the ones not searched): the encoder decides the MTYPEs
+		 * against ref_frame, see decide_MTYPE() */
+		if (ME_open_loop && (MTYPE!=MB_NOT_TRANSMIT)) {
+			MVDH_frame[nMB] = MVDH;
+			MVDV_frame[nMB] = MVDV;
+		}
+
+		/* the MV and AE of the MB into the map */
+		n = ((GOB_posY[Task->GOB] + MB_posY[Task->MB]) >> 4)
+			* Map_width
+			+ ((GOB_posX[Task->GOB] + MB_posX[Task->MB]) >> 4);
+		MVH_map[n] = MVDH_frame[nMB];
+		MVV_map[n] = MVDV_frame[nMB];
+		AE_map[n] = AE_best;
+		Map_frame[n] = ME_frame;
+
+		if (Intra_used[MTYPE]) {
+			*Last_update_ptr = 0;
+		} else {
+			(*Last_update_ptr)++;
+		}
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		decide_MTYPE()
+ *	Description:	decide the MTYPEs of a frame by the MVs got by the
+ *			ME stage (against the original frames) and the AEs
+ *			against ref_frame, as obtain_MTYPE() does after ME
+ *	Input:		none
+ *	Return:	       	none
+ *	Side effects:	MTYPE_frame, MVDH_frame, MVDV_frame and
+ *			Last_update will be changed
+ *
+ *************************************************************************/
+void decide_MTYPE(void)
+{
+	DEBUG("decide_MTYPE");
+	int16 i, n;
+
+	n = Number_GOB * ME_ROWS;
+	#ifdef CTRL_ME_THREAD
+	if (ME_threads>1) run_worker_tasks(n, decide_MB_row);
+	else
+	#endif
+	for (i=0; i<n; i++) decide_MB_row(i);
+
+	#ifdef CTRL_ME_STAT
+	for (i=0; i<n; i++) {
+		ME_candidates += ME_task[i].candidates;
+		ME_task[i].candidates = 0;
+	}
+	#endif
+}
+
+/*************************************************************************
+ *
+ *	Name:		decide_MB_row()
+ *	Description:	decide the MTYPEs of a row of MBs in a GOB (the
+ *			t-th task, as estimate_MB_row()) by their MVs
+ *	Input:		the task ID t
+ *	Return:		none
+ *	Side effects:	MTYPE_frame, MVDH_frame, MVDV_frame and
+ *			Last_update will be changed for the MBs
+ *
+ *************************************************************************/
+static void decide_MB_row(int16 t)
+{
+	DEBUG("decide_MB_row");
+	int16 MTYPE, first_MB, last_MB;
+	extern boolean Intra_used[];
+
+	Task = &ME_task[t];
+	Task->GOB = t / ME_ROWS;
+	first_MB = (t % ME_ROWS) * (Number_MB / ME_ROWS);
+	last_MB = first_MB + (Number_MB / ME_ROWS);
+
+	Task->pmem = *(ref_frame->fs[_Y]);
+	Task->cmem = *(ori_frame->fs[_Y]);
+
+	nMB = Task->GOB * Number_MB + first_MB;
+	Last_update_ptr = Last_update + nMB;
+	for (Task->MB=first_MB; Task->MB<last_MB;
+			Task->MB++,nMB++,Last_update_ptr++) {
+		Task->pmem.memloc = Task->cmem.memloc
+			= YGOB_memloc[Task->GOB] + YMB_memloc[Task->MB];
+		MTYPE_frame[nMB] = MTYPE
+			= MTYPE_by_MV(&Task->pmem, &Task->cmem);
+
+		if (Intra_used[MTYPE]) {
+			*Last_update_ptr = 0;
+		} else {
+			(*Last_update_ptr)++;
+		}
+	}
+}
+
+#ifdef CTRL_ME_THREAD
+/*************************************************************************
+ *
+ *	Name:		run_worker_tasks()
+ *	Description:	run n tasks (rows of MBs of ME, or GOBs of the
+ *			encoder) by the worker threads and this thread,
+ *			and wait for all of them
+ *	Input:		# of tasks, and the function of a task (by the
+ *			task ID 0, ..., n-1)
+ *	Return:		none
+ *	Side effects:	(ME_threads-1) worker threads will be created at
+ *			the first time
+ *
+ *************************************************************************/
+void run_worker_tasks(int16 n, void (*function)(int16))
+{
+	DEBUG("run_worker_tasks");
+
+	/* the workers are kept till free_ME_state() */
+	while (ME_workers<ME_threads-1) {
+		if (pthread_create(&ME_worker[ME_workers], NULL, ME_thread,
+				(void *) Ctx)) {
+			ERROR_LINE();
+			printf("Cannot create the thread of ME.\n");
+			exit(ERROR_OTHERS);
+		}
+		ME_workers++;
+	}
+
+	pthread_mutex_lock(&ME_lock);
+	ME_next = ME_ndone = 0;
+	ME_ntasks = n;
+	ME_function = function;
+	ME_round++;
+	pthread_cond_broadcast(&ME_start);
+	pthread_mutex_unlock(&ME_lock);
+
+	do_ME_tasks();
+
+	pthread_mutex_lock(&ME_lock);
+	while (ME_ndone<ME_ntasks) pthread_cond_wait(&ME_done, &ME_lock);
+	pthread_mutex_unlock(&ME_lock);
+}
+
+/*************************************************************************
+ *
+ *	Name:		do_ME_tasks()
+ *	Description:	take and do the tasks till no task is left
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	ME_next and ME_ndone will be changed
+ *
+ *************************************************************************/
+static void do_ME_tasks(void)
+{
+	DEBUG("do_ME_tasks");
+	int16 t;
+
+	while (TRUE) {
+		pthread_mutex_lock(&ME_lock);
+		t = (ME_next<ME_ntasks) ? ME_next++ : -1;
+		pthread_mutex_unlock(&ME_lock);
+		if (t<0) return;
+
+		(*ME_function)(t);
+
+		pthread_mutex_lock(&ME_lock);
+		if (++ME_ndone==ME_ntasks) pthread_cond_signal(&ME_done);
+		pthread_mutex_unlock(&ME_lock);
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		ME_thread()
+ *	Description:	the worker thread of motion estimation: do the
+ *			tasks of each frame given by run_worker_tasks()
+ *	Input:		the session of the thread
+ *	Return:		none (when ME_quit is set)
+ *	Side effects:
+ *
+ *************************************************************************/
+static void *ME_thread(void *arg)
+{
+	DEBUG("ME_thread");
+	int32 round = 0;
+	boolean quit;
+
+	Ctx = (H261_CONTEXT *) arg;
+	while (TRUE) {
+		pthread_mutex_lock(&ME_lock);
+		while ((round==ME_round) && (!ME_quit))
+			pthread_cond_wait(&ME_start, &ME_lock);
+		round = ME_round;
+		quit = ME_quit;
+		pthread_mutex_unlock(&ME_lock);
+		if (quit) break;
+
+		do_ME_tasks();
+	}
+
+	return NULL;
+}
+#endif
+
 #define RETURN_MTYPE(MTYPE) {\
 		/* nMB for fetch the previous frame's MVs */\
 		MVDH_frame[nMB] = MVDV_frame[nMB] = 0;\
@@ -210,7 +587,7 @@ void motion_estimation(void)
  *	Description:	apply motion estimation for current super-block in
  *			cmem (reference pmem), and obtain MTYPE accordingly
  *	Input:          the pointers to the current and previous Y frames,
- *			the extern rec_frame->fs[_Y] is used for the
+ *			the extern ref_frame->fs[_Y] is used for the
  *			decision of MTYPE after MVDs have been obtained
  *	Return:	       	MTYPE of current macro-block
  *	Side effects:	MVDH, MVDV, MVDH_frame, MVDV_frame, AE_zero, and
@@ -221,7 +598,6 @@ void motion_estimation(void)
 static int16 obtain_MTYPE(MEM *pmem, MEM *cmem)
 {
 	DEBUG("obtain_MTYPE");
-	extern int16 (*default_me_algo)(MEM *, MEM *);
 	#define use_me_algo (*default_me_algo)
 
 	/* set MTYPE and MV for one superblock */
@@ -255,13 +631,69 @@ static int16 obtain_MTYPE(MEM *pmem, MEM *cmem)
 	if (AE_best>AE_TCOEFF_THRESHOLD) {
 		/* obtain MVD */
 		/* MV start from (0, 0) */
-		CurrentX = GOB_posX[Current_GOB] + MB_posX[Current_MB];
-		CurrentY = GOB_posY[Current_GOB] + MB_posY[Current_MB];
+		CurrentX = GOB_posX[Task->GOB] + MB_posX[Task->MB];
+		CurrentY = GOB_posY[Task->GOB] + MB_posY[Task->MB];
 
 		/* choose ME algorithms */
 		AE_best = use_me_algo(pmem, cmem);
 	}
 
+	return MTYPE_by_AE();
+}
+
+/*************************************************************************
+ *
+ *	Name:		MTYPE_by_MV()
+ *	Description:	obtain MTYPE of current super-block in cmem
+ *			(reference pmem) by the MV in MVDH_frame and
+ *			MVDV_frame without motion estimation
+ *	Input:          the pointers to the current and previous Y frames
+ *	Return:	       	MTYPE of current macro-block
+ *	Side effects:	MVDH, MVDV, MVDH_frame, MVDV_frame, AE_zero, and
+ *			AE_best will be changed
+ *
+ *************************************************************************/
+static int16 MTYPE_by_MV(MEM *pmem, MEM *cmem)
+{
+	DEBUG("MTYPE_by_MV");
+
+	AE_best = AE_zero = absolute_error_SB(pmem, cmem);
+	if (WITHOUT_TCOEFF(AE_zero)) {
+		/* do not transmit current MB */
+		RETURN_MTYPE(MB_NOT_TRANSMIT);
+	}
+
+	MVDH = MVDH_frame[nMB];
+	MVDV = MVDV_frame[nMB];
+	if ((MVDH!=0) || (MVDV!=0)) {
+		pmem->memloc += (((MVDV>=0) ? YMVDV_memloc[MVDV] :
+						-YMVDV_memloc[-MVDV]) + MVDH);
+		AE_best = absolute_error_SB_shortcut(pmem, cmem, AE_zero);
+		if (AE_best>=AE_zero) {
+			/* (0, 0) is better than (MVDH, MVDV) */
+			MVDV = MVDH = 0;
+			AE_best = AE_zero;
+		}
+	}
+
+	return MTYPE_by_AE();
+}
+
+/*************************************************************************
+ *
+ *	Name:		MTYPE_by_AE()
+ *	Description:	obtain MTYPE of current super-block by AE_zero,
+ *			AE_best (at (MVDH, MVDV)) and the # of frames
+ *			since it was updated (intra)
+ *	Input:          none
+ *	Return:	       	MTYPE of current macro-block
+ *	Side effects:	MVDH_frame and MVDV_frame will be changed
+ *
+ *************************************************************************/
+static int16 MTYPE_by_AE(void)
+{
+	DEBUG("MTYPE_by_AE");
+
 	/* forced intra */
 	if (*Last_update_ptr+(AE_best>>3)>131) RETURN_MTYPE(INTRA);
 
@@ -295,55 +727,29 @@ static int16 obtain_MTYPE(MEM *pmem, MEM *cmem)
  *
  *	Name:		absoulte_error_SB()
  *	Description:	obatin AE (absoult error) of two super-blocks in
- *			previous and current Y frames
+ *			previous and current Y frames by the metric of -c
  *	Input:		the pointers to the current and previous Y frames
  *	Return:	       	absoult error of two super-blocks
  *	Side effects:
  *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
  *
  *************************************************************************/
-/* NOTE: pick 64 points only
- *  	*---*---*---*---
- *  	--*---*---*---*-
- *  	*---*---*---*---
- *  	--*---*---*---*-
- *  	*---*---*---*---
- * 	.....
- */
 static int16 absolute_error_SB(MEM *preBLK, MEM *curBLK)
 {
 	DEBUG("absolute_error_SB");
-	register int16 i, data, ae, width;
-	register unsigned char *p_ptr, *c_ptr;
 
-	width = preBLK->width;
-	p_ptr = preBLK->data + preBLK->memloc;
-	c_ptr = curBLK->data + curBLK->memloc;
-	for (ae=i=0; i<8; i++) {
-		/* 1st line sample points: 0, 4, 8, 12 */
-		ae += (	abs(*c_ptr - *p_ptr) +
-			abs(*(c_ptr+4) - *(p_ptr+4)) +
-			abs(*(c_ptr+8) - *(p_ptr+8)) +
-			abs(*(c_ptr+12) - *(p_ptr+12)) );
-		c_ptr += width;
-		p_ptr += width;
+	#ifdef CTRL_ME_STAT
+	Task->candidates++;
+	#endif
 
-		/* 2nd line sample points: 2, 6, 10, 14 */
-		ae += (	abs(*(c_ptr+2) - *(p_ptr+2)) +
-			abs(*(c_ptr+6) - *(p_ptr+6)) +
-			abs(*(c_ptr+10) - *(p_ptr+10)) +
-			abs(*(c_ptr+14) - *(p_ptr+14)) );
-		c_ptr += width;
-		p_ptr += width;
-	}
-	return ae;
+	return use_me_metric(preBLK, curBLK, MAX_AE);
 }
 
 /*************************************************************************
  *
  *	Name:		absoulte_error_SB_shortcut()
  *	Description:	obatin AE (absoult error) of two super-blocks in
- *			previous and current Y frames
+ *			previous and current Y frames by the metric of -c
  *	Input:		the pointers to the current and previous Y frames,
  *			the bound at present (upper-bound)
  *	Return:	       	absoult error of two super-blocks (may not be
@@ -352,6 +758,28 @@ static int16 absolute_error_SB(MEM *preBLK, MEM *curBLK)
  *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
  *
  *************************************************************************/
+static int16 absolute_error_SB_shortcut(MEM *preBLK, MEM *curBLK, int16 bound)
+{
+	DEBUG("absolute_error_SB_shortcut");
+
+	#ifdef CTRL_ME_STAT
+	Task->candidates++;
+	#endif
+
+	return use_me_metric(preBLK, curBLK, bound);
+}
+
+/*************************************************************************
+ *
+ *	Name:		sub64_metric()
+ *	Description:	the metric of 64 picked points: SAD of them
+ *	Input:		the pointers to the current and previous Y frames,
+ *			the bound at present (upper-bound)
+ *	Return:	       	SAD of 64 points of two super-blocks (may not be
+ *			complete due to the shortcut)
+ *	Side effects:
+ *
+ *************************************************************************/
 /* NOTE: pick 64 points only
  *  	*---*---*---*---
  *  	--*---*---*---*-
@@ -360,36 +788,60 @@ static int16 absolute_error_SB(MEM *preBLK, MEM *curBLK)
  *  	*---*---*---*---
  * 	.....
  */
-static int16 absolute_error_SB_shortcut(MEM *preBLK, MEM *curBLK, int16 bound)
+int16 sub64_metric(MEM *preBLK, MEM *curBLK, int16 bound)
 {
-	DEBUG("absolute_error_SB_shortcut");
-	register i, data, ae, width;
-	register unsigned char *p_ptr, *c_ptr;
+	DEBUG("sub64_metric");
 
-	width = preBLK->width;
-	p_ptr = preBLK->data + preBLK->memloc;
-	c_ptr = curBLK->data + curBLK->memloc;
-	for (ae=i=0; i<8; i++) {
-		/* 1st line sample points: 0, 4, 8, 12 */
-		ae += (	abs(*c_ptr - *p_ptr) +
-			abs(*(c_ptr+4) - *(p_ptr+4)) +
-			abs(*(c_ptr+8) - *(p_ptr+8)) +
-			abs(*(c_ptr+12) - *(p_ptr+12)) );
-		if (ae>=bound) return ae;	/* shortcut check */
-		c_ptr += width;
-		p_ptr += width;
+	return (int16) use_SAD_sub64(preBLK->data + preBLK->memloc,
+		curBLK->data + curBLK->memloc, (int32) preBLK->stride,
+		(int32) bound);
+}
 
-		/* 2nd line sample points: 2, 6, 10, 14 */
-		ae += (	abs(*(c_ptr+2) - *(p_ptr+2)) +
-			abs(*(c_ptr+6) - *(p_ptr+6)) +
-			abs(*(c_ptr+10) - *(p_ptr+10)) +
-			abs(*(c_ptr+14) - *(p_ptr+14)) );
-		if (ae>=bound) return ae;	/* shortcut check */
-		c_ptr += width;
-		p_ptr += width;
-	}
+/*************************************************************************
+ *
+ *	Name:		SAD_metric()
+ *	Description:	the metric of all 256 points: SAD of them
+ *	Input:		the pointers to the current and previous Y frames,
+ *			the bound at present (upper-bound)
+ *	Return:	       	SAD/4 of two super-blocks (may not be complete due
+ *			to the shortcut)
+ *	Side effects:
+ *
+ *************************************************************************/
+/* NOTE: the SAD is divided by 4 (256 points -> 64 points), so that the
+ * thresholds in thresh.h are for all metrics, and it fits in int16 */
+int16 SAD_metric(MEM *preBLK, MEM *curBLK, int16 bound)
+{
+	DEBUG("SAD_metric");
 
-	return ae;
+	return (int16) (use_SAD_16x16(preBLK->data + preBLK->memloc,
+		curBLK->data + curBLK->memloc, (int32) preBLK->stride,
+		((int32) bound)<<2) >> 2);
+}
+
+/*************************************************************************
+ *
+ *	Name:		SATD_metric()
+ *	Description:	the metric of all 256 points: SATD (sum of absolute
+ *			Hadamard-transformed differences) of them
+ *	Input:		the pointers to the current and previous Y frames,
+ *			the bound at present (upper-bound)
+ *	Return:	       	SATD/16 of two super-blocks (may not be complete
+ *			due to the shortcut)
+ *	Side effects:
+ *
+ *************************************************************************/
+/* NOTE: divided by 4 as the orthonormal Hadamard transform, then by 4 as
+ * SAD_metric(), and clipped to MAX_AE */
+int16 SATD_metric(MEM *preBLK, MEM *curBLK, int16 bound)
+{
+	DEBUG("SATD_metric");
+	int32 ae;
+
+	ae = SATD_16x16(preBLK->data + preBLK->memloc,
+		curBLK->data + curBLK->memloc, (int32) preBLK->stride,
+		((int32) bound)<<4) >> 4;
+	return (int16) ((ae>MAX_AE) ? MAX_AE : ae);
 }
 
 /* DX and DY are positive */
@@ -398,7 +850,7 @@ static int16 absolute_error_SB_shortcut(MEM *preBLK, MEM *curBLK, int16 bound)
 	if (y<=max_y) {\
 		x = pre_x + (DX);\
 		if (x<=max_x) {\
-			preBLK->memloc = y * (Image->width[_Y]) + x;\
+			preBLK->memloc = y * (Image->stride[_Y]) + x;\
 			ae = absolute_error_SB_shortcut(preBLK, curBLK, AE);\
 			if (ae<AE) {\
 				AE = ae;\
@@ -413,7 +865,7 @@ static int16 absolute_error_SB_shortcut(MEM *preBLK, MEM *curBLK, int16 bound)
 	if (y>=0) {\
 		x = pre_x + (DX);\
 		if (x<=max_x) {\
-			preBLK->memloc = y * (Image->width[_Y]) + x;\
+			preBLK->memloc = y * (Image->stride[_Y]) + x;\
 			ae = absolute_error_SB_shortcut(preBLK, curBLK, AE);\
 			if (ae<AE) {\
 				AE = ae;\
@@ -428,7 +880,7 @@ static int16 absolute_error_SB_shortcut(MEM *preBLK, MEM *curBLK, int16 bound)
 	if (y<=max_y) {\
 		x = pre_x + (DX);\
 		if (x>=0) {\
-			preBLK->memloc = y * (Image->width[_Y]) + x;\
+			preBLK->memloc = y * (Image->stride[_Y]) + x;\
 			ae = absolute_error_SB_shortcut(preBLK, curBLK, AE);\
 			if (ae<AE) {\
 				AE = ae;\
@@ -443,7 +895,7 @@ static int16 absolute_error_SB_shortcut(MEM *preBLK, MEM *curBLK, int16 bound)
 	if (y>=0) {\
 		x = pre_x + (DX);\
 		if (x>=0) {\
-			preBLK->memloc = y * (Image->width[_Y]) + x;\
+			preBLK->memloc = y * (Image->stride[_Y]) + x;\
 			ae = absolute_error_SB_shortcut(preBLK, curBLK, AE);\
 			if (ae<AE) {\
 				AE = ae;\
@@ -852,4 +1304,648 @@ int16 my_search_ME(MEM *preBLK, MEM *curBLK)
 	MVDV = new_y - CurrentY;
 
 	return AE;
-}
\ No newline at end of file
+}
+
+/*************************************************************************
+ *
+ *	Name:		make_pyramid()
+ *	Description:	make the 2:1 and 4:1 decimated Y frames of the
+ *			previous and current Y frames (by averaging 2x2
+ *			pixels)
+ *	Input:		the pointers to the previous and current Y frames
+ *	Return:		none
+ *	Side effects:	Pre_pyramid[], Cur_pyramid[], Pyramid_width[],
+ *			Pyramid_height[] and Pyramid_made will be set
+ *
+ *************************************************************************/
+static void make_pyramid(MEM *preBLK, MEM *curBLK)
+{
+	DEBUG("make_pyramid");
+	register byte *src_ptr, *des_ptr;
+	int16 i, x, y, width, height, src_width;
+	byte *pre_src, *cur_src, *src;
+
+	pre_src = preBLK->data;
+	cur_src = curBLK->data;
+	src_width = preBLK->stride;
+	width = preBLK->width;
+	height = preBLK->height;
+	for (i=0; i<PYRAMID_LEVELS; i++) {
+		width >>= 1;
+		height >>= 1;
+		if (!Pre_pyramid[i]) {
+			/* the frame size is fixed: allocate once */
+			Pre_pyramid[i] = (byte *) malloc(width * height);
+			Cur_pyramid[i] = (byte *) malloc(width * height);
+			if ((!Pre_pyramid[i]) || (!Cur_pyramid[i])) {
+				ERROR_LINE();
+				printf("Cannot allocate the pyramid of ME.\n");
+				exit(ERROR_MEMORY);
+			}
+			Pyramid_width[i] = width;
+			Pyramid_height[i] = height;
+		}
+
+		/* average 2x2 pixels of the upper level */
+		for (src=pre_src,des_ptr=Pre_pyramid[i]; src;
+				src=(src==pre_src) ? cur_src : NULL,
+				des_ptr=Cur_pyramid[i]) {
+			for (y=0; y<height; y++) {
+				src_ptr = src + (y<<1) * src_width;
+				for (x=0; x<width; x++,src_ptr+=2)
+					*des_ptr++ = (byte) ((*src_ptr
+						+ *(src_ptr+1)
+						+ *(src_ptr+src_width)
+						+ *(src_ptr+src_width+1) + 2) >> 2);
+			}
+		}
+		pre_src = Pre_pyramid[i];
+		cur_src = Cur_pyramid[i];
+		src_width = width;
+	}
+
+	Pyramid_made = TRUE;
+}
+
+/*************************************************************************
+ *
+ *	Name:		absolute_error_NxN()
+ *	Description:	obtain SAD of two nxn blocks (in the pyramids)
+ *	Input:		the pointers to the previous and current blocks,
+ *			the width of the frames, n and the bound at present
+ *			(upper-bound)
+ *	Return:		SAD of two blocks (may not be complete due to the
+ *			shortcut)
+ *	Side effects:
+ *
+ *************************************************************************/
+static int32 absolute_error_NxN(byte *p_ptr, byte *c_ptr, int32 width,
+	int16 n, int32 bound)
+{
+	DEBUG("absolute_error_NxN");
+	register int16 i, j;
+	register int32 ae;
+
+	#ifdef CTRL_ME_STAT
+	Task->coarse++;
+	#endif
+
+	for (ae=i=0; i<n; i++) {
+		for (j=0; j<n; j++)
+			ae += abs(c_ptr[j] - p_ptr[j]);
+		if (ae>=bound) return ae;	/* shortcut check */
+		c_ptr += width;
+		p_ptr += width;
+	}
+
+	return ae;
+}
+
+/*************************************************************************
+ *
+ *	Name:	   	pyramid_search_ME()
+ *	Description:	apply hierarchical (pyramid) search algorithm to
+ *			obtain AE and MV: full search in the 4:1 decimated
+ *			frames, then refine it in the 2:1 decimated and
+ *			the original frames
+ *	Input:		the pointers to the current and previous Y frames
+ *	Return:		the found minimum absoult error
+ *	Side effects:	MVDH and MVDV may be updated, the pyramids will
+ *			be made for the first MB of a frame
+ *
+ *************************************************************************/
+/* pyramid search:
+ * search area: (0, 0) +-3 (4:1), then +-1 (2:1) and +-1 (1:1)
+ *		=> (0, 0) +-15 in all (49+9+9 points instead of 961)
+ * AE_best and (MVDH, MVDV) can be used
+ */
+int16 pyramid_search_ME(MEM *preBLK, MEM *curBLK)
+{
+	DEBUG("pyramid_search_ME");
+	int16 ae, AE;
+	int16 new_x, new_y, pre_x, pre_y;
+	int16 x, y, max_x, max_y;
+	int16 dx, dy, i, n, range, width;
+	int16 mvx, mvy, best_x, best_y;
+	int32 sad, SAD;
+	byte *c_ptr;
+
+	if (!Pyramid_made) make_pyramid(preBLK, curBLK);
+
+	/* from the 4:1 level (4x4 blocks, +-3) to the 2:1 level (8x8 blocks,
+	 * +-1 around the doubled MV) */
+	mvx = mvy = 0;
+	for (i=PYRAMID_LEVELS-1; i>=0; i--) {
+		n = 16 >> (i+1);
+		range = (i==PYRAMID_LEVELS-1) ? 3 : 1;
+		width = Pyramid_width[i];
+		max_x = width - n;
+		max_y = Pyramid_height[i] - n;
+		pre_x = (CurrentX >> (i+1)) + mvx;
+		pre_y = (CurrentY >> (i+1)) + mvy;
+		c_ptr = Cur_pyramid[i] + (CurrentY >> (i+1)) * width
+			+ (CurrentX >> (i+1));
+
+		/* the center first: prefer the shorter MV */
+		best_x = pre_x;
+		best_y = pre_y;
+		SAD = absolute_error_NxN(Pre_pyramid[i] + pre_y * width + pre_x,
+			c_ptr, width, n, (int32) 0x7fffffff);
+		for (dy=-range; dy<=range; dy++) {
+			y = pre_y + dy;
+			if ((y<0) || (y>max_y)) continue;
+			for (dx=-range; dx<=range; dx++) {
+				x = pre_x + dx;
+				if ((x<0) || (x>max_x) || (!dx && !dy))
+					continue;
+				sad = absolute_error_NxN(
+					Pre_pyramid[i] + y * width + x,
+					c_ptr, width, n, SAD);
+				if (sad<SAD) {
+					SAD = sad;
+					best_x = x;
+					best_y = y;
+				}
+			}
+		}
+
+		/* double the MV for the next level */
+		mvx = (best_x - (CurrentX >> (i+1))) * 2;
+		mvy = (best_y - (CurrentY >> (i+1))) * 2;
+	}
+
+	/* the original level: +-1 around the doubled MV, by the metric of
+	 * -c and compared with AE_best at (MVDH, MVDV) */
+	max_x = preBLK->width - 16;
+	max_y = preBLK->height - 16;
+
+	AE = AE_best;
+	new_x = CurrentX + MVDH;
+	new_y = CurrentY + MVDV;
+
+	pre_x = CurrentX + mvx;
+	pre_y = CurrentY + mvy;
+	if ((mvx!=MVDH) || (mvy!=MVDV)) P_P(0, 0);
+	SEARCH_8_POINTS(1);
+
+	MVDH = new_x - CurrentX;
+	MVDV = new_y - CurrentY;
+
+	return AE;
+}
+
+
+/* check (X, Y) if it is in the frame, in +-15 and not checked */
+#define CHECK_POINT(X, Y) {\
+	x = (X);\
+	y = (Y);\
+	if ((x>=0) && (x<=max_x) && (y>=0) && (y<=max_y) &&\
+	    (abs(x-CurrentX)<=15) && (abs(y-CurrentY)<=15)) {\
+		for (i=0; i<n; i++)\
+			if ((checked_x[i]==x) && (checked_y[i]==y)) break;\
+		if (i==n) {\
+			if (n<EPZS_MAX_POINTS) {\
+				checked_x[n] = x;\
+				checked_y[n++] = y;\
+			}\
+			preBLK->memloc = y * (Image->stride[_Y]) + x;\
+			ae = absolute_error_SB_shortcut(preBLK, curBLK, AE);\
+			if (ae<AE) {\
+				AE = ae;\
+				new_x = x;\
+				new_y = y;\
+			}\
+		}\
+	}}
+
+/* add the MV and AE of the MB at (MX, MY) in the map (of frame F) to the
+ * predictors */
+#define ADD_PREDICTOR(MX, MY, F) {\
+	if (((MX)>=0) && ((MX)<Map_width) && ((MY)>=0)) {\
+		k = (MY) * Map_width + (MX);\
+		if (Map_frame[k]==(F)) {\
+			pred_x[m] = CurrentX + MVH_map[k];\
+			pred_y[m++] = CurrentY + MVV_map[k];\
+			if (AE_map[k]<AE_min) AE_min = AE_map[k];\
+		}\
+	}}
+
+/*************************************************************************
+ *
+ *	Name:	   	EPZS_search_ME()
+ *	Description:	apply EPZS (enhanced predictive zonal search) to
+ *			obtain AE and MV: check the MVs of the left, top
+ *			and top-right MBs and the co-located MB in the
+ *			previous frame, and refine the best one by a small
+ *			diamond, with the early termination by the AEs
+ *			of these MBs
+ *	Input:		the pointers to the current and previous Y frames
+ *	Return:		the found minimum absoult error
+ *	Side effects:	MVDH and MVDV may be updated
+ *
+ *************************************************************************/
+/* EPZS search:
+ * search area: (0, 0) +-15
+ * AE_best and (MVDH, MVDV) (the co-located MV in the previous frame) are
+ * used, AE_zero is used for (0, 0)
+ */
+#define EPZS_MAX_POINTS 32
+int16 EPZS_search_ME(MEM *preBLK, MEM *curBLK)
+{
+	DEBUG("EPZS_search_ME");
+	int16 ae, AE, AE_min, threshold;
+	int16 new_x, new_y, pre_x, pre_y;
+	int16 x, y, max_x, max_y;
+	int16 i, k, m, n, mb_x, mb_y;
+	int16 pred_x[4], pred_y[4];
+	int16 checked_x[EPZS_MAX_POINTS], checked_y[EPZS_MAX_POINTS];
+
+	/* x range of the upper-left point: 0, ..., max_x */
+	/* y range of the upper-left point: 0, ..., max_y */
+	max_x = preBLK->width - 16;
+	max_y = preBLK->height - 16;
+
+	/* (0, 0) and (MVDH, MVDV) have been checked in obtain_MTYPE() */
+	n = 0;
+	checked_x[n] = CurrentX;
+	checked_y[n++] = CurrentY;
+	if ((MVDH!=0) || (MVDV!=0)) {
+		AE = AE_best;
+		checked_x[n] = CurrentX + MVDH;
+		checked_y[n++] = CurrentY + MVDV;
+	} else	AE = AE_zero;
+	new_x = CurrentX + MVDH;
+	new_y = CurrentY + MVDV;
+
+	/* the predictors: left, top and top-right MBs (done in this frame)
+	 * and the co-located MB (in the previous frame) */
+	mb_x = CurrentX >> 4;
+	mb_y = CurrentY >> 4;
+	m = 0;
+	AE_min = MAX_AE;
+	ADD_PREDICTOR(mb_x-1, mb_y, ME_frame);
+	ADD_PREDICTOR(mb_x, mb_y-1, ME_frame);
+	ADD_PREDICTOR(mb_x+1, mb_y-1, ME_frame);
+	ADD_PREDICTOR(mb_x, mb_y, ME_frame-1);
+
+	/* adaptive threshold: stop if AE is as good as the neighbors' */
+	threshold = (AE_min==MAX_AE) ? (AE_TCOEFF_THRESHOLD<<1)
+		: AE_min + (AE_min>>2);
+	if (threshold<AE_TCOEFF_THRESHOLD) threshold = AE_TCOEFF_THRESHOLD;
+	if (AE<=threshold) {
+		MVDH = new_x - CurrentX;
+		MVDV = new_y - CurrentY;
+		return AE;
+	}
+
+	/* check the predictors */
+	while (m--) CHECK_POINT(pred_x[m], pred_y[m]);
+
+	/* refine the best one by the small diamond until it is the center */
+	if (AE>threshold) {
+		do {
+			pre_x = new_x;
+			pre_y = new_y;
+			CHECK_POINT(pre_x, pre_y-1);
+			CHECK_POINT(pre_x-1, pre_y);
+			CHECK_POINT(pre_x+1, pre_y);
+			CHECK_POINT(pre_x, pre_y+1);
+		} while (((new_x!=pre_x) || (new_y!=pre_y)) &&
+			(n<EPZS_MAX_POINTS));
+	}
+
+	MVDH = new_x - CurrentX;
+	MVDV = new_y - CurrentY;
+
+	return AE;
+}
+
+/* (pre_x+DX, pre_y+DY) is within (CurrentX, CurrentY) +-15 */
+#define IN_WINDOW(DX, DY) \
+	((abs(pre_x+(DX)-CurrentX)<=15) && (abs(pre_y+(DY)-CurrentY)<=15))
+
+/* search the 8 points of the large diamond around (pre_x, pre_y) */
+#define SEARCH_LARGE_DIAMOND {\
+	if (IN_WINDOW( 0, -2)) P_N( 0, -2);\
+	if (IN_WINDOW(-1, -1)) N_N(-1, -1);\
+	if (IN_WINDOW( 1, -1)) P_N( 1, -1);\
+	if (IN_WINDOW(-2,  0)) N_P(-2,  0);\
+	if (IN_WINDOW( 2,  0)) P_P( 2,  0);\
+	if (IN_WINDOW(-1,  1)) N_P(-1,  1);\
+	if (IN_WINDOW( 1,  1)) P_P( 1,  1);\
+	if (IN_WINDOW( 0,  2)) P_P( 0,  2);\
+	}
+
+/* search the 4 points of the small diamond around (pre_x, pre_y) */
+#define SEARCH_SMALL_DIAMOND {\
+	if (IN_WINDOW( 0, -1)) P_N( 0, -1);\
+	if (IN_WINDOW(-1,  0)) N_P(-1,  0);\
+	if (IN_WINDOW( 1,  0)) P_P( 1,  0);\
+	if (IN_WINDOW( 0,  1)) P_P( 0,  1);\
+	}
+
+/* search the 6 points of the hexagon around (pre_x, pre_y) */
+#define SEARCH_HEXAGON {\
+	if (IN_WINDOW(-1, -2)) N_N(-1, -2);\
+	if (IN_WINDOW( 1, -2)) P_N( 1, -2);\
+	if (IN_WINDOW(-2,  0)) N_P(-2,  0);\
+	if (IN_WINDOW( 2,  0)) P_P( 2,  0);\
+	if (IN_WINDOW(-1,  2)) N_P(-1,  2);\
+	if (IN_WINDOW( 1,  2)) P_P( 1,  2);\
+	}
+
+/*************************************************************************
+ *
+ *	Name:	   	diamond_search_ME()
+ *	Description:	apply diamond search algorithm to obtain AE and MV:
+ *			move the large diamond until its center is the
+ *			best, then search the small diamond
+ *	Input:		the pointers to the current and previous Y frames
+ *	Return:		the found minimum absoult error
+ *	Side effects:	MVDH and MVDV may be updated
+ *
+ *************************************************************************/
+/* diamond search:
+ * search area: (0, 0) +-15
+ * AE_best and (MVDH, MVDV) are used as the start point
+ */
+int16 diamond_search_ME(MEM *preBLK, MEM *curBLK)
+{
+	DEBUG("diamond_search_ME");
+	int16 ae, AE;
+	int16 new_x, new_y, pre_x, pre_y;
+	int16 x, y, max_x, max_y;
+
+	/* x range of the upper-left point: 0, ..., max_x */
+	/* y range of the upper-left point: 0, ..., max_y */
+	max_x = preBLK->width - 16;
+	max_y = preBLK->height - 16;
+
+	/* start from (MVDH, MVDV) or (0, 0) */
+	AE = ((MVDH!=0) || (MVDV!=0)) ? AE_best : AE_zero;
+	new_x = CurrentX + MVDH;
+	new_y = CurrentY + MVDV;
+
+	/* large diamond: each move makes AE smaller */
+	do {
+		pre_x = new_x;
+		pre_y = new_y;
+		SEARCH_LARGE_DIAMOND;
+	} while ((new_x!=pre_x) || (new_y!=pre_y));
+
+	/* small diamond */
+	SEARCH_SMALL_DIAMOND;
+
+	MVDH = new_x - CurrentX;
+	MVDV = new_y - CurrentY;
+
+	return AE;
+}
+
+/*************************************************************************
+ *
+ *	Name:	   	hexagon_search_ME()
+ *	Description:	apply hexagon-based search algorithm to obtain AE
+ *			and MV: move the hexagon until its center is the
+ *			best, then search the small diamond
+ *	Input:		the pointers to the current and previous Y frames
+ *	Return:		the found minimum absoult error
+ *	Side effects:	MVDH and MVDV may be updated
+ *
+ *************************************************************************/
+/* hexagon search:
+ * search area: (0, 0) +-15
+ * AE_best and (MVDH, MVDV) are used as the start point
+ */
+int16 hexagon_search_ME(MEM *preBLK, MEM *curBLK)
+{
+	DEBUG("hexagon_search_ME");
+	int16 ae, AE;
+	int16 new_x, new_y, pre_x, pre_y;
+	int16 x, y, max_x, max_y;
+
+	/* x range of the upper-left point: 0, ..., max_x */
+	/* y range of the upper-left point: 0, ..., max_y */
+	max_x = preBLK->width - 16;
+	max_y = preBLK->height - 16;
+
+	/* start from (MVDH, MVDV) or (0, 0) */
+	AE = ((MVDH!=0) || (MVDV!=0)) ? AE_best : AE_zero;
+	new_x = CurrentX + MVDH;
+	new_y = CurrentY + MVDV;
+
+	/* hexagon: each move makes AE smaller */
+	do {
+		pre_x = new_x;
+		pre_y = new_y;
+		SEARCH_HEXAGON;
+	} while ((new_x!=pre_x) || (new_y!=pre_y));
+
+	/* small diamond */
+	SEARCH_SMALL_DIAMOND;
+
+	MVDH = new_x - CurrentX;
+	MVDV = new_y - CurrentY;
+
+	return AE;
+}
+
+/*************************************************************************
+ *
+ *	Name:		block_sum()
+ *	Description:	obtain the sum of the points of a super-block used
+ *			by the metric of -c (64 picked points of
+ *			sub64_metric() or all 256 points)
+ *	Input:		the pointer to the super-block and the stride of
+ *			the frame
+ *	Return:		the sum
+ *	Side effects:
+ *
+ *************************************************************************/
+static int32 block_sum(byte *ptr, int32 stride)
+{
+	DEBUG("block_sum");
+	register int16 i, j;
+	register int32 sum;
+
+	sum = 0;
+	if (default_me_metric==sub64_metric) {
+		for (i=0; i<16; i++,ptr+=stride)
+			for (j=(i&1)<<1; j<16; j+=4)
+				sum += ptr[j];
+	} else {
+		for (i=0; i<16; i++,ptr+=stride)
+			for (j=0; j<16; j++)
+				sum += ptr[j];
+	}
+
+	return sum;
+}
+
+/*************************************************************************
+ *
+ *	Name:		make_block_sum()
+ *	Description:	make the sums of the super-blocks at all positions
+ *			of the previous Y frame (the points as block_sum())
+ *	Input:		the pointer to the previous Y frame
+ *	Return:		none
+ *	Side effects:	Block_sum[], Block_sum_shift and Block_sum_made
+ *			will be set
+ *
+ *************************************************************************/
+/* NOTE: |sum(cur) - sum(pre)| <= SAD of the same points, and
+ *	 |sum(cur) - sum(pre)| <= SATD (the sum of |DC| of 4x4 blocks),
+ * so the lower bound of the metrics (scaled to 64 points) is
+ *	 |sum(cur) - sum(pre)| >> 0 (sub64), 2 (SAD) or 4 (SATD)
+ */
+static void make_block_sum(MEM *preBLK)
+{
+	DEBUG("make_block_sum");
+	register byte *ptr;
+	register int32 *sum_ptr;
+	int16 i, x, y, width, height, stride;
+
+	width = preBLK->width;
+	height = preBLK->height;
+	stride = preBLK->stride;
+	if (!Block_sum) {
+		Block_sum = (int32 *) malloc(width * height * sizeof(int32));
+		Row_sum = (int32 *) malloc(width * height * sizeof(int32));
+		if ((!Block_sum) || (!Row_sum)) {
+			ERROR_LINE();
+			printf("Cannot allocate the block sums of ME.\n");
+			exit(ERROR_MEMORY);
+		}
+	}
+
+	if (default_me_metric==sub64_metric) {
+		/* the sum of the points 0, 4, 8, 12 in a line */
+		for (y=0; y<height; y++) {
+			ptr = preBLK->data + y * stride;
+			sum_ptr = Row_sum + y * width;
+			for (x=0; x<=width-13; x++)
+				sum_ptr[x] = ptr[x] + ptr[x+4] + ptr[x+8]
+					+ ptr[x+12];
+		}
+		/* the sum of the even (or odd) lines in 16 lines */
+		for (y=0; y<=height-15; y++) {
+			sum_ptr = Block_sum + y * width;
+			for (x=0; x<=width-13; x++)
+				for (sum_ptr[x]=i=0; i<16; i+=2)
+					sum_ptr[x] += Row_sum[(y+i)*width + x];
+		}
+		/* the even lines at x and the odd lines at x+2 */
+		for (y=0; y<=height-16; y++) {
+			sum_ptr = Block_sum + y * width;
+			for (x=0; x<=width-16; x++)
+				sum_ptr[x] += sum_ptr[width+x+2];
+		}
+		Block_sum_shift = 0;
+	} else {
+		/* the sum of 16 points in a line */
+		for (y=0; y<height; y++) {
+			ptr = preBLK->data + y * stride;
+			sum_ptr = Row_sum + y * width;
+			for (x=0; x<=width-16; x++)
+				for (sum_ptr[x]=i=0; i<16; i++)
+					sum_ptr[x] += ptr[x+i];
+		}
+		/* the sum of 16 lines */
+		for (y=0; y<=height-16; y++) {
+			sum_ptr = Block_sum + y * width;
+			for (x=0; x<=width-16; x++)
+				for (sum_ptr[x]=i=0; i<16; i++)
+					sum_ptr[x] += Row_sum[(y+i)*width + x];
+		}
+		Block_sum_shift = (default_me_metric==SAD_metric) ? 2 : 4;
+	}
+
+	Block_sum_made = TRUE;
+}
+
+/* check (pre_x+DX, pre_y+DY) only if its lower bound of AE < AE */
+#define SEA_POINT(DX, DY) {\
+	y = pre_y + (DY);\
+	x = pre_x + (DX);\
+	if ((y>=0) && (y<=max_y) && (x>=0) && (x<=max_x) &&\
+	    ((abs(cur_sum - Block_sum[y*width+x]) >> Block_sum_shift) < AE)) {\
+		preBLK->memloc = y * stride + x;\
+		ae = absolute_error_SB_shortcut(preBLK, curBLK, AE);\
+		if (ae<AE) {\
+			AE = ae;\
+			new_x = x;\
+			new_y = y;\
+		}\
+	}}
+
+/*************************************************************************
+ *
+ *	Name:	   	SEA_search_ME()
+ *	Description:	apply successive elimination algorithm (exact full
+ *			search) to obtain AE and MV: the points with the
+ *			lower bound of AE (by the block sums) >= AE at
+ *			present are skipped
+ *	Input:		the pointers to the current and previous Y frames
+ *	Return:		the found minimum absoult error
+ *	Side effects:	MVDH and MVDV may be updated, the block sums will
+ *			be made for the first MB of a frame
+ *
+ *************************************************************************/
+/* SEA search:
+ * search area: (0, 0) +-15
+ * the same order as full_search_ME(), and the skipped points would not
+ * be chosen by it (their AE >= AE at present), so MVs and AE are the same
+ * AE_best and (MVDH, MVDV) can be used
+ */
+int16 SEA_search_ME(MEM *preBLK, MEM *curBLK)
+{
+	DEBUG("SEA_search_ME");
+	int16 ae, AE;
+	int16 new_x, new_y, pre_x, pre_y;
+	int16 x, y, max_x, max_y;
+	int16 dx, dy, width, stride;
+	int32 cur_sum;
+
+	if (!Block_sum_made) make_block_sum(preBLK);
+
+	/* x range of the upper-left point: 0, ..., max_x */
+	/* y range of the upper-left point: 0, ..., max_y */
+	width = preBLK->width;
+	stride = preBLK->stride;
+	max_x = preBLK->width - 16;
+	max_y = preBLK->height - 16;
+	cur_sum = block_sum(curBLK->data + curBLK->memloc, stride);
+
+	AE = AE_best;
+	new_x = CurrentX + MVDH;
+	new_y = CurrentY + MVDV;
+
+	/* MV start from (0, 0) */
+	pre_x = CurrentX;
+	pre_y = CurrentY;
+
+	for (dx=1; dx<=15; dx++) {
+		/* (x, y) = (+, +) */
+		for (dy=0; dy<=15; dy++)
+			SEA_POINT(dx, dy);
+
+		/* (x, y) = (+, -) */
+		for (dy=-1; dy>=-15; dy--)
+			SEA_POINT(dx, dy);
+	}
+
+	for (dx=0; dx>=-15; dx--) {
+		/* (x, y) = (-, +) */
+		for (dy=0; dy<=15; dy++)
+			SEA_POINT(dx, dy);
+
+		/* (x, y) = (-, -) */
+		for (dy=-1; dy>=-15; dy--)
+			SEA_POINT(dx, dy);
+	}
+
+	MVDH = new_x - CurrentX;
+	MVDV = new_y - CurrentY;
+
+	return AE;
+}
\ No newline at end of file
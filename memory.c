@@ -10,7 +10,7 @@
 
 /*************************************************************************/
 /* public */
-extern MEM *make_MEM(int16 width, int16 height);
+extern MEM *make_MEM(int16 width, int16 height, int16 border);
 extern MEM *make_MEM_ptr(int16 width, int16 height);
 extern void free_MEM(MEM *mem);
 extern FSTORE *make_FS(int16 width, int16 height);
@@ -19,7 +19,9 @@ extern void free_FS(FSTORE *fs);
 extern IMAGE *make_IMAGE(void);
 extern void alloc_mem_encoder(void);
 extern void alloc_mem_decoder(void);
+extern void free_mem_encoder(void);
 extern void copy_FS(FSTORE *fs_des, FSTORE *fs_src);
+extern void extend_FS(FSTORE *fs);
 extern void copy_block(MEM *des, MEM *src);
 extern void copy_MB(FSTORE *des, FSTORE *src);
 extern void disturb_MB(FSTORE *des, FSTORE *src1, FSTORE *src2);
@@ -28,64 +30,45 @@ extern void write_block(MEM *mem, int16 *block);
 extern void load_residual(MEM *mem, int16 *block, boolean with_filter);
 extern void save_residual(MEM *mem, int16 *block, boolean with_filter);
 
-extern IMAGE *Image;		/* global info. of image */
-
-/*************************************************************************/
-/* Look-up-table for obtaining memloc in MEM: */
-
-/* Position of the upper-left connor in the GN-th GOB for Y-type */
-/* The first entry [0] is useless => [1] is the first actural entry */
-extern int32 YGOB_memloc[12+1];
-/* Position of the upper-left connor in the GN-th GOB for Cb, Cr */
-/* The first entry [0] is useless => [1] is the first actural entry */
-extern int32 GOB_memloc[12+1];
-
-/* Position of the upper-left connor in the CurrentMB-th MB for Y-type */
-extern int32 YMB_memloc[33];
-/* Position of the upper-left connor in the CurrentMB-th MB for Cb, Cr */
-extern int32 MB_memloc[33];
-
-/* Position of the upper-left connor in the Current_B-th block */
-extern int32 B_memloc[6];
-
-/* Distance due to MVDV for Y-type */
-extern int32 YMVDV_memloc[31];
-/* Distance due to MVDV for Cb, Cr */
-extern int32 MVDV_memloc[31];
-
-extern int16 Current_B;
+/* Current Block ID (of this thread, see libh261.c) */
+extern THREAD_LOCAL int16 Current_B;
 
 /*************************************************************************/
 /* private */
-static void loop_filter(unsigned char *memloc, int16 *output, int16 mem_width);
+static void loop_filter(unsigned char *memloc, int16 *output, int16 stride);
 
 /*************************************************************************
  *
  *	Name:		make_MEM()
  *	Description:	make a MEM structure to store one conponent of frame
- *	Input:          the width and height of frame
- *			(the size of data is (width * height))
+ *	Input:          the width and height of frame, and the pels of
+ *			the border around it (the size of data is
+ *			(width + 2*border) * (height + 2*border))
  *	Return:		the pointer to the constructed MEM structure
  *	Side effects:   the constructed structure will have initial value
  *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
  *
  *************************************************************************/
-MEM *make_MEM(int16 width, int16 height)
+MEM *make_MEM(int16 width, int16 height, int16 border)
 {
 	DEBUG("make_MEM");
 	MEM *mem;
-	int32 size = (int32) width * height * sizeof(unsigned char);
+	int32 size = (int32) (width + 2*border) * (height + 2*border)
+			* sizeof(unsigned char);
 
 	MAKE_STRUCTURE(mem, MEM);
 	mem->width = width;
 	mem->height = height;
-	if (!(mem->data=(unsigned char *) malloc(size))) {
+	mem->border = border;
+	mem->stride = width + 2*border;
+	if (!(mem->base=(unsigned char *) malloc(size))) {
 		ERROR_LINE();
 		printf("Cannot allocate data storage for MEM.\n");
 		exit(ERROR_MEMORY);
 	}
+	mem->data = mem->base + (int32) border * mem->stride + border;
 	mem->memloc = 0;
-	memset(mem->data, 0, size);
+	memset(mem->base, 0, size);
 
 	return mem;
 }
@@ -109,7 +92,10 @@ MEM *make_MEM_ptr(int16 width, int16 height)
 	MAKE_STRUCTURE(mem, MEM);
 	mem->width = width;
 	mem->height = height;
+	mem->border = 0;
+	mem->stride = width;
 	mem->memloc = 0;
+	mem->data = mem->base = NULL;
 
 	return mem;
 }
@@ -128,7 +114,7 @@ void free_MEM(MEM *mem)
 {
 	DEBUG("free_MEM");
 
-	free(mem->data);
+	free(mem->base);
 	free(mem);
 }
 
@@ -136,6 +122,7 @@ void free_MEM(MEM *mem)
  *
  *	Name:		make_FS()
  *	Description:	make a FSTORE structure to store a frame
+ *			(with the border of FS_BORDER pels)
  *	Input:          the width and height of Y of frame store
  *	Return:		the pointer to the constructed FSTORE structure
  *	Side effects:   the constructed structure will have initial value
@@ -150,9 +137,9 @@ FSTORE *make_FS(int16 width, int16 height)
 	int16 height_2 = height >> 1;
 
 	MAKE_STRUCTURE(fs, FSTORE);
-	fs->fs[_Y] = make_MEM(width, height);
-	fs->fs[_Cb] = make_MEM(width_2, height_2);
-	fs->fs[_Cr] = make_MEM(width_2, height_2);
+	fs->fs[_Y] = make_MEM(width, height, FS_BORDER);
+	fs->fs[_Cb] = make_MEM(width_2, height_2, FS_BORDER>>1);
+	fs->fs[_Cr] = make_MEM(width_2, height_2, FS_BORDER>>1);
 
 	return fs;
 }
@@ -234,6 +221,7 @@ IMAGE *make_IMAGE(void)
 	/* input frame files and output frame files (reconstructed files) */
 	image->read_from_files = image->write_to_files = FALSE;
 	*image->input_frame_prefix = *image->output_frame_prefix = '\0';
+	image->input_file_type = image->output_file_type = _FILES;
 	for (type=0; type<NUMBER_OF_COMPONENTS; type++) {
 		image->height[type] = image->width[type] = 0;
 		*image->frame_suffix[type] = '\0';
@@ -255,11 +243,6 @@ IMAGE *make_IMAGE(void)
 void alloc_mem_encoder(void)
 {
 	DEBUG("alloc_mem_encoder");
-	extern int16 Number_GOB;
-	extern int16 Number_MB;
-	extern FSTORE *ori_frame, *rec_frame, *rec_frame_backup, *ref_frame;
-	extern int16 *MTYPE_frame, *MVDH_frame, *MVDV_frame, *Last_update;
-	extern int16 Size_frame;
 
 	/* make structure with size of (# of MB in a frame) */
 	Size_frame = Number_GOB * Number_MB * sizeof(int16);
@@ -274,10 +257,9 @@ void alloc_mem_encoder(void)
 	}
 
 	/* make frame stores */
-	ori_frame = make_FS(Image->width[_Y], Image->height[_Y]);
+	/* (ori_frame is got by load_frame(), see start_frame_loader()) */
 	rec_frame = make_FS(Image->width[_Y], Image->height[_Y]);
-	rec_frame_backup = make_FS(Image->width[_Y], Image->height[_Y]);
-	ref_frame = make_FS_ptr(Image->width[_Y], Image->height[_Y]);
+	ref_frame = make_FS(Image->width[_Y], Image->height[_Y]);
 }
 
 /*************************************************************************
@@ -293,15 +275,33 @@ void alloc_mem_encoder(void)
 void alloc_mem_decoder(void)
 {
 	DEBUG("alloc_mem_decoder");
-	extern int16 Number_GOB;
-	extern int16 Number_MB;
-	extern FSTORE *last_frame, *reco_frame;
-	extern int16 *MTYPE_frame, *MVDH_frame, *MVDV_frame;
-	extern int16 Size_frame;
 
-	/* make frame stores */
-	last_frame = make_FS(Image->width[_Y], Image->height[_Y]);
-	reco_frame = make_FS(Image->width[_Y], Image->height[_Y]);
+	/* get frame stores (see start_frame_saver()) */
+	last_frame = get_frame_buffer();
+	reco_frame = get_frame_buffer();
+}
+
+/*************************************************************************
+ *
+ *	Name:		free_mem_encoder()
+ *	Description:	free memory structures of alloc_mem_encoder()
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	the structures will be freed
+ *
+ *************************************************************************/
+void free_mem_encoder(void)
+{
+	DEBUG("free_mem_encoder");
+
+	free(MTYPE_frame);
+	free(MVDH_frame);
+	free(MVDV_frame);
+	free(Last_update);
+	free_FS(rec_frame);
+	free_FS(ref_frame);
+	MTYPE_frame = MVDH_frame = MVDV_frame = Last_update = NULL;
+	rec_frame = ref_frame = NULL;
 }
 
 /*************************************************************************
@@ -318,10 +318,55 @@ void alloc_mem_decoder(void)
 void copy_FS(FSTORE *fs_des, FSTORE *fs_src)
 {
 	DEBUG("copy_FS");
+	ComponentType type;
+	MEM *mem;
+
+	/* the same size of frame stores: copy them with the borders */
+	for (type=0; type<NUMBER_OF_COMPONENTS; type++) {
+		mem = fs_src->fs[type];
+		memcpy(fs_des->fs[type]->base, mem->base, (int32) mem->stride
+			* (mem->height + 2*mem->border) * sizeof(unsigned char));
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		extend_FS()
+ *	Description:	fill the borders of a frame store by replicating
+ *			the pels at the edges of the picture
+ *	Input:		the pointer to the frame store
+ *	Return:		none
+ *	Side effects:	the borders of fs will be changed
+ *
+ *************************************************************************/
+void extend_FS(FSTORE *fs)
+{
+	DEBUG("extend_FS");
+	ComponentType type;
+	int16 i, border, width, stride;
+	unsigned char *ptr;
+	MEM *mem;
 
-	memcpy(fs_des->fs[_Y]->data, fs_src->fs[_Y]->data, Image->len[_Y]);
-	memcpy(fs_des->fs[_Cb]->data, fs_src->fs[_Cb]->data,Image->len[_Cb]);
-	memcpy(fs_des->fs[_Cr]->data, fs_src->fs[_Cr]->data, Image->len[_Cr]);
+	for (type=0; type<NUMBER_OF_COMPONENTS; type++) {
+		mem = fs->fs[type];
+		if (!(border = mem->border)) continue;
+		width = mem->width;
+		stride = mem->stride;
+
+		/* the left and right borders of each line */
+		for (i=0,ptr=mem->data; i<mem->height; i++,ptr+=stride) {
+			memset(ptr - border, ptr[0], border);
+			memset(ptr + width, ptr[width-1], border);
+		}
+
+		/* the top and bottom borders (with the corners) */
+		ptr = mem->data - border;
+		for (i=1; i<=border; i++)
+			memcpy(ptr - i*stride, ptr, stride);
+		ptr += (int32) (mem->height - 1) * stride;
+		for (i=1; i<=border; i++)
+			memcpy(ptr + i*stride, ptr, stride);
+	}
 }
 
 /*************************************************************************
@@ -344,8 +389,8 @@ void copy_block(MEM *des, MEM *src)
 	src_ptr = src->data + src->memloc + B_memloc[Current_B];
 	for (i=0; i<8; i++) {
 		memcpy(des_ptr, src_ptr, 8*sizeof(unsigned char));
-		des_ptr += des->width;
-		src_ptr += src->width;
+		des_ptr += des->stride;
+		src_ptr += src->stride;
 	}
 }
 
@@ -370,24 +415,24 @@ void copy_MB(FSTORE *des, FSTORE *src)
 	src_ptr = src->fs[_Y]->data + src->fs[_Y]->memloc;
 	for (i=0; i<16; i++) {
 		memcpy(des_ptr, src_ptr, 16*sizeof(unsigned char));
-		des_ptr += Image->width[_Y];
-		src_ptr += Image->width[_Y];
+		des_ptr += Image->stride[_Y];
+		src_ptr += Image->stride[_Y];
 	}
 
 	des_ptr = des->fs[_Cb]->data + des->fs[_Cb]->memloc;
 	src_ptr = src->fs[_Cb]->data + src->fs[_Cb]->memloc;
 	for (i=0; i<8; i++) {
 		memcpy(des_ptr, src_ptr, 8*sizeof(unsigned char));
-		des_ptr += Image->width[_Cb];
-		src_ptr += Image->width[_Cb];
+		des_ptr += Image->stride[_Cb];
+		src_ptr += Image->stride[_Cb];
 	}
 
 	des_ptr = des->fs[_Cr]->data + des->fs[_Cr]->memloc;
 	src_ptr = src->fs[_Cr]->data + src->fs[_Cr]->memloc;
 	for (i=0; i<8; i++) {
 		memcpy(des_ptr, src_ptr, 8*sizeof(unsigned char));
-		des_ptr += Image->width[_Cr];
-		src_ptr += Image->width[_Cr];
+		des_ptr += Image->stride[_Cr];
+		src_ptr += Image->stride[_Cr];
 	}
 }
 
@@ -412,7 +457,7 @@ void read_MB(int16 MBbuf[6][64], FSTORE *Fs)
 
 	/* Y */
 	loc0 = Fs->fs[_Y]->data + Fs->fs[_Y]->memloc;
-	dist = Fs->fs[_Y]->width - 16;
+	dist = Fs->fs[_Y]->stride - 16;
 
 	/* for Y1, Y2 blocks */
 	block0 = MBbuf[0];
@@ -434,7 +479,7 @@ void read_MB(int16 MBbuf[6][64], FSTORE *Fs)
 	/* Cb and Cr */
 	loc0 = Fs->fs[_Cb]->data + Fs->fs[_Cb]->memloc;
 	loc1 = Fs->fs[_Cr]->data + Fs->fs[_Cr]->memloc;
-	dist = Fs->fs[_Cb]->width - 8;
+	dist = Fs->fs[_Cb]->stride - 8;
 
 	block0 = MBbuf[4];
 	block1 = MBbuf[5];
@@ -469,7 +514,7 @@ void write_block(MEM *mem, int16 *block)
 	for (i=0; i<BLOCKHEIGHT; i++) {
 		for (j=0; j<BLOCKWIDTH; j++,block++,loc++)
 			*loc =  *block;
-		loc += (mem->width - BLOCKWIDTH);
+		loc += (mem->stride - BLOCKWIDTH);
 	}
 }
 
@@ -497,7 +542,7 @@ void load_residual(MEM *mem, int16 *block, boolean with_filter)
 	loc = mem->data + mem->memloc + B_memloc[Current_B];
 	if (with_filter) {
 		/* Filter MC */
-		loop_filter(loc, temp, mem->width);
+		loop_filter(loc, temp, mem->stride);
 
 		for (ptr=temp,i=0; i<BLOCKHEIGHT; i++)
 			for (j=0; j<BLOCKWIDTH; j++,block++,ptr++)
@@ -507,7 +552,7 @@ void load_residual(MEM *mem, int16 *block, boolean with_filter)
 		for (i=0; i<BLOCKHEIGHT; i++) {
 			for (j=0; j<BLOCKWIDTH; j++,block++,loc++)
 				*block -= *loc;
-			loc += (mem->width - BLOCKWIDTH);
+			loc += (mem->stride - BLOCKWIDTH);
 		}
 	}
 }
@@ -535,7 +580,7 @@ void save_residual(MEM *mem, int16 *block, boolean with_filter)
 	loc = mem->data + mem->memloc + B_memloc[Current_B];
 	if (with_filter) {
 		/* Filter MC */
-		loop_filter(loc, temp, mem->width);
+		loop_filter(loc, temp, mem->stride);
 
 		for (ptr=temp,i=0; i<BLOCKHEIGHT; i++)
 			for (j=0; j<BLOCKWIDTH; j++,block++,ptr++)
@@ -545,7 +590,7 @@ void save_residual(MEM *mem, int16 *block, boolean with_filter)
 		for (i=0; i<BLOCKHEIGHT; i++) {
 			for (j=0; j<BLOCKWIDTH; j++,block++,loc++)
 				*block += *loc;
-			loc += (mem->width - BLOCKWIDTH);
+			loc += (mem->stride - BLOCKWIDTH);
 		}
 	}
 }
@@ -555,13 +600,13 @@ void save_residual(MEM *mem, int16 *block, boolean with_filter)
  *	Name:		loop_filter()
  *	Description:	obatin a block going thru the loop filter
  *	Input:		the pointers to a block in a MEM structure and
- *			the output block, and the width of MEM structure
+ *			the output block, and the stride of MEM structure
  *	Return:		none
  *	Side effects:	the output block will be stored
  *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
  *
  *************************************************************************/
-static void loop_filter(unsigned char *memloc, int16 *output, int16 mem_width)
+static void loop_filter(unsigned char *memloc, int16 *output, int16 stride)
 {
 	DEBUG("loop_filter");
 	int16 i, j;
@@ -585,7 +630,7 @@ static void loop_filter(unsigned char *memloc, int16 *output, int16 mem_width)
 
 		/* at block edge */
 		*(ptr++) = (*(memloc++) << 2);
-		memloc += (mem_width - BLOCKWIDTH);
+		memloc += (stride - BLOCKWIDTH);
 	}
 
 	/* 1-D filter: handle with each column (vertical line) */
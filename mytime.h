@@ -12,32 +12,23 @@
 #include <time.h>
 #include "ctrl.h"	/* set timer or not ? */
 
-#include <sys/timeb.h>
-#define TIME    struct timeb
-#define get_time(t)     ftime(&t)
-#define diff_time(t2, t1)       (((long)t2.time*1000+t2.millitm)-(t1.time*1000+t1.millitm))
+/* a monotonic clock: diff_time() in milliseconds (ticks of 1 ms as
+ * ftime()), and diff_usec() in microseconds for the intervals of a frame
+ * or less */
+#define TIME    struct timespec
+#define get_time(t)     clock_gettime(CLOCK_MONOTONIC, &t)
+#define MSEC_OF(t)	((long) (t).tv_sec * 1000 + (t).tv_nsec / 1000000)
+#define diff_time(t2, t1)       (MSEC_OF(t2) - MSEC_OF(t1))
+#define diff_usec(t2, t1)	(((long) (t2).tv_sec - (long) (t1).tv_sec) * 1000000L\
+			+ ((long) (t2).tv_nsec - (long) (t1).tv_nsec) / 1000)
 #define TIME_UNIT 	((double) 1/1000)
+#define USEC_UNIT 	((double) 1/1000000)
 
+/* the timers (tTOTAL1, tME, ...) are kept in the session, see context.h */
 #if ((!defined(DOS)) || defined(MAIN))
 double tTIME_COST;	/* the cost of {get_time(t1),get_time(t2),diff_time()} */
-TIME tTOTAL1, tME1, tDCT1, tQUAN1;
-TIME tIDCT1, tIQUAN1;
-TIME tTOTAL2, tME2, tDCT2, tQUAN2;
-TIME tIDCT2, tIQUAN2;
-long tTOTAL, tME, tDCT, tQUAN;
-long tIDCT, tIQUAN;
-long ntTOTAL, ntME, ntDCT, ntQUAN;
-long ntIDCT, ntIQUAN;
 #else
 extern double tTIME_COST;	/* the cost of {get_time(t1),get_time(t2),diff_time()} */
-extern TIME tTOTAL1, tME1, tDCT1, tQUAN1, tIO1;
-extern TIME tIDCT1, tIQUAN1;
-extern TIME tTOTAL2, tME2, tDCT2, tQUAN2;
-extern TIME tIDCT2, tIQUAN2;
-extern long tTOTAL, tME, tDCT, tQUAN;
-extern long tIDCT, tIQUAN;
-extern long ntTOTAL, ntME, ntDCT, ntQUAN;
-extern long ntIDCT, ntIQUAN;
 #endif
 
 #endif
@@ -0,0 +1,527 @@
+/*************************************************************************
+ *
+ *	Name:	       	pipeline.c
+ *	Description:	pipelined (open-loop) motion estimation of
+ *			encoder: the ME stage estimates the frames ahead
+ *			against the original previous frames while the
+ *			encoder codes the current frame (with ME_ahead 0,
+ *			the ME stage only runs the open-loop ME of it)
+ *
+ *************************************************************************/
+
+#include "globals.h"
+#include "ctrl.h"	/* codec control: statistics, get time... */
+#include "mytime.h"     /* TIME-type variables definition & function */
+#include <pthread.h>
+
+/*************************************************************************/
+/* public */
+extern void make_pipe_state(void);
+extern void free_pipe_state(void);
+extern FSTORE *pipe_load_frame(int32 frame_ID);
+extern void piped_motion_estimation(void);
+
+/*************************************************************************/
+/* private */
+static void pipe_frame(FSTORE *fs, int32 frame_ID);
+static void *ME_stage(void *arg);
+static void open_loop_cost(void);
+#ifdef CTRL_OPEN_LOOP_COST
+static void closed_loop_ME(void);
+#endif
+static int32 squared_error_16x16(byte *ref, byte *cur, int32 stride);
+
+/* a frame in the pipeline: its original (own copy, also the reference of
+ * ME of the next frame) and the result of ME of it */
+typedef struct {
+	FSTORE *ori;
+	int32 frame_ID;
+	int16 *MTYPE;	/* MTYPE_frame, MVDH_frame and MVDV_frame of it */
+	int16 *MVDH;
+	int16 *MVDV;
+} PIPE_SLOT;
+
+/* the state of the pipeline of a session (see make_pipe_state()):
+ * ring[n % ring_size] is the n-th frame given to the pipeline, the
+ * frames from the one being coded (and the one before it, the reference
+ * of its ME) to the ME_ahead frames after it are kept in the ring */
+struct Pipe_State {
+	PIPE_SLOT *ring;
+	int16 ring_size;	/* ME_ahead + 2 */
+	int32 piped;		/* # of frames given to the pipeline */
+	int32 estimated;	/* # of frames motion-estimated */
+	int32 last_ID;		/* the last frame ID given */
+	boolean ended;		/* no more frames from the frame loader */
+
+	/* the ME stage: a thread with its own session (a copy of the
+	 * session with its own ME state and Last_update) */
+	H261_CONTEXT *ME_ctx;
+	pthread_t stage;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	boolean quit;
+
+	/* time of the ME stage and time waited for it by the encoder (in
+	 * microseconds) */
+	long tME_stage, tME_wait;
+
+	#ifdef CTRL_OPEN_LOOP_COST
+	/* MTYPE_frame, MVDH_frame, MVDV_frame and Last_update of the ME
+	 * a closed-loop encoder would run (see closed_loop_ME()) */
+	int16 *CL_MTYPE, *CL_MVDH, *CL_MVDV, *CL_Last_update;
+	#endif
+};
+
+#define Pipe_state	(Ctx->Pipe_state)
+#define ring		(Pipe_state->ring)
+#define ring_size	(Pipe_state->ring_size)
+#define piped		(Pipe_state->piped)
+#define estimated	(Pipe_state->estimated)
+#define pipe_lock	(Pipe_state->lock)
+#define pipe_cond	(Pipe_state->cond)
+
+/*************************************************************************
+ *
+ *	Name:		make_pipe_state()
+ *	Description:	make the pipeline of the bound (encoder) session,
+ *			and start the ME stage of it
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	Pipe_state will be allocated, exit while error
+ *			occurs
+ *
+ *************************************************************************/
+void make_pipe_state(void)
+{
+	DEBUG("make_pipe_state");
+	H261_CONTEXT *ctx = Ctx;
+	int16 i;
+
+	Pipe_state = (struct Pipe_State *) calloc(1, sizeof(struct Pipe_State));
+	if (!Pipe_state) {
+		ERROR_LINE();
+		printf("Cannot allocate the state of the pipeline.\n");
+		exit(ERROR_MEMORY);
+	}
+	ring_size = ME_ahead + 2;
+	if (!(ring = (PIPE_SLOT *) calloc(ring_size, sizeof(PIPE_SLOT)))) {
+		ERROR_LINE();
+		printf("Cannot allocate the ring of the pipeline.\n");
+		exit(ERROR_MEMORY);
+	}
+	for (i=0; i<ring_size; i++) {
+		ring[i].ori = make_FS(Image->width[_Y], Image->height[_Y]);
+		ring[i].MTYPE = (int16 *) malloc(Size_frame);
+		ring[i].MVDH = (int16 *) malloc(Size_frame);
+		ring[i].MVDV = (int16 *) malloc(Size_frame);
+		if ((!ring[i].MTYPE) || (!ring[i].MVDH) || (!ring[i].MVDV)) {
+			ERROR_LINE();
+			printf("Cannot allocate the ring of the pipeline.\n");
+			exit(ERROR_MEMORY);
+		}
+	}
+	Pipe_state->last_ID = Start_frame - Frame_skip;
+	#ifdef CTRL_OPEN_LOOP_COST
+	Pipe_state->CL_MTYPE = (int16 *) calloc(1, Size_frame);
+	Pipe_state->CL_MVDH = (int16 *) calloc(1, Size_frame);
+	Pipe_state->CL_MVDV = (int16 *) calloc(1, Size_frame);
+	Pipe_state->CL_Last_update = (int16 *) calloc(1, Size_frame);
+	if ((!Pipe_state->CL_MTYPE) || (!Pipe_state->CL_MVDH) ||
+	    (!Pipe_state->CL_MVDV) || (!Pipe_state->CL_Last_update)) {
+		ERROR_LINE();
+		printf("Cannot allocate the closed-loop ME of the pipeline.\n");
+		exit(ERROR_MEMORY);
+	}
+	#endif
+	pthread_mutex_init(&pipe_lock, NULL);
+	pthread_cond_init(&pipe_cond, NULL);
+
+	/* the session of the ME stage */
+	if (!(Pipe_state->ME_ctx = (H261_CONTEXT *)
+			malloc(sizeof(H261_CONTEXT)))) {
+		ERROR_LINE();
+		printf("Cannot allocate the context of the ME stage.\n");
+		exit(ERROR_MEMORY);
+	}
+	*(Pipe_state->ME_ctx) = *ctx;
+	Ctx = Pipe_state->ME_ctx;
+	if (!(Last_update = (int16 *) calloc(1, Size_frame))) {
+		ERROR_LINE();
+		printf("Cannot allocate the context of the ME stage.\n");
+		exit(ERROR_MEMORY);
+	}
+	make_ME_state();
+	Ctx = ctx;
+
+	if (pthread_create(&Pipe_state->stage, NULL, ME_stage,
+			(void *) Pipe_state->ME_ctx)) {
+		ERROR_LINE();
+		printf("Cannot create the thread of the ME stage.\n");
+		exit(ERROR_OTHERS);
+	}
+}
+
+/*************************************************************************
+ *
+ *	Name:		free_pipe_state()
+ *	Description:	stop the ME stage and free the pipeline of the
+ *			bound session
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	the statistics of the ME stage are added to the
+ *			session, and Pipe_state is reset to NULL
+ *
+ *************************************************************************/
+void free_pipe_state(void)
+{
+	DEBUG("free_pipe_state");
+	H261_CONTEXT *ctx = Ctx;
+	int16 i;
+	int32 candidates, coarse, MBs;
+	long t, nt;
+
+	if (!Pipe_state) return;
+
+	pthread_mutex_lock(&pipe_lock);
+	Pipe_state->quit = TRUE;
+	pthread_cond_broadcast(&pipe_cond);
+	pthread_mutex_unlock(&pipe_lock);
+	pthread_join(Pipe_state->stage, NULL);
+	pthread_mutex_destroy(&pipe_lock);
+	pthread_cond_destroy(&pipe_cond);
+
+	/* the statistics of ME are of the session of the ME stage */
+	Ctx = Pipe_state->ME_ctx;
+	candidates = ME_candidates;
+	coarse = ME_coarse;
+	MBs = ME_MBs;
+	t = tME;
+	nt = ntME;
+	free_ME_state();
+	free(Last_update);
+	Ctx = ctx;
+	free(Pipe_state->ME_ctx);
+
+	ME_candidates += candidates;
+	ME_coarse += coarse;
+	ME_MBs += MBs;
+	tME += t;
+	ntME += nt;
+	tPIPE = Pipe_state->tME_stage;
+	tPIPE_wait = Pipe_state->tME_wait;
+
+	for (i=0; i<ring_size; i++) {
+		free_FS(ring[i].ori);
+		free(ring[i].MTYPE);
+		free(ring[i].MVDH);
+		free(ring[i].MVDV);
+	}
+	free(ring);
+	#ifdef CTRL_OPEN_LOOP_COST
+	free(Pipe_state->CL_MTYPE);
+	free(Pipe_state->CL_MVDH);
+	free(Pipe_state->CL_MVDV);
+	free(Pipe_state->CL_Last_update);
+	#endif
+	free(Pipe_state);
+	Pipe_state = NULL;
+}
+
+/*************************************************************************
+ *
+ *	Name:		pipe_load_frame()
+ *	Description:	get the designated frame from the frame loader
+ *			through the pipeline: the frames till ME_ahead
+ *			frames after it are given to the ME stage
+ *	Input:		the frame ID (called after the frame before it
+ *			is encoded)
+ *	Return:		the copy of the frame in the pipeline, or NULL if
+ *			no such frame
+ *	Side effects:	the frames are loaded by load_frame()
+ *
+ *************************************************************************/
+FSTORE *pipe_load_frame(int32 frame_ID)
+{
+	DEBUG("pipe_load_frame");
+	FSTORE *fs;
+	int32 ID, n;
+
+	while ((!Pipe_state->ended) &&
+	       (Pipe_state->last_ID<frame_ID+ME_ahead*Frame_skip)) {
+		ID = Pipe_state->last_ID + Frame_skip;
+		if ((ID>End_frame) || (!(fs = load_frame(ID)))) {
+			Pipe_state->ended = TRUE;
+			break;
+		}
+		pipe_frame(fs, ID);
+		Pipe_state->last_ID = ID;
+	}
+
+	for (n=piped-1; (n>=0) && (n>piped-1-ring_size); n--)
+		if (ring[n % ring_size].frame_ID==frame_ID)
+			return ring[n % ring_size].ori;
+	return NULL;
+}
+
+/*************************************************************************
+ *
+ *	Name:		pipe_frame()
+ *	Description:	give a frame to the ME stage
+ *	Input:		the frame and its frame ID
+ *	Return:		none
+ *	Side effects:	the frame is copied into the ring, waiting while
+ *			the slot is still used by the ME stage
+ *
+ *************************************************************************/
+static void pipe_frame(FSTORE *fs, int32 frame_ID)
+{
+	DEBUG("pipe_frame");
+	PIPE_SLOT *slot = &ring[piped % ring_size];
+
+	/* the slot was the reference of ME of the frame after it */
+	pthread_mutex_lock(&pipe_lock);
+	while (estimated<piped-ring_size+2)
+		pthread_cond_wait(&pipe_cond, &pipe_lock);
+	pthread_mutex_unlock(&pipe_lock);
+
+	/* the original may be the reference of ME (with its borders) */
+	copy_FS(slot->ori, fs);
+	extend_FS(slot->ori);
+	slot->frame_ID = frame_ID;
+
+	pthread_mutex_lock(&pipe_lock);
+	piped++;
+	pthread_cond_broadcast(&pipe_cond);
+	pthread_mutex_unlock(&pipe_lock);
+}
+
+/*************************************************************************
+ *
+ *	Name:		piped_motion_estimation()
+ *	Description:	get the MVs of the current frame (got by
+ *			pipe_load_frame()) from the ME stage, and decide
+ *			the MTYPEs by them against ref_frame
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	MTYPE_frame, MVDH_frame, MVDV_frame and
+ *			Last_update will be changed, waiting for the ME
+ *			stage if needed, and exit while the frame is not in
+ *			the pipeline
+ *
+ *************************************************************************/
+void piped_motion_estimation(void)
+{
+	DEBUG("piped_motion_estimation");
+	PIPE_SLOT *slot;
+	int32 n;
+	TIME t1, t2;
+
+	for (n=piped-1; (n>=0) && (n>piped-1-ring_size); n--)
+		if (ring[n % ring_size].ori==ori_frame) break;
+	if ((n<0) || (n<=piped-1-ring_size)) {
+		ERROR_LINE();
+		printf("Frame %ld is not got by H261_load_frame().\n",
+			Current_frame);
+		exit(ERROR_OTHERS);
+	}
+	slot = &ring[n % ring_size];
+
+	get_time(t1);
+	pthread_mutex_lock(&pipe_lock);
+	while (estimated<=n) pthread_cond_wait(&pipe_cond, &pipe_lock);
+	pthread_mutex_unlock(&pipe_lock);
+	get_time(t2);
+	Pipe_state->tME_wait += diff_usec(t2, t1);
+
+	/* the MTYPEs of the ME stage are of the original frames: only its
+	 * MVs are taken (the slot is kept for the ME of the next frame) */
+	memcpy(MVDH_frame, slot->MVDH, Size_frame);
+	memcpy(MVDV_frame, slot->MVDV, Size_frame);
+	decide_MTYPE();
+
+	open_loop_cost();
+}
+
+/*************************************************************************
+ *
+ *	Name:		open_loop_cost()
+ *	Description:	sum the squared error of the prediction of the
+ *			inter MBs from ref_frame by the open-loop MVs
+ *			(as coded), and (with CTRL_OPEN_LOOP_COST) by the
+ *			MVs of closed_loop_ME() on ref_frame, for the loss
+ *			of the prediction by the open-loop MVs
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	OL_MBs, OL_SE and CL_SE will be changed
+ *
+ *************************************************************************/
+static void open_loop_cost(void)
+{
+	DEBUG("open_loop_cost");
+	extern boolean MVD_used[], Intra_used[];
+	MEM *cur = ori_frame->fs[_Y];
+	MEM *ref = ref_frame->fs[_Y];
+	int16 GOB, MB, nMB, MTYPE;
+	int32 memloc;
+	#ifdef CTRL_OPEN_LOOP_COST
+	int16 *CL_MVDH = Pipe_state->CL_MVDH;
+	int16 *CL_MVDV = Pipe_state->CL_MVDV;
+
+	closed_loop_ME();
+	#endif
+
+	for (nMB=GOB=0; GOB<Number_GOB; GOB++)
+	for (MB=0; MB<Number_MB; MB++,nMB++) {
+		MTYPE = MTYPE_frame[nMB];
+		if ((MTYPE==MB_NOT_TRANSMIT) || Intra_used[MTYPE]) continue;
+
+		memloc = YGOB_memloc[GOB] + YMB_memloc[MB];
+		OL_SE += squared_error_16x16(ref->data + memloc +
+			((MVD_used[MTYPE]) ? ((MVDV_frame[nMB]>=0) ?
+				YMVDV_memloc[MVDV_frame[nMB]] :
+				-YMVDV_memloc[-MVDV_frame[nMB]])
+				+ MVDH_frame[nMB] : 0),
+			cur->data + memloc, (int32) cur->stride);
+		#ifdef CTRL_OPEN_LOOP_COST
+		/* (the MVs of the MBs not MC in closed loop are zero) */
+		CL_SE += squared_error_16x16(ref->data + memloc +
+			((CL_MVDV[nMB]>=0) ?
+				YMVDV_memloc[CL_MVDV[nMB]] :
+				-YMVDV_memloc[-CL_MVDV[nMB]])
+				+ CL_MVDH[nMB],
+			cur->data + memloc, (int32) cur->stride);
+		#endif
+		OL_MBs++;
+	}
+}
+
+#ifdef CTRL_OPEN_LOOP_COST
+/*************************************************************************
+ *
+ *	Name:		closed_loop_ME()
+ *	Description:	run the ME of the session (the -m algorithm) on
+ *			ref_frame, as a closed-loop encoder would, with
+ *			its own MTYPEs, MVs and Last_update kept from frame
+ *			to frame (it doubles the work of ME)
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	the CL_* of the pipeline will be changed, the ME
+ *			state of the session is used (its statistics are
+ *			kept)
+ *
+ *************************************************************************/
+static void closed_loop_ME(void)
+{
+	DEBUG("closed_loop_ME");
+	int16 *MTYPE = MTYPE_frame, *MVDH = MVDH_frame, *MVDV = MVDV_frame;
+	int16 *last = Last_update;
+	int32 candidates = ME_candidates, coarse = ME_coarse, MBs = ME_MBs;
+	long t = tME, nt = ntME, ntotal = ntTOTAL;
+
+	MTYPE_frame = Pipe_state->CL_MTYPE;
+	MVDH_frame = Pipe_state->CL_MVDH;
+	MVDV_frame = Pipe_state->CL_MVDV;
+	Last_update = Pipe_state->CL_Last_update;
+	ME_open_loop = FALSE;
+	motion_estimation();
+	ME_open_loop = TRUE;
+
+	MTYPE_frame = MTYPE;
+	MVDH_frame = MVDH;
+	MVDV_frame = MVDV;
+	Last_update = last;
+	ME_candidates = candidates;
+	ME_coarse = coarse;
+	ME_MBs = MBs;
+	tME = t;
+	ntME = nt;
+	ntTOTAL = ntotal;
+}
+#endif
+
+/*************************************************************************
+ *
+ *	Name:		squared_error_16x16()
+ *	Description:	the sum of squared differences of two 16x16 blocks
+ *	Input:		the pointers to the reference and current blocks,
+ *			and the stride of both
+ *	Return:		the squared error
+ *	Side effects:	none
+ *
+ *************************************************************************/
+static int32 squared_error_16x16(byte *ref, byte *cur, int32 stride)
+{
+	DEBUG("squared_error_16x16");
+	int16 i, j, d;
+	int32 se = 0;
+
+	for (i=0; i<16; i++, ref+=stride, cur+=stride)
+		for (j=0; j<16; j++) {
+			d = (int16) cur[j] - (int16) ref[j];
+			se += d * d;
+		}
+
+	return se;
+}
+
+/*************************************************************************
+ *
+ *	Name:		ME_stage()
+ *	Description:	the thread of the ME stage: motion-estimate each
+ *			frame given to the pipeline against the original
+ *			frame before it
+ *	Input:		the session of the ME stage
+ *	Return:		none (when quit is set)
+ *	Side effects:	the MB info. of the frames in the ring and
+ *			Last_update of the ME stage will be changed
+ *
+ *************************************************************************/
+static void *ME_stage(void *arg)
+{
+	DEBUG("ME_stage");
+	PIPE_SLOT *slot, *last;
+	int32 n;
+	boolean quit;
+	TIME t1, t2;
+
+	Ctx = (H261_CONTEXT *) arg;
+	while (TRUE) {
+		pthread_mutex_lock(&pipe_lock);
+		while ((estimated==piped) && (!Pipe_state->quit))
+			pthread_cond_wait(&pipe_cond, &pipe_lock);
+		n = estimated;
+		quit = Pipe_state->quit;
+		pthread_mutex_unlock(&pipe_lock);
+		if (quit) break;
+
+		slot = &ring[n % ring_size];
+		if (n==0) {
+			/* the 1st frame is I-frame (without MVs) */
+			memset(slot->MTYPE, INTRA, Size_frame);
+			memset(slot->MVDH, 0, Size_frame);
+			memset(slot->MVDV, 0, Size_frame);
+		} else {
+			get_time(t1);
+			/* the MVs of the last frame are the predictions */
+			last = &ring[(n-1) % ring_size];
+			memcpy(slot->MVDH, last->MVDH, Size_frame);
+			memcpy(slot->MVDV, last->MVDV, Size_frame);
+
+			ori_frame = slot->ori;
+			ref_frame = last->ori;
+			MTYPE_frame = slot->MTYPE;
+			MVDH_frame = slot->MVDH;
+			MVDV_frame = slot->MVDV;
+			motion_estimation();
+			get_time(t2);
+			Pipe_state->tME_stage += diff_usec(t2, t1);
+		}
+
+		pthread_mutex_lock(&pipe_lock);
+		estimated++;
+		pthread_cond_broadcast(&pipe_cond);
+		pthread_mutex_unlock(&pipe_lock);
+	}
+
+	return NULL;
+}
@@ -12,19 +12,75 @@
 /*************************************************************************/
 /* h261.c */
 extern void main(int argc, char **argv);
+extern boolean parse_options(int argc, char **argv, H261_PARAM *param,
+	boolean job);
+
+/*************************************************************************/
+/* libh261.c */
+extern void H261_default_param(H261_PARAM *param);
+extern void H261_bind(H261_CONTEXT *ctx);
+/* for encoder */
+extern H261_CONTEXT *H261_encoder_create(H261_PARAM *param);
+extern FSTORE *H261_load_frame(H261_CONTEXT *enc, int32 frame_ID);
+extern FSTORE *H261_encode_frame(H261_CONTEXT *enc, FSTORE *fs,
+	int32 frame_ID);
+extern void H261_encoder_flush(H261_CONTEXT *enc, int32 end_frame_ID);
+extern void H261_encoder_destroy(H261_CONTEXT *enc);
+/* for decoder */
+extern H261_CONTEXT *H261_decoder_create(H261_PARAM *param);
+extern void H261_decoder_push_bits(H261_CONTEXT *dec, byte *data, int32 len);
+extern void H261_decoder_push_bits_in_place(H261_CONTEXT *dec, byte *data,
+	int32 len);
+extern FSTORE *H261_decoder_get_frame(H261_CONTEXT *dec, int32 *frame_ID);
+extern void H261_decoder_destroy(H261_CONTEXT *dec);
+
+/*************************************************************************/
+/* server.c */
+extern void encode_server(char *job_list, int16 threads);
 
 /*************************************************************************/
 /* me.c */
 extern void motion_estimation(void);
+extern void decide_MTYPE(void);
 extern int16 full_search_ME(MEM *preBLK, MEM *curBLK);
 extern int16 three_step_search_ME(MEM *preBLK, MEM *curBLK);
 extern int16 new_three_step_search_ME(MEM *preBLK, MEM *curBLK);
 extern int16 my_search_ME(MEM *preBLK, MEM *curBLK);
+extern int16 pyramid_search_ME(MEM *preBLK, MEM *curBLK);
+extern int16 EPZS_search_ME(MEM *preBLK, MEM *curBLK);
+extern int16 diamond_search_ME(MEM *preBLK, MEM *curBLK);
+extern int16 hexagon_search_ME(MEM *preBLK, MEM *curBLK);
+extern int16 SEA_search_ME(MEM *preBLK, MEM *curBLK);
+extern int16 sub64_metric(MEM *preBLK, MEM *curBLK, int16 bound);
+extern int16 SAD_metric(MEM *preBLK, MEM *curBLK, int16 bound);
+extern int16 SATD_metric(MEM *preBLK, MEM *curBLK, int16 bound);
+extern void make_ME_state(void);
+extern void free_ME_state(void);
+extern void run_worker_tasks(int16 n, void (*function)(int16));
+
+/*************************************************************************/
+/* pipeline.c */
+extern void make_pipe_state(void);
+extern void free_pipe_state(void);
+extern FSTORE *pipe_load_frame(int32 frame_ID);
+extern void piped_motion_estimation(void);
+
+/*************************************************************************/
+/* sad.c */
+extern void init_SAD(void);
+extern void benchmark_SAD(void);
+extern int32 SAD_sub64(byte *p_ptr, byte *c_ptr, int32 width, int32 bound);
+extern int32 SAD_16x16(byte *p_ptr, byte *c_ptr, int32 width, int32 bound);
+extern int32 SATD_16x16(byte *p_ptr, byte *c_ptr, int32 width, int32 bound);
 
 /*************************************************************************/
 /* dct.c */
 extern void DCT(short int *input, short int *output);
 extern void IDCT(short int *input, short int *output);
+extern void init_DCT(void);
+extern void benchmark_DCT(void);
+extern void sparse_IDCT(int16 *block, int16 last, bytes8 mask);
+extern void DCT_blocks(int16 *x, int16 *y, int16 n);
 
 /*************************************************************************/
 /* huffman.c */
@@ -34,15 +90,16 @@ extern int16 put_VLC(int16 val, EHUFF *huff);
 /* for decoder */
 extern void init_VLD(void);
 extern int16 get_VLC(DHUFF *huff);
+extern void benchmark_VLD(void);
 
 /*************************************************************************/
 /* codec.c */
 /* for encoder */
 extern boolean quantize(boolean intra_used, int16 *block, int16 quantizer);
-extern void transfer_TCOEFF(boolean intra_used, int16 *block);
+extern int16 transfer_TCOEFF(boolean intra_used, int16 *block, bytes8 *mask);
 /* for decoder */
 extern void Iquantize(boolean intra_used, int16 *block, int16 quantizer);
-extern void Itransfer_TCOEFF(boolean intra_used, int16 *block);
+extern int16 Itransfer_TCOEFF(boolean intra_used, int16 *block, bytes8 *mask);
 extern void clip_reconstructed_block(int16 *block);
 
 /*************************************************************************/
@@ -61,7 +118,7 @@ extern int16 read_MB_header(int16 *Current_MB, int16 GQUANT, MB_HEADER *header);
 
 /*************************************************************************/
 /* memory.c */
-extern MEM *make_MEM(int16 width, int16 height);
+extern MEM *make_MEM(int16 width, int16 height, int16 border);
 extern MEM *make_MEM_ptr(int16 width, int16 height);
 extern void free_MEM(MEM *mem);
 extern FSTORE *make_FS(int16 width, int16 height);
@@ -70,7 +127,9 @@ extern void free_FS(FSTORE *fs);
 extern IMAGE *make_IMAGE(void);
 extern void alloc_mem_encoder(void);
 extern void alloc_mem_decoder(void);
+extern void free_mem_encoder(void);
 extern void copy_FS(FSTORE *fs_des, FSTORE *fs_src);
+extern void extend_FS(FSTORE *fs);
 extern void copy_block(MEM *des, MEM *src);
 extern void copy_MB(FSTORE *des, FSTORE *src);
 extern void read_MB(int16 MBbuf[6][64], FSTORE *Fs);
@@ -80,11 +139,23 @@ extern void save_residual(MEM *mem, int16 *block, boolean with_filter);
 
 /*************************************************************************/
 /* io.c */
+extern void make_IO_state(void);
+extern void free_IO_state(void);
 /* for image-files (Y, Cb and Cr) IO */
 /* 	for encoder */
 extern boolean read_and_show_frame(int32 frame_ID, FSTORE *fs);
+extern void start_frame_loader(int32 first_ID, int32 last_ID, int32 skip);
+extern FSTORE *load_frame(int32 frame_ID);
+extern void stop_frame_loader(void);
 /* 	for decoder */
 extern boolean write_or_show_frame(int32 end_frame_ID, FSTORE *fs);
+extern void start_frame_saver(void);
+extern FSTORE *get_frame_buffer(void);
+extern void release_frame_buffer(FSTORE *fs);
+extern void save_frame(int32 end_frame_ID, FSTORE *fs);
+extern void stop_frame_saver(void);
+/*	for both (_YUV or _Y4M frame files) */
+extern void close_frame_files(void);
 /* for bit-stream IO */
 /* 	for encoder (write_stream) */
 extern void open_write_stream(char *filename);
@@ -92,11 +163,17 @@ extern void close_write_stream(void);
 extern void put_bit(int16 bit);
 extern void put_n_bits(int16 n, int32 word);
 extern int32 ftell_write_stream(void);
+extern void redirect_write_stream(BIT_BUFFER *buf);
+extern void append_write_stream(BIT_BUFFER *buf);
 /* 	for decoder (read_stream) */
-extern void open_read_stream(char *filename);
+extern void open_read_stream(void);
+extern void push_read_stream(byte *data, int32 len);
+extern void push_read_stream_in_place(byte *data, int32 len);
+extern boolean PSC_in_read_stream(int32 n);
 extern void close_read_stream(void);
-extern int16 get_bit(void);
-extern int32 get_n_bits(int16 n);
+/*	get_bit(), get_n_bits(), peek_bits() and skip_bits() are in bitstream.h */
+extern int16 fill_read_cache(void);
+extern int16 eof_read_error(void);
 extern int32 ftell_read_stream(void);
 extern boolean eof_read_stream(void);
 
@@ -105,7 +182,7 @@ extern boolean eof_read_stream(void);
 extern void statistics(FSTORE *ref_fs, FSTORE *fs);
 extern void print_time(void);
 extern void print_codec_info(boolean decoder);
-extern void print_frame_info(int32 Current_frame);
+extern void print_frame_info(int32 frame_ID);
 extern void print_sequence_info(boolean decoder);
 extern double get_time_cost(void);
 
@@ -0,0 +1,486 @@
+/*************************************************************************
+ *
+ *	Name:		sad.c
+ *	Description:	SAD (sum of absolute differences) kernels for
+ *			motion estimation: the 64-point subsampled SAD
+ *			and the full 16x16 SAD of a super-block, in C and
+ *			in SSE2/AVX2 (chosen by CPUID at run time)
+ *
+ *************************************************************************/
+
+#include "globals.h"
+#include "ctrl.h"
+#include "mytime.h"     /* TIME-type variables definition & function */
+
+/* SIMD kernels need GCC (or clang) on x86 */
+#if defined(CTRL_SIMD_SAD) && defined(__GNUC__) \
+	&& (defined(__x86_64__) || defined(__i386__))
+#define SIMD_SAD
+#include <immintrin.h>
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+/*************************************************************************/
+/* public */
+extern void init_SAD(void);
+extern void benchmark_SAD(void);
+extern int32 SAD_sub64(byte *p_ptr, byte *c_ptr, int32 width, int32 bound);
+extern int32 SAD_16x16(byte *p_ptr, byte *c_ptr, int32 width, int32 bound);
+extern int32 SATD_16x16(byte *p_ptr, byte *c_ptr, int32 width, int32 bound);
+/* the chosen kernels (see use_SAD_sub64() and use_SAD_16x16()) */
+int32 (*default_SAD_sub64)(byte *, byte *, int32, int32) = SAD_sub64;
+int32 (*default_SAD_16x16)(byte *, byte *, int32, int32) = SAD_16x16;
+
+/*************************************************************************/
+/* private */
+#ifdef SIMD_SAD
+static int32 SAD_sub64_SSE2(byte *p_ptr, byte *c_ptr, int32 width, int32 bound);
+static int32 SAD_sub64_AVX2(byte *p_ptr, byte *c_ptr, int32 width, int32 bound);
+static int32 SAD_16x16_SSE2(byte *p_ptr, byte *c_ptr, int32 width, int32 bound);
+static int32 SAD_16x16_AVX2(byte *p_ptr, byte *c_ptr, int32 width, int32 bound);
+#endif
+
+/* the sample points of SAD_sub64(): 0, 4, 8, 12 in even lines and
+ * 2, 6, 10, 14 in odd lines */
+#define SUB64_EVEN(c, p) \
+	(abs(*(c) - *(p)) + abs(*((c)+4) - *((p)+4)) +\
+	 abs(*((c)+8) - *((p)+8)) + abs(*((c)+12) - *((p)+12)))
+#define SUB64_ODD(c, p) SUB64_EVEN((c)+2, (p)+2)
+
+/* the sum of a line of the super-block */
+#define SAD_LINE(c, p) \
+	(abs(*(c) - *(p)) + abs(*((c)+1) - *((p)+1)) +\
+	 abs(*((c)+2) - *((p)+2)) + abs(*((c)+3) - *((p)+3)) +\
+	 abs(*((c)+4) - *((p)+4)) + abs(*((c)+5) - *((p)+5)) +\
+	 abs(*((c)+6) - *((p)+6)) + abs(*((c)+7) - *((p)+7)) +\
+	 abs(*((c)+8) - *((p)+8)) + abs(*((c)+9) - *((p)+9)) +\
+	 abs(*((c)+10) - *((p)+10)) + abs(*((c)+11) - *((p)+11)) +\
+	 abs(*((c)+12) - *((p)+12)) + abs(*((c)+13) - *((p)+13)) +\
+	 abs(*((c)+14) - *((p)+14)) + abs(*((c)+15) - *((p)+15)))
+
+/*************************************************************************
+ *
+ *	Name:		init_SAD()
+ *	Description:	choose the SAD kernels by CPUID (SSE2 or C, or
+ *			AVX2 first if CTRL_SAD_AVX2)
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	default_SAD_sub64 and default_SAD_16x16 will be set
+ *
+ *************************************************************************/
+void init_SAD(void)
+{
+	DEBUG("init_SAD");
+
+	default_SAD_sub64 = SAD_sub64;
+	default_SAD_16x16 = SAD_16x16;
+
+	#ifdef SIMD_SAD
+	__builtin_cpu_init();
+	/* a line of a super-block is only 16 bytes, so AVX2 (2 lines in the
+	 * 2 lanes) is not faster than SSE2 with the shortcut (see -t) */
+	#ifdef CTRL_SAD_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		default_SAD_sub64 = SAD_sub64_AVX2;
+		default_SAD_16x16 = SAD_16x16_AVX2;
+	} else
+	#endif
+	if (__builtin_cpu_supports("sse2")) {
+		default_SAD_sub64 = SAD_sub64_SSE2;
+		default_SAD_16x16 = SAD_16x16_SSE2;
+	}
+	#endif
+}
+
+/*************************************************************************
+ *
+ *	Name:		SAD_sub64()
+ *	Description:	obtain the SAD of 64 points of two super-blocks
+ *			(the scalar version)
+ *	Input:		the pointers to the previous and current
+ *			super-blocks, the width of the frames and the
+ *			bound at present (upper-bound)
+ *	Return:		the SAD of two super-blocks (may not be complete:
+ *			the sum is returned after the first line making
+ *			it >= bound)
+ *	Side effects:
+ *
+ *************************************************************************/
+/* NOTE: pick 64 points only
+ *  	*---*---*---*---
+ *  	--*---*---*---*-
+ *  	*---*---*---*---
+ *  	--*---*---*---*-
+ *  	*---*---*---*---
+ * 	.....
+ */
+int32 SAD_sub64(byte *p_ptr, byte *c_ptr, int32 width, int32 bound)
+{
+	DEBUG("SAD_sub64");
+	register int32 i, ae;
+
+	for (ae=i=0; i<8; i++) {
+		/* 1st line sample points: 0, 4, 8, 12 */
+		ae += SUB64_EVEN(c_ptr, p_ptr);
+		if (ae>=bound) return ae;	/* shortcut check */
+		c_ptr += width;
+		p_ptr += width;
+
+		/* 2nd line sample points: 2, 6, 10, 14 */
+		ae += SUB64_ODD(c_ptr, p_ptr);
+		if (ae>=bound) return ae;	/* shortcut check */
+		c_ptr += width;
+		p_ptr += width;
+	}
+
+	return ae;
+}
+
+/*************************************************************************
+ *
+ *	Name:		SAD_16x16()
+ *	Description:	obtain the SAD of all 256 points of two
+ *			super-blocks (the scalar version)
+ *	Input:		the pointers to the previous and current
+ *			super-blocks, the width of the frames and the
+ *			bound at present (upper-bound)
+ *	Return:		the SAD of two super-blocks (may not be complete:
+ *			the sum is returned after the first line making
+ *			it >= bound)
+ *	Side effects:
+ *
+ *************************************************************************/
+int32 SAD_16x16(byte *p_ptr, byte *c_ptr, int32 width, int32 bound)
+{
+	DEBUG("SAD_16x16");
+	register int32 i, ae;
+
+	for (ae=i=0; i<16; i++) {
+		ae += SAD_LINE(c_ptr, p_ptr);
+		if (ae>=bound) return ae;	/* shortcut check */
+		c_ptr += width;
+		p_ptr += width;
+	}
+
+	return ae;
+}
+
+/*************************************************************************
+ *
+ *	Name:		SATD_16x16()
+ *	Description:	obtain the SATD (sum of absolute Hadamard-transformed
+ *			differences) of two super-blocks by 4x4 blocks
+ *	Input:		the pointers to the previous and current
+ *			super-blocks, the width of the frames and the
+ *			bound at present (upper-bound)
+ *	Return:		the SATD of two super-blocks (may not be complete:
+ *			the sum is returned after the first 4 lines making
+ *			it >= bound)
+ *	Side effects:
+ *
+ *************************************************************************/
+/* NOTE: not normalized (the orthonormal one is SATD/4) */
+int32 SATD_16x16(byte *p_ptr, byte *c_ptr, int32 width, int32 bound)
+{
+	DEBUG("SATD_16x16");
+	int32 i, j, k, ae, a0, a1, a2, a3;
+	int32 d[4][16];
+
+	for (ae=i=0; i<4; i++) {
+		/* horizontal transform of 4 lines */
+		for (j=0; j<4; j++,c_ptr+=width,p_ptr+=width) {
+			for (k=0; k<16; k+=4) {
+				a0 = (c_ptr[k] - p_ptr[k])
+					+ (c_ptr[k+1] - p_ptr[k+1]);
+				a1 = (c_ptr[k] - p_ptr[k])
+					- (c_ptr[k+1] - p_ptr[k+1]);
+				a2 = (c_ptr[k+2] - p_ptr[k+2])
+					+ (c_ptr[k+3] - p_ptr[k+3]);
+				a3 = (c_ptr[k+2] - p_ptr[k+2])
+					- (c_ptr[k+3] - p_ptr[k+3]);
+				d[j][k] = a0 + a2;
+				d[j][k+1] = a1 + a3;
+				d[j][k+2] = a0 - a2;
+				d[j][k+3] = a1 - a3;
+			}
+		}
+
+		/* vertical transform and the sum */
+		for (k=0; k<16; k++) {
+			a0 = d[0][k] + d[1][k];
+			a1 = d[0][k] - d[1][k];
+			a2 = d[2][k] + d[3][k];
+			a3 = d[2][k] - d[3][k];
+			ae += abs(a0+a2) + abs(a1+a3) + abs(a0-a2) + abs(a1-a3);
+		}
+		if (ae>=bound) return ae;	/* shortcut check */
+	}
+
+	return ae;
+}
+
+#ifdef SIMD_SAD
+/*************************************************************************/
+/* SIMD versions: psadbw sums the 8-byte halves of the lines, then the
+ * sum of each line is got in the registers and checked against the bound
+ * line by line, so the returned (incomplete) sum is the same as the one
+ * of the scalar version. */
+
+/* byte masks of the sample points in even and odd lines */
+#define SUB64_MASK_EVEN	0x000000ff000000ffLL
+#define SUB64_MASK_ODD	0x00ff000000ff0000LL
+
+/*************************************************************************
+ *
+ *	Name:		SAD_sub64_SSE2()
+ *	Description:	SAD_sub64() by SSE2 (2 lines at a time, with the
+ *			sum of each line as the shortcut of it)
+ *	Input:		see SAD_sub64()
+ *	Return:		see SAD_sub64()
+ *	Side effects:
+ *
+ *************************************************************************/
+/* the 4 sample points of an even line and of the odd line after it as 8
+ * words (in the 2 halves): psadbw sums each line apart, where the high
+ * bytes of the words are zeros */
+#define SUB64_POINTS_SSE2(ptr) \
+	_mm_packs_epi32(\
+	  _mm_and_si128(_mm_loadu_si128((__m128i *) (ptr)), low8),\
+	  _mm_and_si128(_mm_srli_epi32(\
+	    _mm_loadu_si128((__m128i *) ((ptr)+width)), 16), low8))
+TARGET("sse2")
+static int32 SAD_sub64_SSE2(byte *p_ptr, byte *c_ptr, int32 width, int32 bound)
+{
+	DEBUG("SAD_sub64_SSE2");
+	int32 i, ae;
+	__m128i low8, s;
+
+	low8 = _mm_set1_epi32(0xff);
+	for (ae=i=0; i<8; i++) {
+		s = _mm_sad_epu8(SUB64_POINTS_SSE2(c_ptr),
+			SUB64_POINTS_SSE2(p_ptr));
+
+		/* the same shortcut checks as SAD_sub64() */
+		ae += _mm_cvtsi128_si32(s);
+		if (ae>=bound) return ae;
+		ae += _mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+		if (ae>=bound) return ae;
+		c_ptr += (width<<1);
+		p_ptr += (width<<1);
+	}
+
+	return ae;
+}
+
+/*************************************************************************
+ *
+ *	Name:		SAD_sub64_AVX2()
+ *	Description:	SAD_sub64() by AVX2 (2 lines in the 2 lanes, with
+ *			the sum of each line as the shortcut of it)
+ *	Input:		see SAD_sub64()
+ *	Return:		see SAD_sub64()
+ *	Side effects:
+ *
+ *************************************************************************/
+TARGET("avx2")
+static int32 SAD_sub64_AVX2(byte *p_ptr, byte *c_ptr, int32 width, int32 bound)
+{
+	DEBUG("SAD_sub64_AVX2");
+	int32 i, ae;
+	__m256i mask, s;
+
+	/* even line in the low lane, odd line in the high lane */
+	mask = _mm256_set_epi64x(SUB64_MASK_ODD, SUB64_MASK_ODD,
+		SUB64_MASK_EVEN, SUB64_MASK_EVEN);
+	for (ae=i=0; i<8; i++) {
+		s = _mm256_sad_epu8(
+			_mm256_and_si256(_mm256_loadu2_m128i(
+				(__m128i *) (c_ptr+width), (__m128i *) c_ptr), mask),
+			_mm256_and_si256(_mm256_loadu2_m128i(
+				(__m128i *) (p_ptr+width), (__m128i *) p_ptr), mask));
+		/* the sum of each line in the low dword of its lane */
+		s = _mm256_add_epi32(s, _mm256_srli_si256(s, 8));
+
+		/* the same shortcut checks as SAD_sub64() */
+		ae += _mm_cvtsi128_si32(_mm256_castsi256_si128(s));
+		if (ae>=bound) return ae;
+		ae += _mm_cvtsi128_si32(_mm256_extracti128_si256(s, 1));
+		if (ae>=bound) return ae;
+		c_ptr += (width<<1);
+		p_ptr += (width<<1);
+	}
+
+	return ae;
+}
+
+/*************************************************************************
+ *
+ *	Name:		SAD_16x16_SSE2()
+ *	Description:	SAD_16x16() by SSE2 (a line at a time)
+ *	Input:		see SAD_16x16()
+ *	Return:		see SAD_16x16()
+ *	Side effects:
+ *
+ *************************************************************************/
+TARGET("sse2")
+static int32 SAD_16x16_SSE2(byte *p_ptr, byte *c_ptr, int32 width, int32 bound)
+{
+	DEBUG("SAD_16x16_SSE2");
+	int32 i, ae;
+	__m128i s;
+
+	for (ae=i=0; i<16; i++) {
+		s = _mm_sad_epu8(_mm_loadu_si128((__m128i *) c_ptr),
+			_mm_loadu_si128((__m128i *) p_ptr));
+
+		/* the same shortcut check as SAD_16x16() */
+		ae += _mm_cvtsi128_si32(_mm_add_epi32(s, _mm_srli_si128(s, 8)));
+		if (ae>=bound) return ae;
+		c_ptr += width;
+		p_ptr += width;
+	}
+
+	return ae;
+}
+
+/*************************************************************************
+ *
+ *	Name:		SAD_16x16_AVX2()
+ *	Description:	SAD_16x16() by AVX2 (2 lines in the 2 lanes, with
+ *			the sum of each line as the shortcut of it)
+ *	Input:		see SAD_16x16()
+ *	Return:		see SAD_16x16()
+ *	Side effects:
+ *
+ *************************************************************************/
+TARGET("avx2")
+static int32 SAD_16x16_AVX2(byte *p_ptr, byte *c_ptr, int32 width, int32 bound)
+{
+	DEBUG("SAD_16x16_AVX2");
+	int32 i, ae;
+	__m256i s;
+
+	for (ae=i=0; i<8; i++) {
+		s = _mm256_sad_epu8(
+			_mm256_loadu2_m128i((__m128i *) (c_ptr+width),
+				(__m128i *) c_ptr),
+			_mm256_loadu2_m128i((__m128i *) (p_ptr+width),
+				(__m128i *) p_ptr));
+		/* the sum of each line in the low dword of its lane */
+		s = _mm256_add_epi32(s, _mm256_srli_si256(s, 8));
+
+		/* the same shortcut checks as SAD_16x16() */
+		ae += _mm_cvtsi128_si32(_mm256_castsi256_si128(s));
+		if (ae>=bound) return ae;
+		ae += _mm_cvtsi128_si32(_mm256_extracti128_si256(s, 1));
+		if (ae>=bound) return ae;
+		c_ptr += (width<<1);
+		p_ptr += (width<<1);
+	}
+
+	return ae;
+}
+#endif
+
+/*************************************************************************
+ *
+ *	Name:		benchmark_SAD()
+ *	Description:	compare the speed and the results of the scalar
+ *			and SIMD SAD kernels on random CIF-sized frames
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	exit while the results are different
+ *
+ *************************************************************************/
+#define BENCH_WIDTH 352
+#define BENCH_HEIGHT 288
+#define BENCH_ROUNDS 20
+#define BENCH_KERNELS 6
+void benchmark_SAD(void)
+{
+	DEBUG("benchmark_SAD");
+	static char *name[BENCH_KERNELS] = {
+		"sub64 C", "sub64 SSE2", "sub64 AVX2",
+		"16x16 C", "16x16 SSE2", "16x16 AVX2"};
+	int32 (*kernel[BENCH_KERNELS])(byte *, byte *, int32, int32) = {
+		SAD_sub64, NULL, NULL, SAD_16x16, NULL, NULL};
+	byte *pre, *cur;
+	int32 i, k, x, y, r, n, ae, bound, sum[BENCH_KERNELS];
+	TIME t1, t2;
+	long t;
+
+	#ifdef SIMD_SAD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		kernel[1] = SAD_sub64_SSE2;
+		kernel[4] = SAD_16x16_SSE2;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		kernel[2] = SAD_sub64_AVX2;
+		kernel[5] = SAD_16x16_AVX2;
+	}
+	#endif
+
+	/* a smooth random frame, the current one is the previous one moved
+	 * by (3, 2) + noise */
+	pre = (byte *) malloc(BENCH_WIDTH * BENCH_HEIGHT);
+	cur = (byte *) malloc(BENCH_WIDTH * BENCH_HEIGHT);
+	if (!pre || !cur) {
+		ERROR_LINE();
+		printf("Cannot allocate frames for benchmark.\n");
+		exit(ERROR_MEMORY);
+	}
+	srand(261);
+	for (i=0; i<BENCH_WIDTH*BENCH_HEIGHT; i++) {
+		x = i % BENCH_WIDTH;
+		y = i / BENCH_WIDTH;
+		pre[i] = (byte) ((x*x/7 + y*y/5 + x*y/3 + (rand() & 0x1f)) & 0xff);
+	}
+	for (i=0; i<BENCH_WIDTH*BENCH_HEIGHT; i++) {
+		x = i % BENCH_WIDTH;
+		y = i / BENCH_WIDTH;
+		cur[i] = (byte) (pre[(y>=2 ? y-2 : y)*BENCH_WIDTH + (x>=3 ? x-3 : x)]
+			+ (rand() & 0x07));
+	}
+
+	/* full search of +-15 for each super-block in the middle of frames,
+	 * with the bounds as in full_search_ME() */
+	printf("SAD kernels (%dx%d, %d rounds of full search):\n",
+		BENCH_WIDTH, BENCH_HEIGHT, BENCH_ROUNDS);
+	for (k=0; k<BENCH_KERNELS; k++) {
+		if (!kernel[k]) {
+			printf("\t%-12s: not supported\n", name[k]);
+			continue;
+		}
+		get_time(t1);
+		for (sum[k]=n=r=0; r<BENCH_ROUNDS; r++) {
+			for (y=16; y<=BENCH_HEIGHT-32; y+=16)
+			for (x=16; x<=BENCH_WIDTH-32; x+=16) {
+				bound = kernel[k](pre+y*BENCH_WIDTH+x,
+					cur+y*BENCH_WIDTH+x, BENCH_WIDTH, 0x7fffffff);
+				for (i=0; i<31*31; i++,n++) {
+					ae = kernel[k](pre+(y+i/31-15)*BENCH_WIDTH
+						+(x+i%31-15), cur+y*BENCH_WIDTH+x,
+						BENCH_WIDTH, bound);
+					if (ae<bound) bound = ae;
+					sum[k] += ae;
+				}
+			}
+		}
+		get_time(t2);
+		t = diff_time(t2, t1);
+		printf("\t%-12s: %8.2f M SADs/sec\n", name[k],
+			(t>0) ? (double) n / (t * TIME_UNIT) / 1e6 : 0.0);
+
+		/* all versions must give the same (incomplete) sums */
+		if (sum[k]!=sum[(k<3) ? 0 : 3]) {
+			ERROR_LINE();
+			printf("%s is different from the C version.\n",
+				name[k]);
+			exit(ERROR_OTHERS);
+		}
+	}
+
+	free(pre);
+	free(cur);
+}
@@ -0,0 +1,408 @@
+/*************************************************************************
+ *
+ *	Name:	       	server.c
+ *	Description:	multi-session encode server: the streams of a job
+ *			list are encoded by the sessions of libh261.c, a
+ *			frame at a time, on a fixed-size pool of threads
+ *
+ *************************************************************************/
+
+#define _GNU_SOURCE		/* for pthread_setaffinity_np() */
+#include "globals.h"
+#include "mytime.h"     /* TIME-type variables definition & function */
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+/*************************************************************************/
+/* public */
+extern void encode_server(char *job_list, int16 threads);
+
+/*************************************************************************/
+/* private */
+#define MAX_JOB_LINE 1024	/* max. length of a line of the job list */
+#define MAX_JOB_ARGS 64		/* max. # of options of a job */
+
+/* a stream of the job list: the state between the frames of it */
+#define JOB struct Job
+JOB {
+	H261_PARAM param;	/* the options of the job */
+	H261_CONTEXT *enc;	/* the encoder session */
+	char *line;		/* the line of the job list (argv refer to) */
+	int32 frame_ID;		/* the next frame to be encoded */
+	FSTORE *rec;		/* the last reconstructed frame */
+	int32 frames;		/* # of frames encoded */
+	TIME ready;		/* the job is queued for the next frame */
+	TIME start, done;	/* the job is started and done */
+	long latency_sum;	/* latency (queued to encoded) of the frames */
+	long latency_max;	/* (in microseconds) */
+	JOB *next;		/* in the queue of ready jobs */
+};
+
+static JOB *read_job_list(char *job_list, int16 *number_job);
+static void *pool_thread(void *arg);
+static boolean encode_job_frame(JOB *job);
+static void finish_job(JOB *job);
+static void put_job(JOB *job);
+static JOB *get_job(void);
+
+/* the queue of ready jobs (a frame of each to be encoded) */
+static JOB *queue_head = NULL, *queue_tail = NULL;
+static int16 pending_jobs = 0;	/* # of jobs not finished */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+/* the info. of a sequence is printed by a thread at a time */
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*************************************************************************
+ *
+ *	Name:		encode_server()
+ *	Description:	encode the streams of the job list by a pool of
+ *			threads: a thread takes a ready stream, encodes
+ *			its next frame and queues it again, so that the
+ *			streams share the threads frame by frame
+ *	Input:		the job list (encoder options of a stream per
+ *			line) and # of threads (0: # of CPUs allowed)
+ *	Return:		none
+ *	Side effects:	exit while error occurs
+ *
+ *************************************************************************/
+void encode_server(char *job_list, int16 threads)
+{
+	DEBUG("encode_server");
+	JOB *jobs;
+	int16 number_job, n, ncpu;
+	int32 total_frames;
+	pthread_t *pool;
+	TIME t1, t2;
+	long t;
+	cpu_set_t allowed;	/* the CPUs the process may run on */
+	int16 cpu[CPU_SETSIZE];	/* (their numbers) */
+
+	/* the CPUs allowed (by taskset, cgroups ...), not all the online
+	 * ones */
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed)==0) {
+		for (ncpu=n=0; (n<CPU_SETSIZE) && (ncpu<CPU_COUNT(&allowed)); n++)
+			if (CPU_ISSET(n, &allowed)) cpu[ncpu++] = n;
+	} else {
+		ncpu = (int16) sysconf(_SC_NPROCESSORS_ONLN);
+		if (ncpu<1) ncpu = 1;
+		for (n=0; n<ncpu; n++) cpu[n] = n;
+	}
+	if (threads<=0) threads = ncpu;
+
+	jobs = read_job_list(job_list, &number_job);
+
+	/* create the sessions (the tables are built once for all of them)
+	 * and the frame loaders, and queue all the jobs */
+	get_time(t1);
+	for (n=0; n<number_job; n++) {
+		pthread_mutex_lock(&print_lock);
+		jobs[n].enc = H261_encoder_create(&jobs[n].param);
+		pthread_mutex_unlock(&print_lock);
+		start_frame_loader(jobs[n].param.start_frame,
+			jobs[n].param.end_frame, jobs[n].param.frame_skip);
+		jobs[n].frame_ID = jobs[n].param.start_frame;
+		get_time(jobs[n].start);
+		put_job(&jobs[n]);
+	}
+	pending_jobs = number_job;
+
+	/* run the pool, the n-th thread pinned on the n-th CPU allowed */
+	if (!(pool = (pthread_t *) malloc(sizeof(pthread_t) * threads))) {
+		ERROR_LINE();
+		printf("Cannot allocate the pool of threads.\n");
+		exit(ERROR_MEMORY);
+	}
+	for (n=0; n<threads; n++) {
+		if (pthread_create(&pool[n], NULL, pool_thread, NULL)) {
+			ERROR_LINE();
+			printf("Cannot create the thread of the pool.\n");
+			exit(ERROR_OTHERS);
+		}
+		#ifdef CTRL_PIN_THREADS
+		{
+			cpu_set_t cpus;
+
+			/* (a thread not pinned still runs, just reported) */
+			CPU_ZERO(&cpus);
+			CPU_SET(cpu[n % ncpu], &cpus);
+			if (pthread_setaffinity_np(pool[n], sizeof(cpu_set_t),
+					&cpus)) {
+				pthread_mutex_lock(&print_lock);
+				ERROR_LINE();
+				printf("Cannot pin thread %d of the pool on CPU %d.\n",
+					n, cpu[n % ncpu]);
+				pthread_mutex_unlock(&print_lock);
+			}
+		}
+		#endif
+	}
+	for (n=0; n<threads; n++)
+		pthread_join(pool[n], NULL);
+	get_time(t2);
+	t = diff_usec(t2, t1);
+	free(pool);
+
+	/* report the latency per stream and the aggregate throughput */
+	printf("\n");
+	printf("Encode Server: %d stream(s) by %d thread(s)\n",
+		number_job, threads);
+	printf("  stream  frames  avg. latency  max. latency  bitstream\n");
+	total_frames = 0;
+	for (n=0; n<number_job; n++) {
+		printf("  %6d  %6ld  %9.3f ms  %9.3f ms  %s\n", n, jobs[n].frames,
+			jobs[n].frames ? (double) jobs[n].latency_sum
+				* USEC_UNIT * 1000 / jobs[n].frames : 0.0,
+			(double) jobs[n].latency_max * USEC_UNIT * 1000,
+			jobs[n].param.image->Stream_filename);
+		total_frames += jobs[n].frames;
+		free(jobs[n].line);
+	}
+	printf("Total %ld frames in %.3f sec: %.2f frames/sec\n", total_frames,
+		t * USEC_UNIT, t ? total_frames / (t * USEC_UNIT) : 0.0);
+	free(jobs);
+}
+
+/*************************************************************************
+ *
+ *	Name:		read_job_list()
+ *	Description:	read the options of the jobs (a line per stream,
+ *			with the options of the encoder, '#' for comment)
+ *	Input:		the job list filename, and the pointer to get # of
+ *			jobs
+ *	Return:		the jobs
+ *	Side effects:	exit while error occurs
+ *
+ *************************************************************************/
+static JOB *read_job_list(char *job_list, int16 *number_job)
+{
+	DEBUG("read_job_list");
+	FILE *file;
+	char buf[MAX_JOB_LINE], *argv[MAX_JOB_ARGS], *p;
+	JOB *jobs = NULL;
+	int16 n = 0, argc;
+
+	if ((file = fopen(job_list, "r")) == NULL) {
+		ERROR_LINE();
+		printf("Cannot open job list %s.\n", job_list);
+		exit(ERROR_IO);
+	}
+	while (fgets(buf, MAX_JOB_LINE, file)) {
+		for (p=buf; *p==' ' || *p=='\t'; p++);
+		if (*p=='#' || *p=='\n' || *p=='\r' || *p=='\0') continue;
+
+		if (!(jobs = (JOB *) realloc(jobs, sizeof(JOB) * (n+1))) ||
+		    !(p = strdup(p))) {
+			ERROR_LINE();
+			printf("Cannot allocate the jobs.\n");
+			exit(ERROR_MEMORY);
+		}
+		memset(&jobs[n], 0, sizeof(JOB));
+		jobs[n].line = p;
+
+		/* split the line into the options (argv[0] for help()) */
+		argv[0] = job_list;
+		argc = 1;
+		for (p=strtok(p, " \t\r\n"); p; p=strtok(NULL, " \t\r\n")) {
+			if (argc>=MAX_JOB_ARGS) {
+				ERROR_LINE();
+				printf("Too many options of job %d in %s.\n",
+					n, job_list);
+				exit(ERROR_ARGV);
+			}
+			argv[argc++] = p;
+		}
+		if (parse_options(argc, argv, &jobs[n].param, TRUE)) {
+			ERROR_LINE();
+			printf("Job %d in %s is not an encoder job.\n",
+				n, job_list);
+			exit(ERROR_ARGV);
+		}
+		n++;
+	}
+	fclose(file);
+
+	if (n==0) {
+		ERROR_LINE();
+		printf("No job in job list %s.\n", job_list);
+		exit(ERROR_ARGV);
+	}
+	*number_job = n;
+	return jobs;
+}
+
+/*************************************************************************
+ *
+ *	Name:		pool_thread()
+ *	Description:	a thread of the pool: encode a frame of a ready
+ *			job at a time till all the jobs are finished
+ *	Input:		none
+ *	Return:		none
+ *	Side effects:	the jobs are queued again or finished
+ *
+ *************************************************************************/
+static void *pool_thread(void *arg)
+{
+	DEBUG("pool_thread");
+	JOB *job;
+
+	while ((job = get_job())) {
+		if (encode_job_frame(job)) {
+			get_time(job->ready);
+			put_job(job);
+		} else {
+			finish_job(job);
+			pthread_mutex_lock(&queue_lock);
+			if (--pending_jobs==0)
+				pthread_cond_broadcast(&queue_ready);
+			pthread_mutex_unlock(&queue_lock);
+		}
+	}
+	return NULL;
+}
+
+/*************************************************************************
+ *
+ *	Name:		encode_job_frame()
+ *	Description:	encode the next frame of a job (as the loop of
+ *			H261_encoder() in h261.c)
+ *	Input:		the job
+ *	Return:		TRUE if more frames to be encoded
+ *	Side effects:	the session is bound to the running thread
+ *
+ *************************************************************************/
+static boolean encode_job_frame(JOB *job)
+{
+	DEBUG("encode_job_frame");
+	H261_PARAM *param = &job->param;
+	FSTORE *fs;
+	TIME t;
+	long latency;
+
+	H261_bind(job->enc);
+
+	/* get a frame read (ahead) by the frame loader */
+	#ifdef CTRL_GET_TIME
+	get_time(tLOAD1);
+	#endif
+	if (!(fs = H261_load_frame(job->enc, job->frame_ID))) {
+		/* the 1st frame must be I-frame */
+		if (job->frames==0) {
+			ERROR_LINE();
+			if (param->image->read_from_files)
+				printf("No image file(s): %s.\n",
+					param->image->input_frame_prefix);
+			else
+				printf("No capture exists! <input_frame_prefix> should be specified.\n");
+			exit(ERROR_ARGV);
+		}
+		return FALSE;
+	}
+	#ifdef CTRL_GET_TIME
+	get_time(tLOAD2);
+	if (job->frames) tLOAD += diff_time(tLOAD2, tLOAD1);
+	#endif
+
+	job->rec = H261_encode_frame(job->enc, fs, job->frame_ID);
+
+	/* write out frame(s) till frame_ID */
+	write_or_show_frame(job->frame_ID, job->rec);
+
+	get_time(t);
+	if (job->frames) latency = diff_usec(t, job->ready);
+	else latency = diff_usec(t, job->start);
+	job->latency_sum += latency;
+	if (latency>job->latency_max) job->latency_max = latency;
+	job->frames++;
+
+	job->frame_ID += param->frame_skip;
+	return (job->frame_ID<=param->end_frame);
+}
+
+/*************************************************************************
+ *
+ *	Name:		finish_job()
+ *	Description:	flush and free the session of a job
+ *	Input:		the job
+ *	Return:		none
+ *	Side effects:	the info. of the sequence is printed
+ *
+ *************************************************************************/
+static void finish_job(JOB *job)
+{
+	DEBUG("finish_job");
+	H261_PARAM *param = &job->param;
+	int32 end_frame;
+
+	H261_bind(job->enc);
+	stop_frame_loader();
+	get_time(job->done);
+	#ifdef CTRL_GET_TIME
+	tSEQ = diff_time(job->done, job->start);
+	#endif
+
+	pthread_mutex_lock(&print_lock);
+	/* reset the last frame ID if un-normal break */
+	end_frame = param->end_frame;
+	if (job->frame_ID<=end_frame) {
+		/* no frame_files */
+		end_frame = job->frame_ID - param->frame_skip;
+		printf("The last frame ID is %ld.\n", end_frame);
+	}
+
+	/* write out the rest frame(s) after the last coded frame */
+	write_or_show_frame(end_frame, job->rec);
+
+	H261_encoder_flush(job->enc, end_frame);
+	pthread_mutex_unlock(&print_lock);
+	close_frame_files();
+	H261_encoder_destroy(job->enc);
+}
+
+/*************************************************************************
+ *
+ *	Name:		put_job()
+ *	Description:	queue a job ready for its next frame
+ *	Input:		the job
+ *	Return:		none
+ *	Side effects:	a thread waiting for a job is woken up
+ *
+ *************************************************************************/
+static void put_job(JOB *job)
+{
+	DEBUG("put_job");
+
+	pthread_mutex_lock(&queue_lock);
+	job->next = NULL;
+	if (queue_tail) queue_tail->next = job;
+	else queue_head = job;
+	queue_tail = job;
+	pthread_cond_signal(&queue_ready);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+/*************************************************************************
+ *
+ *	Name:		get_job()
+ *	Description:	take the first ready job from the queue
+ *	Input:		none
+ *	Return:		the job, or NULL when all the jobs are finished
+ *	Side effects:	wait while no job is ready
+ *
+ *************************************************************************/
+static JOB *get_job(void)
+{
+	DEBUG("get_job");
+	JOB *job;
+
+	pthread_mutex_lock(&queue_lock);
+	while (!queue_head && pending_jobs>0)
+		pthread_cond_wait(&queue_ready, &queue_lock);
+	if ((job = queue_head)) {
+		queue_head = job->next;
+		if (!queue_head) queue_tail = NULL;
+	}
+	pthread_mutex_unlock(&queue_lock);
+	return job;
+}
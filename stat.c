@@ -16,26 +16,24 @@
 extern void statistics(FSTORE *ref_fs, FSTORE *fs);
 extern void print_time(void);
 extern void print_codec_info(boolean decoder);
-extern void print_frame_info(int32 Current_frame);
+extern void print_frame_info(int32 frame_ID);
 extern void print_sequence_info(boolean decoder);
 extern double get_time_cost(void);
 
-extern IMAGE *Image;		/* global info. of image */
-
 /*************************************************************************/
 /* private */
 static double psnr(MEM *ref_mem, MEM *mem);
-
-#ifdef CTRL_STAT_MTYPE
-static int32 total_MTYPE_count[11] = {0,0,0,0,0,0,0,0,0,0,0};
-static int32 total_nMTYPE_mc = 0;
-static int32 total_nMTYPE_not = 0;
-#endif
-
-#ifdef CTRL_PSNR
-static double psnr_y, psnr_cb, psnr_cr;
-static double sum_psnr[NUMBER_OF_COMPONENTS] = {0, 0, 0};
-#endif
+static double squared_to_psnr(double squared, double n);
+
+/* the statistics of the bound session (see context.h) */
+#define total_MTYPE_count	(Ctx->total_MTYPE_count)
+#define total_nMTYPE_mc		(Ctx->total_nMTYPE_mc)
+#define total_nMTYPE_not	(Ctx->total_nMTYPE_not)
+#define psnr_y			(Ctx->psnr_y)
+#define psnr_cb			(Ctx->psnr_cb)
+#define psnr_cr			(Ctx->psnr_cr)
+#define sum_psnr		(Ctx->sum_psnr)
+#define last_bits		(Ctx->last_bits)
 
 /*************************************************************************
  *
@@ -73,17 +71,38 @@ void statistics(FSTORE *ref_fs, FSTORE *fs)
 static double psnr(MEM *ref_mem, MEM *mem)
 {
 	DEBUG("psnr");
-	int32 i, n;
+	int32 i, j, n;
 	double squared;
 	unsigned char *cptr, *rptr;
 
 	n = mem->width * mem->height;
 	squared = 0.0;
-	for (i=0,rptr=ref_mem->data,cptr=mem->data; i<n; i++,rptr++,cptr++)
-		squared += (double) (((*cptr)-*(rptr)) * ((*cptr)-(*rptr)));
+	for (j=0; j<mem->height; j++) {
+		rptr = ref_mem->data + j * ref_mem->stride;
+		cptr = mem->data + j * mem->stride;
+		for (i=0; i<mem->width; i++,rptr++,cptr++)
+			squared += (double)
+				(((*cptr)-*(rptr)) * ((*cptr)-(*rptr)));
+	}
+
+	return squared_to_psnr(squared, (double) n);
+}
+
+/*************************************************************************
+ *
+ *	Name:		squared_to_psnr()
+ *	Description:	obtain the psnr of the squared error of n pels
+ *	Input:		the squared error and the number of pels
+ *	Return:	       	the psnr
+ *	Side effects:
+ *
+ *************************************************************************/
+static double squared_to_psnr(double squared, double n)
+{
+	DEBUG("squared_to_psnr");
 
 	if (squared) {
-		return (10 * log10( (65025.0 * (double) n) / squared));
+		return (10 * log10( (65025.0 * n) / squared));
 	} else {
 		return 99.99;
 	}
@@ -133,13 +152,13 @@ void print_time(void)
  *************************************************************************/
 void print_codec_info(boolean decoder)
 {
-	extern int32 Start_frame, End_frame;
-	extern double Bit_rate, Frame_rate;
-
 	if (decoder) {
 		/* show info. of decoder */
 		printf("Decode %s --> ", Image->Stream_filename);
-		if (Image->write_to_files) {
+		if (Image->write_to_files
+		    && (Image->output_file_type!=_FILES)) {
+			printf("%s\n", Image->output_frame_prefix);
+		} else if (Image->write_to_files) {
 			printf("%s%ld%s %s%ld%s %s%ld%s, .....\n",
 				Image->output_frame_prefix,
 				Start_frame, Image->frame_suffix[_Y],
@@ -153,7 +172,12 @@ void print_codec_info(boolean decoder)
 	} else {
 		/* show info. of encoder */
 		printf("Encode %s <-- ", Image->Stream_filename);
-		if (Image->read_from_files) {
+		if (Image->read_from_files
+		    && (Image->input_file_type!=_FILES)) {
+			printf("%s (frame %ld - %ld)\n",
+				Image->input_frame_prefix,
+				Start_frame, End_frame);
+		} else if (Image->read_from_files) {
 			printf("%s%ld%s %s%ld%s %s%ld%s\n",
 				Image->input_frame_prefix,
 				Start_frame, Image->frame_suffix[_Y],
@@ -202,19 +226,16 @@ void print_codec_info(boolean decoder)
  *	Date: 96/04/16	Author: Chu Ching-Wen in N.T.H.U., Taiwan
  *
  *************************************************************************/
-void print_frame_info(int32 Current_frame)
+void print_frame_info(int32 frame_ID)
 {
 	DEBUG("print_frame_info");
 	#ifdef CTRL_STAT_MTYPE
-	extern int32 MTYPE_count[], nMTYPE_mc, nMTYPE_not;
 	int16 i;
 	#endif
-	extern int32 Start_frame, Total_bits;
-	static int32 last_bits = 0;
 
 	/* show bits for frame */
 	Total_bits = ftell_write_stream();
-	printf("Frame %ld:\t%ld bits\n", Current_frame,
+	printf("Frame %ld:\t%ld bits\n", frame_ID,
 		Total_bits - last_bits);
 	last_bits = Total_bits;
 
@@ -256,20 +277,12 @@ void print_frame_info(int32 Current_frame)
 void print_sequence_info(boolean decoder)
 {
 	DEBUG("print_sequence_info");
-	#ifdef CTRL_HEADER_BITS
-	extern int32 HeaderBits;
-	#endif
 	#ifdef CTRL_STAT_MTYPE
-	extern int32 MTYPE_count[], nMTYPE_mc, nMTYPE_not;
-	extern int16 Number_GOB, Number_MB;
 	int16 i;
 	#endif
 	#ifdef CTRL_GET_TIME
 	double atime;
 	#endif
-	extern int32 First_frame_bits, Total_bits;
-	extern int32 Start_frame, End_frame, Number_frame, Frame_skip;
-	extern double Bit_rate, Frame_rate;
 	int32 number_frame, image_bits;
 
 	printf("----------------------------------------\n");
@@ -334,9 +347,39 @@ void print_sequence_info(boolean decoder)
 		Total_bits -= First_frame_bits;
 		printf("\tTotal bits: %ld\n", Total_bits);
 
+		#ifdef CTRL_ME_STAT
+		if (!decoder) {
+			printf("\tME        : %s, %ld candidates  \t(%.2f per MB",
+				ME_algo_name, ME_candidates,
+				(ME_MBs>0) ? (double) ME_candidates / ME_MBs : 0.0);
+			/* and the 4x4 and 8x8 ones of the decimated frames */
+			if (ME_coarse>0) printf(", +%.2f 4x4/8x8 of pyramid",
+				(ME_MBs>0) ? (double) ME_coarse / ME_MBs : 0.0);
+			printf(")\n");
+		}
+		#endif
+		/* the PSNR (Y) of the prediction of the inter MBs by the
+		 * open-loop MVs (as coded), against the closed-loop ones */
+		if ((!decoder) && ME_open_loop && (OL_MBs>0)) {
+			printf("\tOpen-loop : prediction %.2f dB",
+				squared_to_psnr(OL_SE, 256.0 * OL_MBs));
+			#ifdef CTRL_OPEN_LOOP_COST
+			printf("\t(%.2f dB by the closed-loop MVs, %+.2f dB)\n",
+				squared_to_psnr(CL_SE, 256.0 * OL_MBs),
+				squared_to_psnr(OL_SE, 256.0 * OL_MBs)
+				- squared_to_psnr(CL_SE, 256.0 * OL_MBs));
+			#else
+			printf("\t(the cost against closed loop needs a run without -g and -f)\n");
+			#endif
+		}
+
 		#ifdef CTRL_GET_TIME
 		print_time();
 		atime = ACTUAL_TIME(tTOTAL, ntTOTAL);
+		#ifdef CTRL_VLD_STAT
+		if (decoder) printf("\tVLD       : %ld symbols  \t(%.0f symbols/sec)\n",
+			VLD_symbols, (double) VLD_symbols / atime);
+		#endif
 		printf("\tBit rate  : %.2f kbps   \t(%.2f kbps under %.2f fps)\n",
 			(double) Total_bits / 1000 / atime,
 			((double) Total_bits / number_frame) * Frame_rate / 1000,
@@ -345,6 +388,14 @@ void print_sequence_info(boolean decoder)
 			(double) number_frame / atime,
 			(double) number_frame * Bit_rate / Total_bits,
 			(double) Bit_rate / 1000);
+		if (!decoder) printf("\tThroughput: %.2f fps    \t(with I/O, %ld frames read ahead, %.2f sec waiting for frames)\n",
+			(double) number_frame / (tSEQ * TIME_UNIT),
+			Read_ahead, (double) tLOAD * TIME_UNIT);
+		if ((!decoder) && ME_ahead) printf("\tPipelined : ME %d frames ahead\t(%.2f ms of ME, %.2f ms waited, %.1f%% overlapped)\n",
+			ME_ahead, (double) tPIPE * USEC_UNIT * 1000,
+			(double) tPIPE_wait * USEC_UNIT * 1000,
+			(tPIPE>tPIPE_wait) ?
+			100.0 * (tPIPE - tPIPE_wait) / tPIPE : 0.0);
 		#endif
 
 		/* print compression rate */
@@ -376,14 +427,15 @@ double get_time_cost(void)
 
 	int32 test_time = 1000;
 	int32 i;
+	TIME t1, t2;
+	long total = 0;
 
-	tTOTAL = 0;
 	for (i=0; i<test_time; i++) {
-		get_time(tTOTAL1);
-		get_time(tTOTAL2);
-		tTOTAL += diff_time(tTOTAL2, tTOTAL1);
+		get_time(t1);
+		get_time(t2);
+		total += diff_time(t2, t1);
 	}
 
-	return ((double)tTOTAL / test_time);
+	return ((double)total / test_time);
 }
 